@@ -0,0 +1,26 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef BROADCAST_CODE_H_
+#define BROADCAST_CODE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <zephyr/bluetooth/iso.h>
+
+/* Copy the current Broadcast Code to code. Returns false when encryption is
+ * off and code was left untouched.
+ */
+bool broadcast_code_get(uint8_t code[BT_ISO_BROADCAST_CODE_SIZE]);
+
+/* Set the Broadcast Code from a string of at most 16 characters, zero padded
+ * as in BAP. NULL turns encryption off. Takes effect at the next BIG create or
+ * sync. Returns 0 or -EINVAL when str is too long.
+ */
+int broadcast_code_set(const char *str);
+
+#endif /* BROADCAST_CODE_H_ */
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef LATENCY_PROBE_H_
+#define LATENCY_PROBE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/toolchain.h>
+
+/* Time-stamped SDU for end-to-end latency measurements, sent by iso_broadcast
+ * with CONFIG_ISO_BROADCAST_PAYLOAD_LATENCY and read by iso_receive with
+ * CONFIG_ISO_LATENCY, all little-endian:
+ *
+ *   0  uint32  SDU counter
+ *   4  uint16  ISO sequence number the SDU is sent with
+ *   6  uint32  broadcaster time (us) the SDU was captured
+ *  10  uint32  broadcaster time (us) of the BIG anchor it is scheduled for, 0
+ *              when the SDU is not scheduled to an anchor
+ */
+#define LATENCY_PROBE_LEN 14
+
+#if defined(CONFIG_BT_ISO_SYNC_RECEIVER)
+BUILD_ASSERT(LATENCY_PROBE_LEN <= CONFIG_BT_ISO_RX_MTU,
+	     "CONFIG_BT_ISO_RX_MTU too small for the latency probe");
+#else
+BUILD_ASSERT(LATENCY_PROBE_LEN <= CONFIG_BT_ISO_TX_MTU,
+	     "CONFIG_BT_ISO_TX_MTU too small for the latency probe");
+#endif /* CONFIG_BT_ISO_SYNC_RECEIVER */
+
+struct latency_probe {
+	uint32_t count;
+	uint16_t seq_num;
+	uint32_t capture_us;
+	uint32_t anchor_us;
+};
+
+static inline void latency_probe_put(uint8_t *sdu, uint32_t count, uint16_t seq_num,
+				     uint32_t capture_us, uint32_t anchor_us)
+{
+	sys_put_le32(count, &sdu[0]);
+	sys_put_le16(seq_num, &sdu[4]);
+	sys_put_le32(capture_us, &sdu[6]);
+	sys_put_le32(anchor_us, &sdu[10]);
+}
+
+/* Fill in the sequence number and anchor of a probe put before it was known
+ * which SDU it is sent as, e.g. by the ISO TX thread of iso_broadcast
+ */
+static inline void latency_probe_sched(uint8_t *sdu, uint16_t seq_num, uint32_t anchor_us)
+{
+	sys_put_le16(seq_num, &sdu[4]);
+	sys_put_le32(anchor_us, &sdu[10]);
+}
+
+/* False when the SDU is too short to hold a probe */
+static inline bool latency_probe_get(const uint8_t *sdu, uint16_t len,
+				     struct latency_probe *probe)
+{
+	if (len < LATENCY_PROBE_LEN) {
+		return false;
+	}
+
+	probe->count = sys_get_le32(&sdu[0]);
+	probe->seq_num = sys_get_le16(&sdu[4]);
+	probe->capture_us = sys_get_le32(&sdu[6]);
+	probe->anchor_us = sys_get_le32(&sdu[10]);
+
+	return true;
+}
+
+#endif /* LATENCY_PROBE_H_ */
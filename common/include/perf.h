@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef PERF_H_
+#define PERF_H_
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+
+/* On hardware the DWT cycle counter (timing API) is used, the system clock of
+ * the nRF53 runs at 32768 Hz which is too coarse to time a single frame. On
+ * native_sim both the kernel clock and the simulated real time clock only
+ * advance while the simulated CPU sleeps, so the monotonic clock of the host
+ * is read through perf_native_bottom.c instead.
+ */
+#if defined(CONFIG_ARCH_POSIX)
+#include "perf_native_bottom.h"
+
+typedef uint64_t perf_ts_t;
+
+static inline void perf_init(void)
+{
+}
+
+static inline perf_ts_t perf_now(void)
+{
+	return perf_native_now_ns();
+}
+
+static inline uint32_t perf_ns(perf_ts_t start, perf_ts_t end)
+{
+	return (uint32_t)(end - start);
+}
+#else
+#include <zephyr/timing/timing.h>
+
+typedef timing_t perf_ts_t;
+
+static inline void perf_init(void)
+{
+	timing_init();
+	timing_start();
+}
+
+static inline perf_ts_t perf_now(void)
+{
+	return timing_counter_get();
+}
+
+static inline uint32_t perf_ns(perf_ts_t start, perf_ts_t end)
+{
+	return (uint32_t)timing_cycles_to_ns(timing_cycles_get(&start, &end));
+}
+#endif /* CONFIG_ARCH_POSIX */
+
+/* Running min/avg/max of a duration in nanoseconds */
+struct perf_stat {
+	uint32_t min;
+	uint32_t max;
+	uint64_t sum;
+	uint32_t count;
+};
+
+static inline void perf_stat_reset(struct perf_stat *stat)
+{
+	stat->min = UINT32_MAX;
+	stat->max = 0U;
+	stat->sum = 0U;
+	stat->count = 0U;
+}
+
+static inline void perf_stat_add(struct perf_stat *stat, uint32_t ns)
+{
+	stat->min = MIN(stat->min, ns);
+	stat->max = MAX(stat->max, ns);
+	stat->sum += ns;
+	stat->count++;
+}
+
+static inline uint32_t perf_stat_avg(const struct perf_stat *stat)
+{
+	return stat->count ? (uint32_t)(stat->sum / stat->count) : 0U;
+}
+
+static inline void perf_stat_print(const char *name, const struct perf_stat *stat)
+{
+	if (!stat->count) {
+		printk("%s: no samples\n", name);
+		return;
+	}
+
+	printk("%s: n %u min %u avg %u max %u ns\n", name, stat->count,
+	       stat->min, perf_stat_avg(stat), stat->max);
+}
+
+#endif /* PERF_H_ */
@@ -0,0 +1,18 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef PERF_NATIVE_BOTTOM_H_
+#define PERF_NATIVE_BOTTOM_H_
+
+#include <stdint.h>
+
+/* CLOCK_MONOTONIC of the host in nanoseconds. The simulated clock of native_sim
+ * only advances while the simulated CPU sleeps, so code that runs reads as
+ * taking no time on it.
+ */
+uint64_t perf_native_now_ns(void);
+
+#endif /* PERF_NATIVE_BOTTOM_H_ */
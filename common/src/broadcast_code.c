@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+
+#include "broadcast_code.h"
+
+#if defined(CONFIG_BT_ISO_SYNC_RECEIVER)
+#define CODE_ARG_HELP "Sync with and decrypt encrypted BIGs with this Broadcast Code " \
+		      "(max 16 characters)"
+#define CODE_USE "Decryption"
+#define CODE_APPLIED "BIG sync"
+#else
+#define CODE_ARG_HELP "Encrypt the BIGs with this Broadcast Code (max 16 characters)"
+#define CODE_USE "Encryption"
+#define CODE_APPLIED "BIG create"
+#endif /* CONFIG_BT_ISO_SYNC_RECEIVER */
+
+static struct k_spinlock code_lock;
+static bool code_enabled = IS_ENABLED(CONFIG_ISO_BIG_ENCRYPTION);
+static uint8_t code[BT_ISO_BROADCAST_CODE_SIZE] = CONFIG_ISO_BROADCAST_CODE;
+
+BUILD_ASSERT(sizeof(CONFIG_ISO_BROADCAST_CODE) - 1 <= BT_ISO_BROADCAST_CODE_SIZE,
+	     "CONFIG_ISO_BROADCAST_CODE is longer than 16 characters");
+
+bool broadcast_code_get(uint8_t out[BT_ISO_BROADCAST_CODE_SIZE])
+{
+	k_spinlock_key_t key = k_spin_lock(&code_lock);
+	bool enabled = code_enabled;
+
+	if (enabled) {
+		memcpy(out, code, sizeof(code));
+	}
+
+	k_spin_unlock(&code_lock, key);
+
+	return enabled;
+}
+
+int broadcast_code_set(const char *str)
+{
+	k_spinlock_key_t key;
+	size_t len = str ? strlen(str) : 0U;
+
+	if (len > BT_ISO_BROADCAST_CODE_SIZE) {
+		return -EINVAL;
+	}
+
+	key = k_spin_lock(&code_lock);
+
+	code_enabled = (str != NULL);
+	memset(code, 0, sizeof(code));
+	if (str) {
+		memcpy(code, str, len);
+	}
+
+	k_spin_unlock(&code_lock, key);
+
+	return 0;
+}
+
+#if defined(CONFIG_ARCH_POSIX)
+#include <cmdline.h>
+#include <posix_native_task.h>
+
+static char *code_arg;
+
+static void code_arg_found(char *argv, int offset)
+{
+	ARG_UNUSED(argv);
+	ARG_UNUSED(offset);
+
+	if (broadcast_code_set(code_arg)) {
+		printk("Broadcast Code %s too long, ignored\n", code_arg);
+	}
+}
+
+static void broadcast_code_options(void)
+{
+	static struct args_struct_t code_opts[] = {
+		{
+			.option = "broadcast-code",
+			.name = "code",
+			.type = 's',
+			.dest = (void *)&code_arg,
+			.call_when_found = code_arg_found,
+			.descript = CODE_ARG_HELP,
+		},
+		ARG_TABLE_ENDMARKER,
+	};
+
+	native_add_command_line_opts(code_opts);
+}
+NATIVE_TASK(broadcast_code_options, PRE_BOOT_1, 1);
+#endif /* CONFIG_ARCH_POSIX */
+
+#if defined(CONFIG_SHELL)
+#include <zephyr/shell/shell.h>
+
+static int cmd_broadcast_code(const struct shell *sh, size_t argc, char **argv)
+{
+	const char *str = argv[1];
+
+	if (!strcmp(str, "off")) {
+		str = NULL;
+	}
+
+	if (broadcast_code_set(str)) {
+		shell_error(sh, "Broadcast Code is at most %u characters",
+			    BT_ISO_BROADCAST_CODE_SIZE);
+		return -EINVAL;
+	}
+
+	shell_print(sh, CODE_USE " %s, applied at the next " CODE_APPLIED,
+		    str ? "on" : "off");
+
+	return 0;
+}
+
+SHELL_CMD_ARG_REGISTER(broadcast_code, NULL, "<code>|off", cmd_broadcast_code, 2, 0);
+#endif /* CONFIG_SHELL */
@@ -0,0 +1,23 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* Built into the native_sim runner against the host C library, see
+ * perf_native_bottom.h
+ */
+
+#include <stdint.h>
+#include <time.h>
+
+#include "perf_native_bottom.h"
+
+uint64_t perf_native_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
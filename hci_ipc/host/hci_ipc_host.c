@@ -0,0 +1,321 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* Host side HCI driver for the hci_ipc sample. Same as Zephyr's
+ * CONFIG_BT_HCI_IPC driver, but a message from the controller may hold several
+ * H:4 packets, as sent by hci_ipc with CONFIG_HCI_IPC_BATCH.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/sys/byteorder.h>
+
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/hci.h>
+#include <zephyr/bluetooth/buf.h>
+#include <zephyr/drivers/bluetooth/hci_driver.h>
+
+#include <zephyr/ipc/ipc_service.h>
+
+#include <zephyr/logging/log.h>
+
+#include "hci_ipc_host.h"
+#include "hci_ipc_msg.h"
+
+LOG_MODULE_REGISTER(hci_ipc_host, CONFIG_HCI_IPC_HOST_LOG_LEVEL);
+
+#define IPC_BOUND_TIMEOUT_IN_MS K_MSEC(1000)
+
+static struct ipc_ept hci_ept;
+#if defined(CONFIG_HCI_IPC_HOST_ISO_EPT)
+static struct ipc_ept hci_iso_ept;
+#define IPC_EPT_COUNT 2
+#else
+#define IPC_EPT_COUNT 1
+#endif /* CONFIG_HCI_IPC_HOST_ISO_EPT */
+static K_SEM_DEFINE(ipc_bound_sem, 0, IPC_EPT_COUNT);
+
+#if CONFIG_HCI_IPC_HOST_STATS_INTERVAL_S > 0
+static uint32_t stats_start;
+static uint32_t stats_pkts;
+static uint32_t stats_msgs;
+
+static void stats_update(uint32_t pkts)
+{
+	uint32_t now = k_uptime_get_32();
+	uint32_t elapsed;
+
+	stats_pkts += pkts;
+	stats_msgs++;
+
+	elapsed = now - stats_start;
+	if (elapsed < CONFIG_HCI_IPC_HOST_STATS_INTERVAL_S * MSEC_PER_SEC) {
+		return;
+	}
+
+	LOG_INF("IPC RX: %u packets/s in %u messages/s (interrupts/s), saved %u interrupts/s",
+		stats_pkts * MSEC_PER_SEC / elapsed, stats_msgs * MSEC_PER_SEC / elapsed,
+		(stats_pkts - stats_msgs) * MSEC_PER_SEC / elapsed);
+
+	stats_start = now;
+	stats_pkts = 0U;
+	stats_msgs = 0U;
+}
+#else
+static inline void stats_update(uint32_t pkts)
+{
+}
+#endif /* CONFIG_HCI_IPC_HOST_STATS_INTERVAL_S > 0 */
+
+struct k_poll_signal hci_ipc_host_congested =
+	K_POLL_SIGNAL_INITIALIZER(hci_ipc_host_congested);
+
+static struct k_spinlock congestion_lock;
+static struct hci_ipc_host_congestion congestion;
+
+void hci_ipc_host_congestion_get(struct hci_ipc_host_congestion *out)
+{
+	K_SPINLOCK(&congestion_lock) {
+		*out = congestion;
+	}
+}
+
+/* The controller's host congestion event, consumed here instead of reaching
+ * the Bluetooth host
+ */
+static void congestion_recv(const uint8_t *data)
+{
+	const struct hci_ipc_evt_host_congestion *evt =
+		(const void *)&data[sizeof(struct bt_hci_evt_hdr)];
+	bool congested = evt->congested != 0U;
+
+	K_SPINLOCK(&congestion_lock) {
+		congestion.congested = congested;
+		congestion.congested_count = sys_le32_to_cpu(evt->congested_count);
+		congestion.blocked_ms = sys_le32_to_cpu(evt->blocked_ms);
+		congestion.dropped_reports = sys_le32_to_cpu(evt->dropped_reports);
+	}
+
+	if (congested) {
+		LOG_WRN("Controller waited for IPC buffers, %u reports dropped so far",
+			sys_le32_to_cpu(evt->dropped_reports));
+	} else {
+		LOG_INF("Controller no longer waits for IPC buffers");
+	}
+
+	k_poll_signal_raise(&hci_ipc_host_congested, congested);
+}
+
+static struct net_buf *evt_recv(const uint8_t *data, size_t len)
+{
+	const struct bt_hci_evt_hdr *hdr = (const struct bt_hci_evt_hdr *)data;
+	bool discardable = hci_ipc_evt_discardable(data, len);
+	struct net_buf *buf;
+
+	buf = bt_buf_get_evt(hdr->evt, discardable, discardable ? K_NO_WAIT : K_SECONDS(10));
+	if (!buf) {
+		if (discardable) {
+			LOG_DBG("Discarding event 0x%02x", hdr->evt);
+		} else {
+			LOG_ERR("No available event buffers!");
+		}
+		return NULL;
+	}
+
+	return buf;
+}
+
+static void pkt_recv(const uint8_t *data, size_t len)
+{
+	struct net_buf *buf;
+
+	switch (data[0]) {
+	case HCI_IPC_EVT:
+		if (hci_ipc_evt_host_congestion(&data[1], len - 1)) {
+			congestion_recv(&data[1]);
+			return;
+		}
+		buf = evt_recv(&data[1], len - 1);
+		break;
+	case HCI_IPC_ACL:
+		buf = bt_buf_get_rx(BT_BUF_ACL_IN, K_NO_WAIT);
+		break;
+	case HCI_IPC_ISO:
+		buf = bt_buf_get_rx(BT_BUF_ISO_IN, K_NO_WAIT);
+		break;
+	default:
+		LOG_ERR("Unknown HCI type %u", data[0]);
+		return;
+	}
+
+	if (!buf) {
+		if (data[0] != HCI_IPC_EVT) {
+			LOG_ERR("No available %s buffers!",
+				data[0] == HCI_IPC_ACL ? "ACL" : "ISO");
+		}
+		return;
+	}
+
+	if (len - 1 > net_buf_tailroom(buf)) {
+		LOG_ERR("Not enough space in buffer");
+		net_buf_unref(buf);
+		return;
+	}
+
+	net_buf_add_mem(buf, &data[1], len - 1);
+	bt_recv(buf);
+}
+
+static void hci_ept_recv(const void *data, size_t len, void *priv)
+{
+	const uint8_t *pkt = data;
+	uint32_t pkts = 0U;
+
+	LOG_HEXDUMP_DBG(data, len, "IPC data:");
+
+	while (len > 0) {
+		size_t pkt_len = hci_ipc_pkt_len(pkt, len);
+
+		if (pkt_len == 0 || pkt_len > len) {
+			LOG_ERR("Malformed HCI packet, %zu bytes dropped", len);
+			break;
+		}
+
+		pkt_recv(pkt, pkt_len);
+		pkts++;
+
+		pkt += pkt_len;
+		len -= pkt_len;
+	}
+
+	stats_update(pkts);
+}
+
+static void hci_ept_bound(void *priv)
+{
+	k_sem_give(&ipc_bound_sem);
+}
+
+static struct ipc_ept_cfg hci_ept_cfg = {
+	.name = "nrf_bt_hci",
+	.cb = {
+		.bound = hci_ept_bound,
+		.received = hci_ept_recv,
+	},
+};
+
+#if defined(CONFIG_HCI_IPC_HOST_ISO_EPT)
+static struct ipc_ept_cfg hci_iso_ept_cfg = {
+	.name = "nrf_bt_hci_iso",
+	.cb = {
+		.bound = hci_ept_bound,
+		.received = hci_ept_recv,
+	},
+};
+#endif /* CONFIG_HCI_IPC_HOST_ISO_EPT */
+
+/* Always consumes buf and returns 0 as Zephyr's IPC driver does: the host
+ * unrefs buf itself when send fails, an error would free it twice
+ */
+static int bt_ipc_send(struct net_buf *buf)
+{
+	struct ipc_ept *ept = &hci_ept;
+	uint8_t pkt_indicator;
+	int err;
+
+	LOG_DBG("buf %p type %u len %u", buf, bt_buf_get_type(buf), buf->len);
+
+	switch (bt_buf_get_type(buf)) {
+	case BT_BUF_ACL_OUT:
+		pkt_indicator = HCI_IPC_ACL;
+		break;
+	case BT_BUF_CMD:
+		pkt_indicator = HCI_IPC_CMD;
+		break;
+	case BT_BUF_ISO_OUT:
+		pkt_indicator = HCI_IPC_ISO;
+#if defined(CONFIG_HCI_IPC_HOST_ISO_EPT)
+		ept = &hci_iso_ept;
+#endif /* CONFIG_HCI_IPC_HOST_ISO_EPT */
+		break;
+	default:
+		LOG_ERR("Unknown type %u", bt_buf_get_type(buf));
+		goto done;
+	}
+	net_buf_push_u8(buf, pkt_indicator);
+
+	LOG_HEXDUMP_DBG(buf->data, buf->len, "Final HCI buffer:");
+
+	err = ipc_service_send(ept, buf->data, buf->len);
+	if (err < 0) {
+		LOG_ERR("Failed to send (err %d)", err);
+	}
+
+done:
+	net_buf_unref(buf);
+	return 0;
+}
+
+static int bt_ipc_open(void)
+{
+	const struct device *hci_ipc_instance = DEVICE_DT_GET(DT_CHOSEN(zephyr_bt_hci_ipc));
+	int err;
+
+	err = ipc_service_open_instance(hci_ipc_instance);
+	if (err && (err != -EALREADY)) {
+		LOG_ERR("IPC service instance initialization failed: %d", err);
+		return err;
+	}
+
+	err = ipc_service_register_endpoint(hci_ipc_instance, &hci_ept, &hci_ept_cfg);
+	if (err) {
+		LOG_ERR("Registering endpoint failed with %d", err);
+		return err;
+	}
+
+#if defined(CONFIG_HCI_IPC_HOST_ISO_EPT)
+	err = ipc_service_register_endpoint(hci_ipc_instance, &hci_iso_ept, &hci_iso_ept_cfg);
+	if (err) {
+		LOG_ERR("Registering ISO endpoint failed with %d", err);
+		return err;
+	}
+#endif /* CONFIG_HCI_IPC_HOST_ISO_EPT */
+
+	for (uint8_t i = 0U; i < IPC_EPT_COUNT; i++) {
+		err = k_sem_take(&ipc_bound_sem, IPC_BOUND_TIMEOUT_IN_MS);
+		if (err) {
+			LOG_ERR("Endpoint binding failed with %d", err);
+			return err;
+		}
+	}
+
+#if CONFIG_HCI_IPC_HOST_STATS_INTERVAL_S > 0
+	stats_start = k_uptime_get_32();
+#endif /* CONFIG_HCI_IPC_HOST_STATS_INTERVAL_S > 0 */
+
+	return 0;
+}
+
+static const struct bt_hci_driver drv = {
+	.name = "IPC",
+	.open = bt_ipc_open,
+	.send = bt_ipc_send,
+	.bus = BT_HCI_DRIVER_BUS_IPM,
+#if defined(CONFIG_BT_DRIVER_QUIRK_NO_AUTO_DLE)
+	.quirks = BT_QUIRK_NO_AUTO_DLE,
+#endif /* CONFIG_BT_DRIVER_QUIRK_NO_AUTO_DLE */
+};
+
+static int bt_ipc_init(void)
+{
+	return bt_hci_driver_register(&drv);
+}
+
+SYS_INIT(bt_ipc_init, POST_KERNEL, CONFIG_KERNEL_INIT_PRIORITY_DEVICE);
@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef HCI_IPC_HOST_H_
+#define HCI_IPC_HOST_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <zephyr/kernel.h>
+
+/* Host congestion as last reported by hci_ipc on the network core. The
+ * counters are the totals since the controller booted.
+ */
+struct hci_ipc_host_congestion {
+	bool congested;
+	uint32_t congested_count;
+	uint32_t blocked_ms;
+	uint32_t dropped_reports;
+};
+
+/* Raised by the hci_ipc host driver with result 1 when the controller had to
+ * wait for this core to free IPC buffers and with 0 once it no longer waits.
+ * Poll it to shed load, e.g. stop scanning, while the host can't keep up.
+ */
+extern struct k_poll_signal hci_ipc_host_congested;
+
+/* The last congestion report, all zero until the first one */
+void hci_ipc_host_congestion_get(struct hci_ipc_host_congestion *congestion);
+
+#endif /* HCI_IPC_HOST_H_ */
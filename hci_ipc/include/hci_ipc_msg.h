@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef HCI_IPC_MSG_H_
+#define HCI_IPC_MSG_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <zephyr/bluetooth/hci.h>
+#include <zephyr/sys/byteorder.h>
+
+/* H:4 packet indicators, the first byte of every packet in an IPC message */
+#define HCI_IPC_CMD 0x01
+#define HCI_IPC_ACL 0x02
+#define HCI_IPC_SCO 0x03
+#define HCI_IPC_EVT 0x04
+#define HCI_IPC_ISO 0x05
+
+/* An IPC message holds one or more H:4 packets back to back. Every packet is
+ * delimited by the length in its HCI header, so a batch needs no framing of
+ * its own and a message with a single packet is the classic format.
+ *
+ * Returns the length of the packet at the start of data including its
+ * indicator, or 0 when the indicator is unknown or the header is incomplete.
+ * The result can be larger than len when the payload is truncated.
+ */
+static inline size_t hci_ipc_pkt_len(const uint8_t *data, size_t len)
+{
+	const uint8_t *hdr = &data[1];
+	size_t hdr_len;
+
+	if (len < 1) {
+		return 0;
+	}
+
+	switch (data[0]) {
+	case HCI_IPC_CMD:
+		hdr_len = sizeof(struct bt_hci_cmd_hdr);
+		if (len < 1 + hdr_len) {
+			return 0;
+		}
+		return 1 + hdr_len + ((const struct bt_hci_cmd_hdr *)hdr)->param_len;
+
+	case HCI_IPC_EVT:
+		hdr_len = sizeof(struct bt_hci_evt_hdr);
+		if (len < 1 + hdr_len) {
+			return 0;
+		}
+		return 1 + hdr_len + ((const struct bt_hci_evt_hdr *)hdr)->len;
+
+	case HCI_IPC_ACL:
+		hdr_len = sizeof(struct bt_hci_acl_hdr);
+		if (len < 1 + hdr_len) {
+			return 0;
+		}
+		return 1 + hdr_len + sys_get_le16(&hdr[offsetof(struct bt_hci_acl_hdr, len)]);
+
+	case HCI_IPC_ISO:
+		hdr_len = sizeof(struct bt_hci_iso_hdr);
+		if (len < 1 + hdr_len) {
+			return 0;
+		}
+		return 1 + hdr_len +
+		       bt_iso_hdr_len(sys_get_le16(&hdr[offsetof(struct bt_hci_iso_hdr, len)]));
+
+	default:
+		return 0;
+	}
+}
+
+/* Advertising reports may be dropped when no buffer is free, the next
+ * advertisement brings the same data again. evt starts at the event header.
+ */
+static inline bool hci_ipc_evt_discardable(const uint8_t *evt, size_t len)
+{
+	const struct bt_hci_evt_hdr *hdr = (const struct bt_hci_evt_hdr *)evt;
+
+	if (len < sizeof(*hdr) + sizeof(struct bt_hci_evt_le_meta_event) ||
+	    hdr->evt != BT_HCI_EVT_LE_META_EVENT) {
+		return false;
+	}
+
+	switch (evt[sizeof(*hdr)]) {
+	case BT_HCI_EVT_LE_ADVERTISING_REPORT:
+	case BT_HCI_EVT_LE_EXT_ADVERTISING_REPORT:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* Vendor specific event sent by hci_ipc with CONFIG_HCI_IPC_TX_BACKPRESSURE
+ * every time the host becomes congested or is no longer congested. The
+ * subevent code is above the ones Zephyr's vendor specific events use. The
+ * counters are the totals since the controller booted.
+ */
+#define HCI_IPC_VS_EVT_HOST_CONGESTION 0xC0
+
+struct hci_ipc_evt_host_congestion {
+	uint8_t  subevent;
+	uint8_t  congested;
+	uint32_t congested_count;
+	uint32_t blocked_ms;
+	uint32_t dropped_reports;
+} __packed;
+
+/* True when the event at evt, starting at the event header, is the host
+ * congestion event. The host driver consumes it instead of passing it up.
+ */
+static inline bool hci_ipc_evt_host_congestion(const uint8_t *evt, size_t len)
+{
+	const struct bt_hci_evt_hdr *hdr = (const struct bt_hci_evt_hdr *)evt;
+
+	return len >= sizeof(*hdr) + sizeof(struct hci_ipc_evt_host_congestion) &&
+	       hdr->evt == BT_HCI_EVT_VENDOR &&
+	       evt[sizeof(*hdr)] == HCI_IPC_VS_EVT_HOST_CONGESTION;
+}
+
+#endif /* HCI_IPC_MSG_H_ */
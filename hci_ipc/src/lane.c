@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/logging/log.h>
+
+#include "lane.h"
+
+LOG_MODULE_DECLARE(hci_ipc, CONFIG_BT_LOG_LEVEL);
+
+static const char *const lane_str[LANE_COUNT] = {"ISO", "ACL", "CMD/EVT"};
+
+/* Sequence numbers wrap, a is older than b */
+static inline bool seq_before(uint32_t a, uint32_t b)
+{
+	return (int32_t)(a - b) < 0;
+}
+
+static inline struct lane_pkt *lane_at(struct lane *lane, uint16_t i)
+{
+	return &lane->ring[(lane->head + i) % CONFIG_HCI_IPC_LANE_DEPTH];
+}
+
+void lanes_init(struct lanes *l, const char *name)
+{
+	memset(l, 0, sizeof(*l));
+	l->name = name;
+	k_sem_init(&l->sem, 0, K_SEM_MAX_LIMIT);
+	l->stats_start = k_uptime_get_32();
+}
+
+bool lanes_put(struct lanes *l, struct net_buf *buf, enum lane_id id, bool barrier)
+{
+	struct lane *lane = &l->lane[id];
+	k_spinlock_key_t key = k_spin_lock(&l->lock);
+	struct lane_pkt *pkt;
+
+	if (lane->count == CONFIG_HCI_IPC_LANE_DEPTH) {
+		lane->stats.drops++;
+		k_spin_unlock(&l->lock, key);
+
+		__ASSERT(false, "%s %s lane full", l->name, lane_str[id]);
+		LOG_ERR("%s %s lane full, packet dropped", l->name, lane_str[id]);
+		net_buf_unref(buf);
+		return false;
+	}
+
+	pkt = lane_at(lane, lane->count);
+	pkt->buf = buf;
+	pkt->seq = l->seq++;
+	pkt->in_cyc = k_cycle_get_32();
+	pkt->barrier = barrier;
+	lane->count++;
+
+	lane->stats.depth_sum += lane->count;
+	lane->stats.depth_max = MAX(lane->stats.depth_max, lane->count);
+
+	k_spin_unlock(&l->lock, key);
+
+	k_sem_give(&l->sem);
+
+	return true;
+}
+
+bool lanes_full(struct lanes *l, enum lane_id id)
+{
+	k_spinlock_key_t key = k_spin_lock(&l->lock);
+	bool full = l->lane[id].count == CONFIG_HCI_IPC_LANE_DEPTH;
+
+	k_spin_unlock(&l->lock, key);
+
+	return full;
+}
+
+/* Called with the lock held and at least one packet queued */
+static struct lane *lanes_next(struct lanes *l)
+{
+	struct lane *first = NULL;
+	struct lane *oldest = NULL;
+	bool barrier = false;
+	uint32_t barrier_seq = 0U;
+
+	for (uint8_t id = 0U; id < LANE_COUNT; id++) {
+		struct lane *lane = &l->lane[id];
+
+		if (!lane->count) {
+			continue;
+		}
+
+		if (!first) {
+			first = lane;
+		}
+
+		if (!oldest || seq_before(lane_at(lane, 0)->seq, lane_at(oldest, 0)->seq)) {
+			oldest = lane;
+		}
+
+		/* Only the first barrier of a lane can hold others back */
+		for (uint16_t i = 0U; i < lane->count; i++) {
+			struct lane_pkt *pkt = lane_at(lane, i);
+
+			if (pkt->barrier) {
+				if (!barrier || seq_before(pkt->seq, barrier_seq)) {
+					barrier_seq = pkt->seq;
+					barrier = true;
+				}
+				break;
+			}
+		}
+	}
+
+	/* Keep the order up to the oldest barrier */
+	if (barrier && seq_before(barrier_seq, lane_at(first, 0)->seq)) {
+		return oldest;
+	}
+
+	return first;
+}
+
+struct net_buf *lanes_get(struct lanes *l, k_timeout_t timeout)
+{
+	k_spinlock_key_t key;
+	struct lane_pkt *pkt;
+	struct net_buf *buf;
+	struct lane *lane;
+	uint32_t wait_us;
+
+	if (k_sem_take(&l->sem, timeout)) {
+		return NULL;
+	}
+
+	key = k_spin_lock(&l->lock);
+
+	lane = lanes_next(l);
+	pkt = lane_at(lane, 0);
+	buf = pkt->buf;
+	wait_us = k_cyc_to_us_floor32(k_cycle_get_32() - pkt->in_cyc);
+
+	lane->head = (lane->head + 1U) % CONFIG_HCI_IPC_LANE_DEPTH;
+	lane->count--;
+
+	lane->stats.pkts++;
+	lane->stats.wait_sum_us += wait_us;
+	lane->stats.wait_max_us = MAX(lane->stats.wait_max_us, wait_us);
+
+	k_spin_unlock(&l->lock, key);
+
+	return buf;
+}
+
+uint32_t lanes_count(struct lanes *l)
+{
+	return k_sem_count_get(&l->sem);
+}
+
+void lanes_stats_update(struct lanes *l)
+{
+#if CONFIG_HCI_IPC_STATS_INTERVAL_S > 0
+	struct lane_stats stats[LANE_COUNT];
+	uint32_t now = k_uptime_get_32();
+	k_spinlock_key_t key;
+
+	if (now - l->stats_start < CONFIG_HCI_IPC_STATS_INTERVAL_S * MSEC_PER_SEC) {
+		return;
+	}
+	l->stats_start = now;
+
+	key = k_spin_lock(&l->lock);
+	for (uint8_t id = 0U; id < LANE_COUNT; id++) {
+		stats[id] = l->lane[id].stats;
+		memset(&l->lane[id].stats, 0, sizeof(l->lane[id].stats));
+	}
+	k_spin_unlock(&l->lock, key);
+
+	for (uint8_t id = 0U; id < LANE_COUNT; id++) {
+		struct lane_stats *s = &stats[id];
+
+		if (!s->pkts && !s->drops) {
+			continue;
+		}
+
+		LOG_INF("%s %s: %u packets, depth avg %u max %u, wait avg %u max %u us, "
+			"%u dropped", l->name, lane_str[id], s->pkts,
+			(uint32_t)(s->depth_sum / MAX(s->pkts, 1U)), s->depth_max,
+			(uint32_t)(s->wait_sum_us / MAX(s->pkts, 1U)), s->wait_max_us, s->drops);
+	}
+#endif /* CONFIG_HCI_IPC_STATS_INTERVAL_S > 0 */
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef LANE_H_
+#define LANE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/net/buf.h>
+
+/* Priority lanes for the HCI packets of one direction, drained in this order */
+enum lane_id {
+	LANE_ISO,
+	LANE_ACL,
+	LANE_CTRL,
+	LANE_COUNT,
+};
+
+struct lane_pkt {
+	struct net_buf *buf;
+	uint32_t seq;
+	uint32_t in_cyc;
+	bool barrier;
+};
+
+struct lane_stats {
+	uint32_t pkts;
+	uint32_t drops;
+	uint32_t depth_max;
+	uint32_t wait_max_us;
+	uint64_t depth_sum;
+	uint64_t wait_sum_us;
+};
+
+struct lane {
+	struct lane_pkt ring[CONFIG_HCI_IPC_LANE_DEPTH];
+	uint16_t head;
+	uint16_t count;
+	struct lane_stats stats;
+};
+
+/* A packet put as barrier is not overtaken by packets of a higher priority
+ * lane put after it, e.g. ISO data does not overtake the event that sets up
+ * its stream.
+ */
+struct lanes {
+	const char *name;
+	struct lane lane[LANE_COUNT];
+	struct k_spinlock lock;
+	struct k_sem sem;
+	uint32_t seq;
+	uint32_t stats_start;
+};
+
+void lanes_init(struct lanes *l, const char *name);
+
+/* Takes over the reference to buf. The caller makes sure the lane has room,
+ * see lanes_full(); a packet for a full lane is a bug, it is dropped and false
+ * returned.
+ */
+bool lanes_put(struct lanes *l, struct net_buf *buf, enum lane_id id, bool barrier);
+
+/* True when a packet for lane id can't be put */
+bool lanes_full(struct lanes *l, enum lane_id id);
+
+/* The next packet by priority, NULL on timeout */
+struct net_buf *lanes_get(struct lanes *l, k_timeout_t timeout);
+
+/* Packets queued in all lanes */
+uint32_t lanes_count(struct lanes *l);
+
+/* Log queue depth and wait time per lane every CONFIG_HCI_IPC_STATS_INTERVAL_S
+ * seconds, called by the thread that drains the lanes
+ */
+void lanes_stats_update(struct lanes *l);
+
+#endif /* LANE_H_ */
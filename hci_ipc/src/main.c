@@ -27,14 +27,34 @@
 #include <zephyr/logging/log_ctrl.h>
 #include <zephyr/logging/log.h>
 
+#include "hci_ipc_msg.h"
+#if CONFIG_HCI_IPC_STATS_INTERVAL_S > 0
+#include "perf.h"
+#endif /* CONFIG_HCI_IPC_STATS_INTERVAL_S > 0 */
+#if defined(CONFIG_HCI_IPC_LANES)
+#include "lane.h"
+#endif /* CONFIG_HCI_IPC_LANES */
+
 LOG_MODULE_REGISTER(hci_ipc, CONFIG_BT_LOG_LEVEL);
 
 static struct ipc_ept hci_ept;
+#if defined(CONFIG_HCI_IPC_ISO_EPT)
+/* ISO data in both directions, with RPMsg buffers of its own */
+static struct ipc_ept hci_iso_ept;
+#define IPC_EPT_COUNT 2
+#else
+#define IPC_EPT_COUNT 1
+#endif /* CONFIG_HCI_IPC_ISO_EPT */
 
 static K_THREAD_STACK_DEFINE(tx_thread_stack, CONFIG_BT_HCI_TX_STACK_SIZE);
 static struct k_thread tx_thread_data;
+#if defined(CONFIG_HCI_IPC_LANES)
+static struct lanes tx_lanes;
+static struct lanes rx_lanes;
+#else
 static K_FIFO_DEFINE(tx_queue);
-static K_SEM_DEFINE(ipc_bound_sem, 0, 1);
+#endif /* CONFIG_HCI_IPC_LANES */
+static K_SEM_DEFINE(ipc_bound_sem, 0, IPC_EPT_COUNT);
 #if defined(CONFIG_BT_CTLR_ASSERT_HANDLER) || defined(CONFIG_BT_HCI_VS_FATAL_ERROR)
 /* A flag used to store information if the IPC endpoint has already been bound. The end point can't
  * be used before that happens.
@@ -42,15 +62,253 @@ static K_SEM_DEFINE(ipc_bound_sem, 0, 1);
 static bool ipc_ept_ready;
 #endif /* CONFIG_BT_CTLR_ASSERT_HANDLER || CONFIG_BT_HCI_VS_FATAL_ERROR */
 
-#define HCI_IPC_CMD 0x01
-#define HCI_IPC_ACL 0x02
-#define HCI_IPC_SCO 0x03
-#define HCI_IPC_EVT 0x04
-#define HCI_IPC_ISO 0x05
-
 #define HCI_FATAL_ERR_MSG true
 #define HCI_REGULAR_MSG false
 
+#if defined(CONFIG_HCI_IPC_TX_BACKPRESSURE)
+/* Since boot: times the host was congested, time blocked waiting for it and
+ * advertising reports dropped meanwhile
+ */
+static uint32_t congested_count;
+static uint64_t blocked_us;
+static uint32_t dropped_reports;
+#endif /* CONFIG_HCI_IPC_TX_BACKPRESSURE */
+
+#if CONFIG_HCI_IPC_STATS_INTERVAL_S > 0
+/* Controller to host traffic, every IPC message is one mailbox interrupt and
+ * one RPMsg buffer on the host core
+ */
+static uint32_t stats_start;
+static uint32_t stats_pkts;
+static uint32_t stats_msgs;
+static uint32_t stats_bytes;
+
+static void stats_update(uint32_t pkts, uint32_t msgs, size_t bytes)
+{
+	uint32_t now = k_uptime_get_32();
+	uint32_t elapsed;
+
+	stats_pkts += pkts;
+	stats_msgs += msgs;
+	stats_bytes += bytes;
+
+	elapsed = now - stats_start;
+	if (elapsed < CONFIG_HCI_IPC_STATS_INTERVAL_S * MSEC_PER_SEC) {
+		return;
+	}
+
+	LOG_INF("IPC TX: %u packets/s, %u messages/s, %u bytes/s, %u.%02u packets per message",
+		stats_pkts * MSEC_PER_SEC / elapsed, stats_msgs * MSEC_PER_SEC / elapsed,
+		stats_bytes * MSEC_PER_SEC / elapsed, stats_pkts / MAX(stats_msgs, 1U),
+		(stats_pkts * 100U / MAX(stats_msgs, 1U)) % 100U);
+
+#if defined(CONFIG_HCI_IPC_TX_BACKPRESSURE)
+	LOG_INF("Host congested %u times, blocked %u ms in total, %u reports dropped",
+		congested_count, (uint32_t)(blocked_us / USEC_PER_MSEC), dropped_reports);
+#endif /* CONFIG_HCI_IPC_TX_BACKPRESSURE */
+
+	stats_start = now;
+	stats_pkts = 0U;
+	stats_msgs = 0U;
+	stats_bytes = 0U;
+}
+#else
+static inline void stats_update(uint32_t pkts, uint32_t msgs, size_t bytes)
+{
+}
+#endif /* CONFIG_HCI_IPC_STATS_INTERVAL_S > 0 */
+
+#if CONFIG_HCI_IPC_STATS_INTERVAL_S > 0
+/* Time to turn an ACL or ISO packet from the host into a net_buf, copied or
+ * in place. An in place packet costs a hold and release of the IPC buffer per
+ * message on top, timed separately.
+ */
+enum rx_path {
+	RX_PATH_COPY,
+	RX_PATH_IN_PLACE,
+	RX_PATH_COUNT,
+};
+
+static uint32_t rx_stats_start;
+static struct perf_stat rx_time_acl[RX_PATH_COUNT];
+static struct perf_stat rx_time_iso[RX_PATH_COUNT];
+static struct perf_stat rx_time_release;
+
+static void rx_time_log(const char *name, struct perf_stat *stat)
+{
+	if (stat->count) {
+		LOG_INF("IPC RX %s: %u, avg %u max %u ns", name, stat->count,
+			perf_stat_avg(stat), stat->max);
+	}
+	perf_stat_reset(stat);
+}
+
+static void rx_stats_init(void)
+{
+	perf_init();
+
+	for (uint8_t i = 0U; i < RX_PATH_COUNT; i++) {
+		perf_stat_reset(&rx_time_acl[i]);
+		perf_stat_reset(&rx_time_iso[i]);
+	}
+	perf_stat_reset(&rx_time_release);
+
+	rx_stats_start = k_uptime_get_32();
+}
+
+static void rx_stats_update(struct net_buf *buf, uint8_t pkt_indicator, uint32_t ns)
+{
+	struct perf_stat *stat = (pkt_indicator == HCI_IPC_ISO) ? rx_time_iso : rx_time_acl;
+	uint32_t now = k_uptime_get_32();
+
+	if (buf) {
+		bool in_place = (buf->flags & NET_BUF_EXTERNAL_DATA) != 0U;
+
+		perf_stat_add(&stat[in_place ? RX_PATH_IN_PLACE : RX_PATH_COPY], ns);
+	}
+
+	if (now - rx_stats_start < CONFIG_HCI_IPC_STATS_INTERVAL_S * MSEC_PER_SEC) {
+		return;
+	}
+	rx_stats_start = now;
+
+	rx_time_log("ACL copied", &rx_time_acl[RX_PATH_COPY]);
+	rx_time_log("ACL in place", &rx_time_acl[RX_PATH_IN_PLACE]);
+	rx_time_log("ISO copied", &rx_time_iso[RX_PATH_COPY]);
+	rx_time_log("ISO in place", &rx_time_iso[RX_PATH_IN_PLACE]);
+	rx_time_log("buffer releases", &rx_time_release);
+}
+#endif /* CONFIG_HCI_IPC_STATS_INTERVAL_S > 0 */
+
+#if defined(CONFIG_HCI_IPC_RX_NOCOPY)
+/* ACL and ISO packets are handed to the controller in the IPC receive buffer
+ * itself. The buffer is held until the last packet wrapped from it is freed.
+ */
+struct rx_hold {
+	struct ipc_ept *ept;
+	const void *msg;
+	atomic_t refs;
+	bool held;
+};
+
+static struct rx_hold rx_holds[CONFIG_HCI_IPC_RX_NOCOPY_COUNT];
+/* The hold of every wrapped net_buf, by buffer id */
+static uint8_t rx_hold_of[CONFIG_HCI_IPC_RX_NOCOPY_COUNT];
+/* Message being parsed, only used in the IPC receive callback */
+static struct rx_hold *rx_hold_cur;
+static bool rx_nocopy_unsupported;
+
+static void rx_hold_put(struct rx_hold *hold)
+{
+	struct ipc_ept *ept = hold->ept;
+	const void *msg = hold->msg;
+	bool held = hold->held;
+	int err;
+
+	if (atomic_dec(&hold->refs) != 1) {
+		return;
+	}
+
+	if (held) {
+#if CONFIG_HCI_IPC_STATS_INTERVAL_S > 0
+		perf_ts_t start = perf_now();
+#endif /* CONFIG_HCI_IPC_STATS_INTERVAL_S > 0 */
+
+		err = ipc_service_release_rx_buffer(ept, (void *)msg);
+		if (err < 0) {
+			LOG_ERR("Failed to release IPC buffer (err %d)", err);
+		}
+
+#if CONFIG_HCI_IPC_STATS_INTERVAL_S > 0
+		perf_stat_add(&rx_time_release, perf_ns(start, perf_now()));
+#endif /* CONFIG_HCI_IPC_STATS_INTERVAL_S > 0 */
+	}
+}
+
+static void rx_nocopy_destroy(struct net_buf *buf)
+{
+	struct rx_hold *hold = &rx_holds[rx_hold_of[net_buf_id(buf)]];
+
+	net_buf_destroy(buf);
+	rx_hold_put(hold);
+}
+
+NET_BUF_POOL_FIXED_DEFINE(rx_nocopy_pool, CONFIG_HCI_IPC_RX_NOCOPY_COUNT, 0,
+			  BT_BUF_USER_DATA_MIN, rx_nocopy_destroy);
+
+/* The parser takes the first reference, every wrapped packet one more */
+static void rx_hold_begin(struct ipc_ept *ept, const void *msg)
+{
+	rx_hold_cur = NULL;
+
+	if (rx_nocopy_unsupported) {
+		return;
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(rx_holds); i++) {
+		if (atomic_cas(&rx_holds[i].refs, 0, 1)) {
+			rx_holds[i].ept = ept;
+			rx_holds[i].msg = msg;
+			rx_holds[i].held = false;
+			rx_hold_cur = &rx_holds[i];
+			return;
+		}
+	}
+}
+
+static void rx_hold_end(void)
+{
+	if (rx_hold_cur) {
+		rx_hold_put(rx_hold_cur);
+		rx_hold_cur = NULL;
+	}
+}
+
+/* NULL when the packet has to be copied */
+static struct net_buf *rx_nocopy_wrap(enum bt_buf_type type, uint8_t *data, size_t len)
+{
+	struct rx_hold *hold = rx_hold_cur;
+	struct net_buf *buf;
+	int err;
+
+	if (!hold) {
+		return NULL;
+	}
+
+	if (!hold->held) {
+		err = ipc_service_hold_rx_buffer(hold->ept, (void *)hold->msg);
+		if (err < 0) {
+			LOG_WRN("IPC backend can't hold buffers (err %d), copying", err);
+			rx_nocopy_unsupported = true;
+			rx_hold_cur = NULL;
+			atomic_dec(&hold->refs);
+			return NULL;
+		}
+		hold->held = true;
+	}
+
+	/* Out of wrappers, the held buffer is released with the message */
+	buf = net_buf_alloc_with_data(&rx_nocopy_pool, data, len, K_NO_WAIT);
+	if (!buf) {
+		return NULL;
+	}
+
+	bt_buf_set_type(buf, type);
+	rx_hold_of[net_buf_id(buf)] = hold - rx_holds;
+	atomic_inc(&hold->refs);
+
+	return buf;
+}
+#else
+static inline void rx_hold_begin(struct ipc_ept *ept, const void *msg)
+{
+}
+
+static inline void rx_hold_end(void)
+{
+}
+#endif /* CONFIG_HCI_IPC_RX_NOCOPY */
+
 static struct net_buf *hci_ipc_cmd_recv(uint8_t *data, size_t remaining)
 {
 	struct bt_hci_cmd_hdr *hdr = (void *)data;
@@ -98,6 +356,15 @@ static struct net_buf *hci_ipc_acl_recv(uint8_t *data, size_t remaining)
 		return NULL;
 	}
 
+#if defined(CONFIG_HCI_IPC_RX_NOCOPY)
+	if (remaining == sizeof(*hdr) + sys_le16_to_cpu(hdr->len)) {
+		buf = rx_nocopy_wrap(BT_BUF_ACL_OUT, data, remaining);
+		if (buf) {
+			return buf;
+		}
+	}
+#endif /* CONFIG_HCI_IPC_RX_NOCOPY */
+
 	buf = bt_buf_get_tx(BT_BUF_ACL_OUT, K_NO_WAIT, hdr, sizeof(*hdr));
 	if (buf) {
 		data += sizeof(*hdr);
@@ -135,6 +402,15 @@ static struct net_buf *hci_ipc_iso_recv(uint8_t *data, size_t remaining)
 		return NULL;
 	}
 
+#if defined(CONFIG_HCI_IPC_RX_NOCOPY)
+	if (remaining == sizeof(*hdr) + bt_iso_hdr_len(sys_le16_to_cpu(hdr->len))) {
+		buf = rx_nocopy_wrap(BT_BUF_ISO_OUT, data, remaining);
+		if (buf) {
+			return buf;
+		}
+	}
+#endif /* CONFIG_HCI_IPC_RX_NOCOPY */
+
 	buf = bt_buf_get_tx(BT_BUF_ISO_OUT, K_NO_WAIT, hdr, sizeof(*hdr));
 	if (buf) {
 		data += sizeof(*hdr);
@@ -162,13 +438,136 @@ static struct net_buf *hci_ipc_iso_recv(uint8_t *data, size_t remaining)
 	return buf;
 }
 
-static void hci_ipc_rx(uint8_t *data, size_t len)
+#if defined(CONFIG_HCI_IPC_LANES)
+static enum lane_id lane_of(struct net_buf *buf)
+{
+	switch (bt_buf_get_type(buf)) {
+	case BT_BUF_ISO_OUT:
+	case BT_BUF_ISO_IN:
+		return LANE_ISO;
+	case BT_BUF_ACL_OUT:
+	case BT_BUF_ACL_IN:
+		return LANE_ACL;
+	default:
+		return LANE_CTRL;
+	}
+}
+
+/* Events that data must not overtake, all but the frequent reports and
+ * completed packets: e.g. ISO data sent ahead of the event that sets up its
+ * stream would be dropped by the host.
+ */
+static bool rx_barrier(struct net_buf *buf)
+{
+	struct bt_hci_evt_hdr *hdr = (void *)buf->data;
+
+	if (bt_buf_get_type(buf) != BT_BUF_EVT || buf->len < sizeof(*hdr)) {
+		return false;
+	}
+
+	if (hdr->evt == BT_HCI_EVT_NUM_COMPLETED_PACKETS ||
+	    hci_ipc_evt_discardable(buf->data, buf->len)) {
+		return false;
+	}
+
+	if (hdr->evt == BT_HCI_EVT_LE_META_EVENT && buf->len > sizeof(*hdr)) {
+		switch (buf->data[sizeof(*hdr)]) {
+		case BT_HCI_EVT_LE_PER_ADVERTISING_REPORT:
+		case BT_HCI_EVT_LE_BIGINFO_ADV_REPORT:
+			return false;
+		default:
+			break;
+		}
+	}
+
+	return true;
+}
+
+/* Every packet from the host holds a buffer of its pool until the controller
+ * is done with it, ACL and ISO data also one of the in place wrappers. A lane
+ * as deep as its pools can therefore never be full and nothing from the host
+ * is dropped.
+ */
+#if defined(CONFIG_HCI_IPC_RX_NOCOPY)
+#define TX_LANE_NOCOPY_COUNT CONFIG_HCI_IPC_RX_NOCOPY_COUNT
+#else
+#define TX_LANE_NOCOPY_COUNT 0
+#endif /* CONFIG_HCI_IPC_RX_NOCOPY */
+
+BUILD_ASSERT(CONFIG_HCI_IPC_LANE_DEPTH >= CONFIG_BT_BUF_CMD_TX_COUNT,
+	     "CONFIG_HCI_IPC_LANE_DEPTH below CONFIG_BT_BUF_CMD_TX_COUNT");
+BUILD_ASSERT(CONFIG_HCI_IPC_LANE_DEPTH >= CONFIG_BT_BUF_ACL_TX_COUNT + TX_LANE_NOCOPY_COUNT,
+	     "CONFIG_HCI_IPC_LANE_DEPTH below the ACL TX buffers");
+#if defined(CONFIG_BT_ISO)
+BUILD_ASSERT(CONFIG_HCI_IPC_LANE_DEPTH >= CONFIG_BT_ISO_TX_BUF_COUNT + TX_LANE_NOCOPY_COUNT,
+	     "CONFIG_HCI_IPC_LANE_DEPTH below the ISO TX buffers");
+#endif /* CONFIG_BT_ISO */
+
+/* Commands keep their order with the data from the host */
+static void tx_put(struct net_buf *buf)
+{
+	enum lane_id id = lane_of(buf);
+
+	lanes_put(&tx_lanes, buf, id, id == LANE_CTRL);
+}
+
+static struct net_buf *tx_get(void)
+{
+	lanes_stats_update(&tx_lanes);
+
+	return lanes_get(&tx_lanes, K_FOREVER);
+}
+
+/* Sort what the controller has queued into the lanes, then take the most
+ * urgent packet. Packets stay in the controller queue, in order, while the
+ * lane of the first one is full, so no event or data is ever dropped.
+ */
+static struct net_buf *rx_get(struct k_fifo *rx_queue, k_timeout_t timeout)
+{
+	struct net_buf *buf;
+
+	if (!lanes_count(&rx_lanes)) {
+		buf = net_buf_get(rx_queue, timeout);
+		if (!buf) {
+			return NULL;
+		}
+		lanes_put(&rx_lanes, buf, lane_of(buf), rx_barrier(buf));
+	}
+
+	while ((buf = k_fifo_peek_head(rx_queue)) && !lanes_full(&rx_lanes, lane_of(buf))) {
+		buf = net_buf_get(rx_queue, K_NO_WAIT);
+		lanes_put(&rx_lanes, buf, lane_of(buf), rx_barrier(buf));
+	}
+
+	lanes_stats_update(&rx_lanes);
+
+	return lanes_get(&rx_lanes, K_NO_WAIT);
+}
+#else
+static void tx_put(struct net_buf *buf)
+{
+	net_buf_put(&tx_queue, buf);
+}
+
+static struct net_buf *tx_get(void)
+{
+	return net_buf_get(&tx_queue, K_FOREVER);
+}
+
+static struct net_buf *rx_get(struct k_fifo *rx_queue, k_timeout_t timeout)
+{
+	return net_buf_get(rx_queue, timeout);
+}
+#endif /* CONFIG_HCI_IPC_LANES */
+
+static void hci_ipc_rx_pkt(uint8_t *data, size_t len)
 {
 	uint8_t pkt_indicator;
 	struct net_buf *buf = NULL;
 	size_t remaining = len;
-
-	LOG_HEXDUMP_DBG(data, len, "IPC data:");
+#if CONFIG_HCI_IPC_STATS_INTERVAL_S > 0
+	perf_ts_t start = perf_now();
+#endif /* CONFIG_HCI_IPC_STATS_INTERVAL_S > 0 */
 
 	pkt_indicator = *data++;
 	remaining -= sizeof(pkt_indicator);
@@ -180,10 +579,16 @@ static void hci_ipc_rx(uint8_t *data, size_t len)
 
 	case HCI_IPC_ACL:
 		buf = hci_ipc_acl_recv(data, remaining);
+#if CONFIG_HCI_IPC_STATS_INTERVAL_S > 0
+		rx_stats_update(buf, pkt_indicator, perf_ns(start, perf_now()));
+#endif /* CONFIG_HCI_IPC_STATS_INTERVAL_S > 0 */
 		break;
 
 	case HCI_IPC_ISO:
 		buf = hci_ipc_iso_recv(data, remaining);
+#if CONFIG_HCI_IPC_STATS_INTERVAL_S > 0
+		rx_stats_update(buf, pkt_indicator, perf_ns(start, perf_now()));
+#endif /* CONFIG_HCI_IPC_STATS_INTERVAL_S > 0 */
 		break;
 
 	default:
@@ -192,20 +597,48 @@ static void hci_ipc_rx(uint8_t *data, size_t len)
 	}
 
 	if (buf) {
-		net_buf_put(&tx_queue, buf);
-
 		LOG_HEXDUMP_DBG(buf->data, buf->len, "Final net buffer:");
+
+		tx_put(buf);
+	}
+}
+
+/* A message from the host can hold more than one packet */
+static void hci_ipc_rx(struct ipc_ept *ept, uint8_t *data, size_t len)
+{
+	LOG_HEXDUMP_DBG(data, len, "IPC data:");
+
+	rx_hold_begin(ept, data);
+
+	while (len > 0) {
+		size_t pkt_len = hci_ipc_pkt_len(data, len);
+
+		if (pkt_len == 0 || pkt_len > len) {
+			LOG_ERR("Malformed HCI packet, %zu bytes dropped", len);
+			break;
+		}
+
+		hci_ipc_rx_pkt(data, pkt_len);
+
+		data += pkt_len;
+		len -= pkt_len;
 	}
+
+	rx_hold_end();
 }
 
 static void tx_thread(void *p1, void *p2, void *p3)
 {
+#if defined(CONFIG_HCI_IPC_LANES)
+	uint8_t burst = 0U;
+#endif /* CONFIG_HCI_IPC_LANES */
+
 	while (1) {
 		struct net_buf *buf;
 		int err;
 
 		/* Wait until a buffer is available */
-		buf = net_buf_get(&tx_queue, K_FOREVER);
+		buf = tx_get();
 		/* Pass buffer to the stack */
 		err = bt_send(buf);
 		if (err) {
@@ -213,18 +646,29 @@ static void tx_thread(void *p1, void *p2, void *p3)
 			net_buf_unref(buf);
 		}
 
+#if defined(CONFIG_HCI_IPC_LANES)
+		/* Yield once per burst instead of between the SDUs of one
+		 * interval, the thread blocks anyway when the lanes are empty.
+		 */
+		if (!lanes_count(&tx_lanes)) {
+			burst = 0U;
+		} else if (++burst >= CONFIG_HCI_IPC_TX_BURST) {
+			burst = 0U;
+			k_yield();
+		}
+#else
 		/* Give other threads a chance to run if tx_queue keeps getting
 		 * new data all the time.
 		 */
 		k_yield();
+#endif /* CONFIG_HCI_IPC_LANES */
 	}
 }
 
-static void hci_ipc_send(struct net_buf *buf, bool is_fatal_err)
+/* Put the H:4 indicator in front of the packet, false for an unknown type */
+static bool hci_ipc_indicator_push(struct net_buf *buf)
 {
 	uint8_t pkt_indicator;
-	uint8_t retries = 0;
-	int ret;
 
 	LOG_DBG("buf %p type %u len %u", buf, bt_buf_get_type(buf), buf->len);
 
@@ -242,15 +686,251 @@ static void hci_ipc_send(struct net_buf *buf, bool is_fatal_err)
 		break;
 	default:
 		LOG_ERR("Unknown type %u", bt_buf_get_type(buf));
-		net_buf_unref(buf);
-		return;
+		return false;
 	}
 	net_buf_push_u8(buf, pkt_indicator);
 
 	LOG_HEXDUMP_DBG(buf->data, buf->len, "Final HCI buffer:");
 
+	return true;
+}
+
+/* The endpoint a packet is sent to the host on */
+static struct ipc_ept *hci_ipc_ept_of(struct net_buf *buf)
+{
+#if defined(CONFIG_HCI_IPC_ISO_EPT)
+	if (bt_buf_get_type(buf) == BT_BUF_ISO_IN) {
+		return &hci_iso_ept;
+	}
+#endif /* CONFIG_HCI_IPC_ISO_EPT */
+
+	return &hci_ept;
+}
+
+#if defined(CONFIG_HCI_IPC_TX_BACKPRESSURE)
+/* Set when the host stops freeing IPC buffers, cleared when a buffer is free
+ * again without waiting
+ */
+static bool host_congested;
+static bool tx_lend_unsupported;
+
+/* The state changed and the host has not been sent the congestion event yet */
+static bool congestion_report_pending;
+
+static void host_congested_set(bool congested)
+{
+	if (host_congested == congested) {
+		return;
+	}
+
+	host_congested = congested;
+	if (congested) {
+		congested_count++;
+		LOG_WRN("Host congested");
+	} else {
+		LOG_INF("Host no longer congested");
+	}
+
+	congestion_report_pending = true;
+}
+
+/* The host congestion event for the host driver, sent as the next packet.
+ * Congested is only seen by the host once it has freed a buffer, so it marks
+ * the episode rather than warning ahead of it.
+ */
+static struct net_buf *congestion_report_take(void)
+{
+	struct hci_ipc_evt_host_congestion *evt;
+	struct bt_hci_evt_hdr *hdr;
+	struct net_buf *buf;
+
+	if (!congestion_report_pending) {
+		return NULL;
+	}
+
+	buf = bt_buf_get_evt(BT_HCI_EVT_VENDOR, false, K_NO_WAIT);
+	if (!buf) {
+		/* retried before the next packet */
+		return NULL;
+	}
+
+	congestion_report_pending = false;
+
+	hdr = net_buf_add(buf, sizeof(*hdr));
+	hdr->evt = BT_HCI_EVT_VENDOR;
+	hdr->len = sizeof(*evt);
+
+	evt = net_buf_add(buf, sizeof(*evt));
+	evt->subevent = HCI_IPC_VS_EVT_HOST_CONGESTION;
+	evt->congested = host_congested;
+	evt->congested_count = sys_cpu_to_le32(congested_count);
+	evt->blocked_ms = sys_cpu_to_le32((uint32_t)(blocked_us / USEC_PER_MSEC));
+	evt->dropped_reports = sys_cpu_to_le32(dropped_reports);
+
+	return buf;
+}
+
+/* An IPC TX buffer of size bytes, or the largest one when the backend's are
+ * smaller. When the host holds all of them the backend puts the thread to
+ * sleep until one is freed.
+ */
+static int tx_buffer_get(struct ipc_ept *ept, void **data, uint32_t *size)
+{
+	uint32_t requested = *size;
+	int64_t start;
+	int err;
+
+	if (tx_lend_unsupported) {
+		return -ENOTSUP;
+	}
+
+	err = ipc_service_get_tx_buffer(ept, data, size, K_NO_WAIT);
+	if (err == -ENOMEM && *size > 0 && *size < requested) {
+		/* size is now that of the largest IPC buffer */
+		requested = *size;
+		err = ipc_service_get_tx_buffer(ept, data, size, K_NO_WAIT);
+	}
+
+	if (err == 0) {
+		host_congested_set(false);
+		return 0;
+	}
+
+	if (err == -ENOTSUP) {
+		tx_lend_unsupported = true;
+		return err;
+	}
+
+	host_congested_set(true);
+	start = k_uptime_ticks();
+
 	do {
-		ret = ipc_service_send(&hci_ept, buf->data, buf->len);
+		err = ipc_service_get_tx_buffer(ept, data, size, K_FOREVER);
+		if (err == -ENOMEM && *size > 0 && *size < requested) {
+			requested = *size;
+		} else if (err && err != -ENOTSUP) {
+			LOG_WRN("Host has not freed an IPC buffer (err %d)", err);
+		}
+	} while (err && err != -ENOTSUP);
+
+	blocked_us += k_ticks_to_us_floor64(k_uptime_ticks() - start);
+
+	if (err == -ENOTSUP) {
+		tx_lend_unsupported = true;
+	}
+
+	return err;
+}
+
+/* For backends that can't lend TX buffers: sleep between the attempts, longer
+ * every time, instead of yielding
+ */
+static void tx_sleep_send(struct ipc_ept *ept, const uint8_t *data, size_t len)
+{
+	uint32_t backoff_us = 50U;
+	int64_t start = 0;
+	int ret;
+
+	while ((ret = ipc_service_send(ept, data, len)) < 0) {
+		if (!start) {
+			host_congested_set(true);
+			start = k_uptime_ticks();
+		}
+
+		k_sleep(K_USEC(backoff_us));
+		backoff_us = MIN(backoff_us * 2U, 1000U);
+	}
+
+	if (start) {
+		blocked_us += k_ticks_to_us_floor64(k_uptime_ticks() - start);
+	} else {
+		host_congested_set(false);
+	}
+
+	LOG_INF("Sent message of %d bytes.", ret);
+}
+
+static void tx_wait_send(struct ipc_ept *ept, const uint8_t *data, size_t len)
+{
+	uint32_t size = len;
+	void *buf;
+	int err;
+
+	err = tx_buffer_get(ept, &buf, &size);
+	if (err == -ENOTSUP) {
+		tx_sleep_send(ept, data, len);
+		return;
+	}
+
+	if (err == 0 && size < len) {
+		(void)ipc_service_drop_tx_buffer(ept, buf);
+		err = -EMSGSIZE;
+	}
+
+	if (err) {
+		LOG_ERR("No IPC buffer for %zu bytes (err %d)", len, err);
+		return;
+	}
+
+	memcpy(buf, data, len);
+
+	err = ipc_service_send_nocopy(ept, buf, len);
+	if (err < 0) {
+		LOG_ERR("IPC send of %zu bytes failed (err %d)", len, err);
+		(void)ipc_service_drop_tx_buffer(ept, buf);
+		return;
+	}
+
+	LOG_INF("Sent message of %d bytes.", err);
+}
+#elif defined(CONFIG_HCI_IPC_TX_NOCOPY)
+static int tx_buffer_get(struct ipc_ept *ept, void **data, uint32_t *size)
+{
+	uint8_t retries = 0;
+	int err;
+
+	while (true) {
+		uint32_t requested = *size;
+
+		err = ipc_service_get_tx_buffer(ept, data, size, K_FOREVER);
+		if (err == 0) {
+			return 0;
+		}
+
+		if (err == -ENOMEM && *size > 0 && *size < requested) {
+			/* size is now that of the largest IPC buffer */
+			continue;
+		}
+
+		if (err == -ENOTSUP || err == -ENOMEM) {
+			return err;
+		}
+
+		retries++;
+		if (retries > 10) {
+			LOG_WRN("No IPC TX buffer (err %d)", err);
+			retries = 0;
+		}
+		k_yield();
+	}
+}
+#endif /* CONFIG_HCI_IPC_TX_BACKPRESSURE */
+
+static void hci_ipc_msg_send(struct ipc_ept *ept, const uint8_t *data, size_t len,
+			     bool is_fatal_err)
+{
+	uint8_t retries = 0;
+	int ret;
+
+#if defined(CONFIG_HCI_IPC_TX_BACKPRESSURE)
+	if (!is_fatal_err) {
+		tx_wait_send(ept, data, len);
+		return;
+	}
+#endif /* CONFIG_HCI_IPC_TX_BACKPRESSURE */
+
+	do {
+		ret = ipc_service_send(ept, data, len);
 		if (ret < 0) {
 			retries++;
 			if (retries > 10) {
@@ -277,10 +957,316 @@ static void hci_ipc_send(struct net_buf *buf, bool is_fatal_err)
 	} while (ret < 0);
 
 	LOG_INF("Sent message of %d bytes.", ret);
+}
+
+static void hci_ipc_send(struct net_buf *buf, bool is_fatal_err)
+{
+	struct ipc_ept *ept = hci_ipc_ept_of(buf);
+
+	if (hci_ipc_indicator_push(buf)) {
+		hci_ipc_msg_send(ept, buf->data, buf->len, is_fatal_err);
+		if (!is_fatal_err) {
+			stats_update(1U, 1U, buf->len);
+		}
+	}
 
 	net_buf_unref(buf);
 }
 
+#if defined(CONFIG_HCI_IPC_DROP_DUPLICATES)
+/* Advertising reports recently sent to the host, by a hash over everything
+ * but the RSSI
+ */
+struct report_seen {
+	uint32_t hash;
+	uint32_t time;
+};
+
+static struct report_seen reports_seen[CONFIG_HCI_IPC_DUP_CACHE_SIZE];
+static uint8_t reports_seen_next;
+
+static uint32_t report_hash(const uint8_t *data, size_t len, size_t rssi_offset)
+{
+	/* FNV-1a */
+	uint32_t hash = 2166136261U;
+
+	for (size_t i = 0; i < len; i++) {
+		if (i != rssi_offset) {
+			hash = (hash ^ data[i]) * 16777619U;
+		}
+	}
+
+	return hash;
+}
+
+/* True when the same single report event was sent within the last
+ * CONFIG_HCI_IPC_DUP_WINDOW_MS, the report is remembered either way
+ */
+static bool report_duplicate(struct net_buf *buf)
+{
+	const size_t hdr_len = sizeof(struct bt_hci_evt_hdr) +
+			       sizeof(struct bt_hci_evt_le_meta_event) + sizeof(uint8_t);
+	const uint8_t *data = buf->data;
+	uint32_t now = k_uptime_get_32();
+	size_t rssi_offset;
+	uint32_t hash;
+
+	if (buf->len < hdr_len || data[hdr_len - 1] != 1U) {
+		/* Not exactly one report */
+		return false;
+	}
+
+	if (data[sizeof(struct bt_hci_evt_hdr)] == BT_HCI_EVT_LE_ADVERTISING_REPORT) {
+		const struct bt_hci_evt_le_advertising_info *info = (void *)&data[hdr_len];
+
+		if (buf->len < hdr_len + sizeof(*info)) {
+			return false;
+		}
+		rssi_offset = hdr_len + sizeof(*info) + info->length;
+	} else {
+		rssi_offset = hdr_len + offsetof(struct bt_hci_evt_le_ext_advertising_info, rssi);
+	}
+
+	hash = report_hash(data, buf->len, rssi_offset);
+
+	for (uint8_t i = 0U; i < ARRAY_SIZE(reports_seen); i++) {
+		struct report_seen *seen = &reports_seen[i];
+
+		if (seen->time && seen->hash == hash &&
+		    now - seen->time < CONFIG_HCI_IPC_DUP_WINDOW_MS) {
+			seen->time = now;
+			return true;
+		}
+	}
+
+	reports_seen[reports_seen_next].hash = hash;
+	reports_seen[reports_seen_next].time = now ? now : 1U;
+	reports_seen_next = (reports_seen_next + 1U) % ARRAY_SIZE(reports_seen);
+
+	return false;
+}
+#endif /* CONFIG_HCI_IPC_DROP_DUPLICATES */
+
+/* Drop policy for advertising reports while the host is congested */
+static bool rx_drop(struct net_buf *buf)
+{
+#if defined(CONFIG_HCI_IPC_DROP_REPORTS) || defined(CONFIG_HCI_IPC_DROP_DUPLICATES)
+	bool drop;
+
+	if (bt_buf_get_type(buf) != BT_BUF_EVT ||
+	    !hci_ipc_evt_discardable(buf->data, buf->len)) {
+		return false;
+	}
+
+#if defined(CONFIG_HCI_IPC_DROP_DUPLICATES)
+	drop = report_duplicate(buf) && host_congested;
+#else
+	drop = host_congested;
+#endif /* CONFIG_HCI_IPC_DROP_DUPLICATES */
+
+	if (drop) {
+		dropped_reports++;
+	}
+
+	return drop;
+#else
+	return false;
+#endif /* CONFIG_HCI_IPC_DROP_REPORTS || CONFIG_HCI_IPC_DROP_DUPLICATES */
+}
+
+static struct net_buf *rx_next(struct k_fifo *rx_queue, k_timeout_t timeout)
+{
+	struct net_buf *buf;
+
+#if defined(CONFIG_HCI_IPC_TX_BACKPRESSURE)
+	buf = congestion_report_take();
+	if (buf) {
+		return buf;
+	}
+#endif /* CONFIG_HCI_IPC_TX_BACKPRESSURE */
+
+	while ((buf = rx_get(rx_queue, timeout))) {
+		if (!rx_drop(buf)) {
+			return buf;
+		}
+		net_buf_unref(buf);
+	}
+
+	return NULL;
+}
+
+#if defined(CONFIG_HCI_IPC_BATCH)
+/* Packets queued by the controller are copied back to back into one message,
+ * a batch per endpoint
+ */
+struct batch {
+	struct ipc_ept *ept;
+	uint8_t buf[CONFIG_HCI_IPC_BATCH_SIZE];
+	uint8_t *data;
+	size_t size;
+	size_t len;
+	uint32_t pkts;
+#if defined(CONFIG_HCI_IPC_TX_NOCOPY)
+	/* data is an IPC TX buffer in shared memory, sent without a copy */
+	bool nocopy;
+#endif /* CONFIG_HCI_IPC_TX_NOCOPY */
+};
+
+static struct batch batches[IPC_EPT_COUNT] = {
+	{ .ept = &hci_ept },
+#if defined(CONFIG_HCI_IPC_ISO_EPT)
+	{ .ept = &hci_iso_ept },
+#endif /* CONFIG_HCI_IPC_ISO_EPT */
+};
+
+#if defined(CONFIG_HCI_IPC_TX_NOCOPY)
+static bool tx_nocopy_unsupported;
+#endif /* CONFIG_HCI_IPC_TX_NOCOPY */
+
+static struct batch *batch_of(struct net_buf *buf)
+{
+	struct ipc_ept *ept = hci_ipc_ept_of(buf);
+
+	for (size_t i = 1; i < ARRAY_SIZE(batches); i++) {
+		if (batches[i].ept == ept) {
+			return &batches[i];
+		}
+	}
+
+	return &batches[0];
+}
+
+static void batch_begin(struct batch *b)
+{
+	b->data = b->buf;
+	b->size = sizeof(b->buf);
+
+#if defined(CONFIG_HCI_IPC_TX_NOCOPY)
+	uint32_t size = sizeof(b->buf);
+	void *data;
+	int err;
+
+	if (tx_nocopy_unsupported) {
+		return;
+	}
+
+	err = tx_buffer_get(b->ept, &data, &size);
+	if (err == 0) {
+		b->data = data;
+		b->size = MIN(size, sizeof(b->buf));
+		b->nocopy = true;
+		return;
+	}
+
+	LOG_WRN("IPC backend can't lend TX buffers (err %d), copying", err);
+	tx_nocopy_unsupported = true;
+#endif /* CONFIG_HCI_IPC_TX_NOCOPY */
+}
+
+#if defined(CONFIG_HCI_IPC_TX_NOCOPY)
+static void batch_send_nocopy(struct batch *b)
+{
+	int err;
+
+	if (b->len == 0) {
+		err = ipc_service_drop_tx_buffer(b->ept, b->data);
+		if (err < 0) {
+			LOG_ERR("Failed to drop IPC TX buffer (err %d)", err);
+		}
+		return;
+	}
+
+	err = ipc_service_send_nocopy(b->ept, b->data, b->len);
+	if (err < 0) {
+		LOG_ERR("IPC send of %zu bytes failed (err %d)", b->len, err);
+		(void)ipc_service_drop_tx_buffer(b->ept, b->data);
+		return;
+	}
+
+	LOG_INF("Sent message of %d bytes.", err);
+}
+#endif /* CONFIG_HCI_IPC_TX_NOCOPY */
+
+static void batch_flush(struct batch *b)
+{
+	if (!b->data) {
+		return;
+	}
+
+#if defined(CONFIG_HCI_IPC_TX_NOCOPY)
+	if (b->nocopy) {
+		batch_send_nocopy(b);
+		b->nocopy = false;
+	} else if (b->len) {
+		hci_ipc_msg_send(b->ept, b->data, b->len, HCI_REGULAR_MSG);
+	}
+#else
+	if (b->len) {
+		hci_ipc_msg_send(b->ept, b->data, b->len, HCI_REGULAR_MSG);
+	}
+#endif /* CONFIG_HCI_IPC_TX_NOCOPY */
+
+	if (b->len) {
+		stats_update(b->pkts, 1U, b->len);
+	}
+
+	b->data = NULL;
+	b->len = 0;
+	b->pkts = 0U;
+}
+
+static void batch_add(struct net_buf *buf)
+{
+	struct batch *b = batch_of(buf);
+
+	if (!hci_ipc_indicator_push(buf)) {
+		net_buf_unref(buf);
+		return;
+	}
+
+	if (b->data && buf->len > b->size - b->len) {
+		batch_flush(b);
+	}
+
+	if (!b->data && buf->len <= sizeof(b->buf)) {
+		batch_begin(b);
+	}
+
+	if (!b->data || buf->len > b->size) {
+		/* Does not fit in any batch, keep the order and send it alone */
+		batch_flush(b);
+		hci_ipc_msg_send(b->ept, buf->data, buf->len, HCI_REGULAR_MSG);
+		stats_update(1U, 1U, buf->len);
+		net_buf_unref(buf);
+		return;
+	}
+
+	memcpy(&b->data[b->len], buf->data, buf->len);
+	b->len += buf->len;
+	b->pkts++;
+
+	net_buf_unref(buf);
+}
+
+/* Collect what the controller queues until the batch is full, the queue is
+ * empty or the first packet has waited CONFIG_HCI_IPC_BATCH_LATENCY_US.
+ */
+static void batch_send(struct k_fifo *rx_queue)
+{
+	struct net_buf *buf = rx_next(rx_queue, K_FOREVER);
+	k_timepoint_t deadline = sys_timepoint_calc(K_USEC(CONFIG_HCI_IPC_BATCH_LATENCY_US));
+
+	while (buf) {
+		batch_add(buf);
+		buf = rx_next(rx_queue, sys_timepoint_timeout(deadline));
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(batches); i++) {
+		batch_flush(&batches[i]);
+	}
+}
+#endif /* CONFIG_HCI_IPC_BATCH */
+
 #if defined(CONFIG_BT_CTLR_ASSERT_HANDLER)
 void bt_ctlr_assert_handle(char *file, uint32_t line)
 {
@@ -363,7 +1349,7 @@ static void hci_ept_bound(void *priv)
 static void hci_ept_recv(const void *data, size_t len, void *priv)
 {
 	LOG_INF("Received message of %u bytes.", len);
-	hci_ipc_rx((uint8_t *) data, len);
+	hci_ipc_rx(priv, (uint8_t *) data, len);
 }
 
 static struct ipc_ept_cfg hci_ept_cfg = {
@@ -372,8 +1358,25 @@ static struct ipc_ept_cfg hci_ept_cfg = {
 		.bound    = hci_ept_bound,
 		.received = hci_ept_recv,
 	},
+	.priv = &hci_ept,
 };
 
+#if defined(CONFIG_HCI_IPC_ISO_EPT)
+static void hci_iso_ept_bound(void *priv)
+{
+	k_sem_give(&ipc_bound_sem);
+}
+
+static struct ipc_ept_cfg hci_iso_ept_cfg = {
+	.name = "nrf_bt_hci_iso",
+	.cb = {
+		.bound    = hci_iso_ept_bound,
+		.received = hci_ept_recv,
+	},
+	.priv = &hci_iso_ept,
+};
+#endif /* CONFIG_HCI_IPC_ISO_EPT */
+
 int main(void)
 {
 	int err;
@@ -385,6 +1388,11 @@ int main(void)
 
 	LOG_DBG("Start");
 
+#if defined(CONFIG_HCI_IPC_LANES)
+	lanes_init(&tx_lanes, "Host to controller");
+	lanes_init(&rx_lanes, "Controller to host");
+#endif /* CONFIG_HCI_IPC_LANES */
+
 	/* Enable the raw interface, this will in turn open the HCI driver */
 	bt_enable_raw(&rx_queue);
 
@@ -407,13 +1415,33 @@ int main(void)
 		LOG_ERR("Registering endpoint failed with %d", err);
 	}
 
-	k_sem_take(&ipc_bound_sem, K_FOREVER);
+#if defined(CONFIG_HCI_IPC_ISO_EPT)
+	err = ipc_service_register_endpoint(hci_ipc_instance, &hci_iso_ept, &hci_iso_ept_cfg);
+	if (err) {
+		LOG_ERR("Registering ISO endpoint failed with %d", err);
+	}
+#endif /* CONFIG_HCI_IPC_ISO_EPT */
+
+	for (uint8_t i = 0U; i < IPC_EPT_COUNT; i++) {
+		k_sem_take(&ipc_bound_sem, K_FOREVER);
+	}
+
+#if CONFIG_HCI_IPC_STATS_INTERVAL_S > 0
+	stats_start = k_uptime_get_32();
+	rx_stats_init();
+#endif /* CONFIG_HCI_IPC_STATS_INTERVAL_S > 0 */
 
 	while (1) {
+#if defined(CONFIG_HCI_IPC_BATCH)
+		batch_send(&rx_queue);
+#else
 		struct net_buf *buf;
 
-		buf = net_buf_get(&rx_queue, K_FOREVER);
-		hci_ipc_send(buf, HCI_REGULAR_MSG);
+		buf = rx_next(&rx_queue, K_FOREVER);
+		if (buf) {
+			hci_ipc_send(buf, HCI_REGULAR_MSG);
+		}
+#endif /* CONFIG_HCI_IPC_BATCH */
 	}
 	return 0;
 }
@@ -0,0 +1,315 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+
+#include <lc3.h>
+
+#include "audio_enc.h"
+#include "perf.h"
+
+#define FRAME_PCM_SAMPLES (AUDIO_ENC_FRAME_SAMPLES * AUDIO_ENC_PCM_CHAN_COUNT)
+
+BUILD_ASSERT(AUDIO_ENC_SDU_LEN >= 20 && AUDIO_ENC_SDU_LEN <= 400,
+	     "LC3 frame size out of range, check CONFIG_ISO_AUDIO_BITRATE");
+BUILD_ASSERT(AUDIO_ENC_SDU_LEN <= CONFIG_BT_ISO_TX_MTU,
+	     "CONFIG_BT_ISO_TX_MTU too small for the LC3 frame");
+
+/* Interleaved PCM, one frame for all source channels */
+static int16_t pcm[FRAME_PCM_SAMPLES];
+
+static lc3_encoder_mem_48k_t lc3_enc_mem[AUDIO_ENC_PCM_CHAN_COUNT];
+static lc3_encoder_t lc3_enc[AUDIO_ENC_PCM_CHAN_COUNT];
+
+/* Time to fetch PCM and encode one frame for all BIS */
+static struct perf_stat frame_stat;
+static uint32_t deadline_miss_count;
+
+#if defined(CONFIG_ISO_AUDIO_SOURCE_SINE)
+#define SINE_TABLE_BITS 8
+#define SINE_TABLE_LEN  BIT(SINE_TABLE_BITS)
+
+static int16_t sine_table[SINE_TABLE_LEN];
+static uint32_t sine_phase[AUDIO_ENC_PCM_CHAN_COUNT];
+static uint32_t sine_step[AUDIO_ENC_PCM_CHAN_COUNT];
+
+static int pcm_source_init(void)
+{
+	for (size_t i = 0U; i < SINE_TABLE_LEN; i++) {
+		/* -6 dBFS to leave the encoder some headroom */
+		sine_table[i] = (int16_t)(16383.0f *
+					  sinf(2.0f * 3.14159265f * i / SINE_TABLE_LEN));
+	}
+
+	/* Left channel at the configured tone, right channel one octave lower so
+	 * the two BIS can be told apart on the receiver.
+	 */
+	for (uint8_t chan = 0U; chan < AUDIO_ENC_PCM_CHAN_COUNT; chan++) {
+		uint64_t step = ((uint64_t)CONFIG_ISO_AUDIO_SINE_FREQ_HZ << 32) /
+				CONFIG_ISO_AUDIO_SAMPLE_RATE_HZ;
+
+		sine_step[chan] = (uint32_t)(step >> chan);
+		sine_phase[chan] = 0U;
+	}
+
+	return 0;
+}
+
+static int pcm_source_read(int16_t *out)
+{
+	for (size_t i = 0U; i < AUDIO_ENC_FRAME_SAMPLES; i++) {
+		for (uint8_t chan = 0U; chan < AUDIO_ENC_PCM_CHAN_COUNT; chan++) {
+			*out++ = sine_table[sine_phase[chan] >> (32 - SINE_TABLE_BITS)];
+			sine_phase[chan] += sine_step[chan];
+		}
+	}
+
+	return 0;
+}
+
+#elif defined(CONFIG_ISO_AUDIO_SOURCE_FILE)
+#include <fcntl.h>
+
+#include <nsi_host_trampolines.h>
+#include <cmdline.h>
+#include <posix_native_task.h>
+
+static const char *pcm_file_path = CONFIG_ISO_AUDIO_FILE_PATH;
+static int pcm_fd = -1;
+
+static void pcm_file_options(void)
+{
+	static struct args_struct_t pcm_file_opts[] = {
+		{
+			.option = "pcm-file",
+			.name = "path",
+			.type = 's',
+			.dest = (void *)&pcm_file_path,
+			.descript = "16-bit stereo WAV or raw PCM file used as audio source",
+		},
+		ARG_TABLE_ENDMARKER,
+	};
+
+	native_add_command_line_opts(pcm_file_opts);
+}
+NATIVE_TASK(pcm_file_options, PRE_BOOT_1, 1);
+
+static int pcm_file_read_all(void *data, size_t len)
+{
+	uint8_t *dst = data;
+
+	while (len > 0) {
+		long ret = nsi_host_read(pcm_fd, dst, len);
+
+		if (ret <= 0) {
+			return -ENODATA;
+		}
+
+		dst += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+static int pcm_file_skip(size_t len)
+{
+	uint8_t scratch[64];
+
+	while (len > 0) {
+		size_t chunk = MIN(len, sizeof(scratch));
+		int err;
+
+		err = pcm_file_read_all(scratch, chunk);
+		if (err) {
+			return err;
+		}
+
+		len -= chunk;
+	}
+
+	return 0;
+}
+
+/* Position the file at the first sample. A RIFF/WAVE file is parsed up to its
+ * data chunk, anything else is taken as raw interleaved S16LE stereo.
+ */
+static int pcm_file_open(void)
+{
+	uint8_t hdr[12];
+	int err;
+
+	if (pcm_fd >= 0) {
+		nsi_host_close(pcm_fd);
+	}
+
+	pcm_fd = nsi_host_open(pcm_file_path, O_RDONLY);
+	if (pcm_fd < 0) {
+		printk("Unable to open PCM file %s\n", pcm_file_path);
+		return -ENOENT;
+	}
+
+	err = pcm_file_read_all(hdr, sizeof(hdr));
+	if (err) {
+		return err;
+	}
+
+	if (memcmp(&hdr[0], "RIFF", 4) || memcmp(&hdr[8], "WAVE", 4)) {
+		/* Raw PCM, start over without the header */
+		nsi_host_close(pcm_fd);
+		pcm_fd = nsi_host_open(pcm_file_path, O_RDONLY);
+
+		return pcm_fd < 0 ? -ENOENT : 0;
+	}
+
+	while (true) {
+		uint8_t chunk[8];
+		uint32_t chunk_len;
+
+		err = pcm_file_read_all(chunk, sizeof(chunk));
+		if (err) {
+			return err;
+		}
+
+		chunk_len = sys_get_le32(&chunk[4]);
+
+		if (!memcmp(chunk, "data", 4)) {
+			return 0;
+		}
+
+		if (!memcmp(chunk, "fmt ", 4) && chunk_len >= 16U) {
+			uint8_t fmt[16];
+
+			err = pcm_file_read_all(fmt, sizeof(fmt));
+			if (err) {
+				return err;
+			}
+
+			if (sys_get_le16(&fmt[2]) != AUDIO_ENC_PCM_CHAN_COUNT ||
+			    sys_get_le32(&fmt[4]) != CONFIG_ISO_AUDIO_SAMPLE_RATE_HZ ||
+			    sys_get_le16(&fmt[14]) != 16U) {
+				printk("WAV format %u ch %u Hz %u bit, expected %u ch %u Hz 16 bit\n",
+				       sys_get_le16(&fmt[2]), sys_get_le32(&fmt[4]),
+				       sys_get_le16(&fmt[14]), AUDIO_ENC_PCM_CHAN_COUNT,
+				       CONFIG_ISO_AUDIO_SAMPLE_RATE_HZ);
+				return -EINVAL;
+			}
+
+			chunk_len -= sizeof(fmt);
+		}
+
+		/* Chunks are padded to an even length */
+		err = pcm_file_skip(chunk_len + (chunk_len & 1U));
+		if (err) {
+			return err;
+		}
+	}
+}
+
+static int pcm_source_init(void)
+{
+	return pcm_file_open();
+}
+
+static int pcm_source_read(int16_t *out)
+{
+	int err;
+
+	err = pcm_file_read_all(out, sizeof(int16_t) * FRAME_PCM_SAMPLES);
+	if (err == -ENODATA) {
+		/* Loop the file */
+		err = pcm_file_open();
+		if (!err) {
+			err = pcm_file_read_all(out, sizeof(int16_t) * FRAME_PCM_SAMPLES);
+		}
+	}
+	if (err) {
+		return err;
+	}
+
+	for (size_t i = 0U; i < FRAME_PCM_SAMPLES; i++) {
+		out[i] = sys_le16_to_cpu(out[i]);
+	}
+
+	return 0;
+}
+#endif /* CONFIG_ISO_AUDIO_SOURCE_FILE */
+
+int audio_enc_init(void)
+{
+	int err;
+
+	perf_init();
+	perf_stat_reset(&frame_stat);
+	deadline_miss_count = 0U;
+
+	err = pcm_source_init();
+	if (err) {
+		return err;
+	}
+
+	for (uint8_t chan = 0U; chan < AUDIO_ENC_PCM_CHAN_COUNT; chan++) {
+		lc3_enc[chan] = lc3_setup_encoder(CONFIG_ISO_AUDIO_FRAME_DURATION_US,
+						  CONFIG_ISO_AUDIO_SAMPLE_RATE_HZ, 0,
+						  &lc3_enc_mem[chan]);
+		if (lc3_enc[chan] == NULL) {
+			printk("Failed to setup LC3 encoder %u\n", chan);
+			return -EINVAL;
+		}
+	}
+
+	printk("LC3 encoder: %u us frames, %u Hz, %u bps, %u bytes per SDU\n",
+	       CONFIG_ISO_AUDIO_FRAME_DURATION_US, CONFIG_ISO_AUDIO_SAMPLE_RATE_HZ,
+	       CONFIG_ISO_AUDIO_BITRATE, AUDIO_ENC_SDU_LEN);
+
+	return 0;
+}
+
+int audio_enc_frame(uint8_t sdu[AUDIO_ENC_PCM_CHAN_COUNT][AUDIO_ENC_SDU_LEN])
+{
+	perf_ts_t start;
+	uint32_t ns;
+	int err;
+
+	start = perf_now();
+
+	err = pcm_source_read(pcm);
+	if (err) {
+		return err;
+	}
+
+	for (uint8_t pcm_chan = 0U; pcm_chan < AUDIO_ENC_PCM_CHAN_COUNT; pcm_chan++) {
+		err = lc3_encode(lc3_enc[pcm_chan], LC3_PCM_FORMAT_S16,
+				 &pcm[pcm_chan], AUDIO_ENC_PCM_CHAN_COUNT,
+				 AUDIO_ENC_SDU_LEN, sdu[pcm_chan]);
+		if (err) {
+			return -EIO;
+		}
+	}
+
+	ns = perf_ns(start, perf_now());
+	perf_stat_add(&frame_stat, ns);
+
+	/* All PCM channels must be encoded within one SDU interval */
+	if (ns > (CONFIG_ISO_AUDIO_FRAME_DURATION_US * NSEC_PER_USEC)) {
+		deadline_miss_count++;
+	}
+
+	return 0;
+}
+
+void audio_enc_stats_print(void)
+{
+	perf_stat_print("LC3 frame encode", &frame_stat);
+	printk("LC3 deadline misses %u of %u frames\n", deadline_miss_count,
+	       frame_stat.count);
+}
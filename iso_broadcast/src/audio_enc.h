@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef AUDIO_ENC_H_
+#define AUDIO_ENC_H_
+
+#include <stdint.h>
+
+/* Number of PCM channels delivered by the audio source (stereo). BIS n is fed
+ * from PCM channel n % AUDIO_ENC_PCM_CHAN_COUNT.
+ */
+#define AUDIO_ENC_PCM_CHAN_COUNT 2
+
+#define AUDIO_ENC_FRAME_SAMPLES ((CONFIG_ISO_AUDIO_SAMPLE_RATE_HZ / 100) * \
+				 CONFIG_ISO_AUDIO_FRAME_DURATION_US / 10000)
+
+/* Encoded frame size, same rounding as lc3_frame_bytes() */
+#define AUDIO_ENC_SDU_LEN ((CONFIG_ISO_AUDIO_BITRATE / 100) * \
+			   (CONFIG_ISO_AUDIO_FRAME_DURATION_US / 10) / 8000)
+
+int audio_enc_init(void);
+
+/* Fetch one frame of PCM from the audio source and encode every PCM channel
+ * once. sdu[pcm_chan] receives AUDIO_ENC_SDU_LEN bytes, the BIS fed from the
+ * same PCM channel share it. Returns 0 on success or negative errno.
+ */
+int audio_enc_frame(uint8_t sdu[AUDIO_ENC_PCM_CHAN_COUNT][AUDIO_ENC_SDU_LEN]);
+
+void audio_enc_stats_print(void);
+
+#endif /* AUDIO_ENC_H_ */
@@ -0,0 +1,359 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/iso.h>
+#include <zephyr/net/buf.h>
+#include <zephyr/sys/printk.h>
+
+#include "bench_sweep.h"
+
+#define BIS_COUNT CONFIG_ISO_BENCH_SWEEP_BIS_COUNT
+/* SDUs per BIS in the host and controller at the same time */
+#define INFLIGHT_PER_BIS (CONFIG_BT_ISO_TX_BUF_COUNT / BIS_COUNT)
+#define HIST_BUCKETS 16
+
+BUILD_ASSERT(BIS_COUNT <= CONFIG_BT_ISO_MAX_CHAN,
+	     "CONFIG_BT_ISO_MAX_CHAN must cover the benchmark BIS");
+BUILD_ASSERT(INFLIGHT_PER_BIS > 0, "CONFIG_BT_ISO_TX_BUF_COUNT too small");
+
+NET_BUF_POOL_FIXED_DEFINE(sweep_pool, BIS_COUNT * INFLIGHT_PER_BIS,
+			  BT_ISO_SDU_BUF_SIZE(CONFIG_BT_ISO_TX_MTU),
+			  CONFIG_BT_CONN_TX_USER_DATA_SIZE, NULL);
+
+/* The sweep matrix, every combination is run */
+static const uint16_t sweep_sdu_len[] = { 40, 100, 155 };
+static const uint8_t sweep_rtn[] = { 0, 2 };
+static const uint8_t sweep_phy[] = { BT_GAP_LE_PHY_1M, BT_GAP_LE_PHY_2M };
+static const uint32_t sweep_interval_us[] = { 7500, 10000 };
+static const uint16_t sweep_latency_ms[] = { 10, 20 };
+static const uint8_t sweep_packing[] = { BT_ISO_PACKING_SEQUENTIAL,
+					 BT_ISO_PACKING_INTERLEAVED };
+static const uint8_t sweep_framing[] = { BT_ISO_FRAMING_UNFRAMED,
+					 BT_ISO_FRAMING_FRAMED };
+
+struct sweep_point {
+	uint16_t sdu_len;
+	uint8_t rtn;
+	uint8_t phy;
+	uint32_t interval_us;
+	uint16_t latency_ms;
+	uint8_t packing;
+	uint8_t framing;
+};
+
+#define SWEEP_POINT_COUNT                                                   \
+	(ARRAY_SIZE(sweep_sdu_len) * ARRAY_SIZE(sweep_rtn) *                \
+	 ARRAY_SIZE(sweep_phy) * ARRAY_SIZE(sweep_interval_us) *            \
+	 ARRAY_SIZE(sweep_latency_ms) * ARRAY_SIZE(sweep_packing) *         \
+	 ARRAY_SIZE(sweep_framing))
+
+/* Point idx of the matrix, framing varies fastest and SDU size slowest */
+static void sweep_point_get(uint32_t idx, struct sweep_point *pt)
+{
+#define SWEEP_NEXT(field, table)                            \
+	do {                                                \
+		pt->field = table[idx % ARRAY_SIZE(table)]; \
+		idx /= ARRAY_SIZE(table);                   \
+	} while (0)
+
+	SWEEP_NEXT(framing, sweep_framing);
+	SWEEP_NEXT(packing, sweep_packing);
+	SWEEP_NEXT(latency_ms, sweep_latency_ms);
+	SWEEP_NEXT(interval_us, sweep_interval_us);
+	SWEEP_NEXT(phy, sweep_phy);
+	SWEEP_NEXT(rtn, sweep_rtn);
+	SWEEP_NEXT(sdu_len, sweep_sdu_len);
+
+#undef SWEEP_NEXT
+}
+
+/* Send times of the SDUs in flight on a BIS, completed in order by iso_sent */
+struct sweep_bis {
+	uint32_t sent_us[INFLIGHT_PER_BIS];
+	volatile uint32_t wr;
+	volatile uint32_t rd;
+};
+
+struct sweep_result {
+	uint32_t sent;
+	uint32_t completed;
+	uint32_t send_err;
+	uint32_t no_buf;
+	uint32_t lat_min_us;
+	uint32_t lat_max_us;
+	uint64_t lat_sum_us;
+	uint32_t hist[HIST_BUCKETS];
+};
+
+static struct bt_iso_chan sweep_chan[BIS_COUNT];
+static struct bt_iso_chan *sweep_bis_chans[BIS_COUNT];
+static struct sweep_bis sweep_bis[BIS_COUNT];
+static struct sweep_result result;
+
+static struct bt_iso_chan_io_qos sweep_tx_qos;
+static struct bt_iso_chan_qos sweep_qos = {
+	.tx = &sweep_tx_qos,
+};
+
+static K_SEM_DEFINE(sem_connected, 0, BIS_COUNT);
+static K_SEM_DEFINE(sem_disconnected, 0, BIS_COUNT);
+static K_TIMER_DEFINE(sweep_timer, NULL, NULL);
+
+static uint8_t sweep_data[CONFIG_BT_ISO_TX_MTU];
+
+static uint32_t local_us(void)
+{
+	return (uint32_t)k_ticks_to_us_floor64(k_uptime_ticks());
+}
+
+static void sweep_connected(struct bt_iso_chan *chan)
+{
+	k_sem_give(&sem_connected);
+}
+
+static void sweep_disconnected(struct bt_iso_chan *chan, uint8_t reason)
+{
+	k_sem_give(&sem_disconnected);
+}
+
+static void sweep_sent(struct bt_iso_chan *chan)
+{
+	struct sweep_bis *bis = &sweep_bis[ARRAY_INDEX(sweep_chan, chan)];
+	uint32_t lat;
+
+	if (bis->rd == bis->wr) {
+		return;
+	}
+
+	lat = local_us() - bis->sent_us[bis->rd % INFLIGHT_PER_BIS];
+	bis->rd++;
+
+	result.completed++;
+	result.lat_min_us = MIN(result.lat_min_us, lat);
+	result.lat_max_us = MAX(result.lat_max_us, lat);
+	result.lat_sum_us += lat;
+	result.hist[MIN(lat / CONFIG_ISO_BENCH_SWEEP_HIST_BUCKET_US,
+			HIST_BUCKETS - 1U)]++;
+}
+
+static struct bt_iso_chan_ops sweep_ops = {
+	.connected	= sweep_connected,
+	.disconnected	= sweep_disconnected,
+	.sent		= sweep_sent,
+};
+
+static void sweep_send(uint16_t seq_num, uint16_t sdu_len)
+{
+	for (uint8_t i = 0U; i < BIS_COUNT; i++) {
+		struct sweep_bis *bis = &sweep_bis[i];
+		struct net_buf *buf;
+		int err;
+
+		if (bis->wr - bis->rd >= INFLIGHT_PER_BIS) {
+			result.no_buf++;
+			continue;
+		}
+
+		buf = net_buf_alloc(&sweep_pool, K_NO_WAIT);
+		if (!buf) {
+			result.no_buf++;
+			continue;
+		}
+
+		net_buf_reserve(buf, BT_ISO_CHAN_SEND_RESERVE);
+		net_buf_add_mem(buf, sweep_data, sdu_len);
+
+		bis->sent_us[bis->wr % INFLIGHT_PER_BIS] = local_us();
+		bis->wr++;
+
+		err = bt_iso_chan_send(&sweep_chan[i], buf, seq_num);
+		if (err < 0) {
+			bis->wr--;
+			result.send_err++;
+			net_buf_unref(buf);
+			continue;
+		}
+
+		result.sent++;
+	}
+}
+
+static void sweep_print(const struct sweep_point *pt, const struct bt_iso_info *info)
+{
+	uint32_t duration_us = CONFIG_ISO_BENCH_SWEEP_DURATION_S * USEC_PER_SEC;
+	uint32_t rate;
+	uint32_t goodput;
+
+	/* SDU/s over all BIS, goodput in bit/s */
+	rate = (uint32_t)((uint64_t)result.completed * USEC_PER_SEC / duration_us);
+	goodput = rate * pt->sdu_len * 8U;
+
+	printk("sweep sdu %u rtn %u phy %u interval %u latency %u %s %s: "
+	       "%u SDU/s (%u sent, %u send errors, %u no buffer), goodput %u bps\n",
+	       pt->sdu_len, pt->rtn, pt->phy, pt->interval_us, pt->latency_ms,
+	       pt->packing == BT_ISO_PACKING_INTERLEAVED ? "interleaved" : "sequential",
+	       pt->framing == BT_ISO_FRAMING_FRAMED ? "framed" : "unframed",
+	       rate, result.sent, result.send_err, result.no_buf, goodput);
+
+	printk("  BIG: iso interval %u us, max subevent %u, sync delay %u us, "
+	       "transport latency %u us, phy %u, bn %u, irc %u, pto %u, max pdu %u\n",
+	       info->iso_interval * 1250U, info->max_subevent,
+	       info->broadcaster.sync_delay, info->broadcaster.transport_latency,
+	       info->broadcaster.phy, info->broadcaster.bn, info->broadcaster.irc,
+	       info->broadcaster.pto, info->broadcaster.max_pdu);
+
+	if (!result.completed) {
+		printk("  latency: no samples\n");
+		return;
+	}
+
+	printk("  latency: min %u avg %u max %u us\n", result.lat_min_us,
+	       (uint32_t)(result.lat_sum_us / result.completed), result.lat_max_us);
+
+	printk("  histogram (%u us buckets):", CONFIG_ISO_BENCH_SWEEP_HIST_BUCKET_US);
+	for (uint8_t i = 0U; i < HIST_BUCKETS; i++) {
+		printk(" %u", result.hist[i]);
+	}
+	printk("\n");
+}
+
+static int sweep_point_run(struct bt_le_ext_adv *adv, const struct sweep_point *pt)
+{
+	struct bt_iso_big_create_param param = {
+		.num_bis = BIS_COUNT,
+		.bis_channels = sweep_bis_chans,
+		.interval = pt->interval_us,
+		.latency = pt->latency_ms,
+		.packing = pt->packing,
+		.framing = pt->framing,
+	};
+	uint32_t sdu_count = CONFIG_ISO_BENCH_SWEEP_DURATION_S * USEC_PER_SEC /
+			     pt->interval_us;
+	struct bt_iso_info info;
+	struct bt_iso_big *big;
+	int err;
+
+	sweep_tx_qos.sdu = pt->sdu_len;
+	sweep_tx_qos.rtn = pt->rtn;
+	sweep_tx_qos.phy = pt->phy;
+
+	err = bt_iso_big_create(adv, &param, &big);
+	if (err) {
+		printk("sweep sdu %u rtn %u phy %u interval %u latency %u: "
+		       "BIG create failed (err %d)\n", pt->sdu_len, pt->rtn, pt->phy,
+		       pt->interval_us, pt->latency_ms, err);
+		return 0;
+	}
+
+	for (uint8_t i = 0U; i < BIS_COUNT; i++) {
+		err = k_sem_take(&sem_connected, K_SECONDS(5));
+		if (err) {
+			printk("BIG create timed out\n");
+			return err;
+		}
+	}
+
+	memset(&result, 0, sizeof(result));
+	result.lat_min_us = UINT32_MAX;
+	memset(sweep_bis, 0, sizeof(sweep_bis));
+
+	err = bt_iso_chan_get_info(&sweep_chan[0], &info);
+	if (err) {
+		memset(&info, 0, sizeof(info));
+	}
+
+	k_timer_start(&sweep_timer, K_USEC(pt->interval_us), K_USEC(pt->interval_us));
+	for (uint32_t seq_num = 0U; seq_num < sdu_count; seq_num++) {
+		k_timer_status_sync(&sweep_timer);
+		sweep_send((uint16_t)seq_num, pt->sdu_len);
+	}
+	k_timer_stop(&sweep_timer);
+
+	err = bt_iso_big_terminate(big);
+	if (err) {
+		printk("BIG terminate failed (err %d)\n", err);
+		return err;
+	}
+
+	for (uint8_t i = 0U; i < BIS_COUNT; i++) {
+		err = k_sem_take(&sem_disconnected, K_SECONDS(5));
+		if (err) {
+			printk("BIG terminate timed out\n");
+			return err;
+		}
+	}
+
+	sweep_print(pt, &info);
+
+	return 0;
+}
+
+int bench_sweep_run(void)
+{
+	struct bt_le_ext_adv *adv;
+	struct sweep_point pt;
+	uint32_t points = 0U;
+	int err;
+
+	for (uint8_t i = 0U; i < BIS_COUNT; i++) {
+		sweep_chan[i].ops = &sweep_ops;
+		sweep_chan[i].qos = &sweep_qos;
+		sweep_bis_chans[i] = &sweep_chan[i];
+	}
+
+	for (size_t i = 0U; i < sizeof(sweep_data); i++) {
+		sweep_data[i] = (uint8_t)i;
+	}
+
+	err = bt_le_ext_adv_create(BT_LE_EXT_ADV_NCONN, NULL, &adv);
+	if (err) {
+		printk("Failed to create advertising set (err %d)\n", err);
+		return err;
+	}
+
+	err = bt_le_per_adv_set_param(adv, BT_LE_PER_ADV_DEFAULT);
+	if (err) {
+		printk("Failed to set periodic advertising parameters (err %d)\n", err);
+		return err;
+	}
+
+	err = bt_le_per_adv_start(adv);
+	if (err) {
+		printk("Failed to enable periodic advertising (err %d)\n", err);
+		return err;
+	}
+
+	err = bt_le_ext_adv_start(adv, BT_LE_EXT_ADV_START_DEFAULT);
+	if (err) {
+		printk("Failed to start extended advertising (err %d)\n", err);
+		return err;
+	}
+
+	printk("Sweep: %u BIS, %u s per point, %u SDUs in flight per BIS\n",
+	       BIS_COUNT, CONFIG_ISO_BENCH_SWEEP_DURATION_S, INFLIGHT_PER_BIS);
+
+	for (uint32_t idx = 0U; idx < SWEEP_POINT_COUNT; idx++) {
+		sweep_point_get(idx, &pt);
+		if (pt.sdu_len > CONFIG_BT_ISO_TX_MTU) {
+			continue;
+		}
+
+		err = sweep_point_run(adv, &pt);
+		if (err) {
+			return err;
+		}
+		points++;
+	}
+
+	printk("Sweep done, %u points\n", points);
+
+	return 0;
+}
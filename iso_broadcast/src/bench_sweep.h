@@ -0,0 +1,17 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef BENCH_SWEEP_H_
+#define BENCH_SWEEP_H_
+
+/* Create a BIG for every combination of the TX QoS and BIG parameters in the
+ * sweep matrix, stream on it for CONFIG_ISO_BENCH_SWEEP_DURATION_S and print
+ * the achieved SDU rate, goodput, send to sent latency histogram and the BIG
+ * timing chosen by the controller. Bluetooth must be enabled.
+ */
+int bench_sweep_run(void);
+
+#endif /* BENCH_SWEEP_H_ */
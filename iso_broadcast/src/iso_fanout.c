@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/iso.h>
+#include <zephyr/net/buf.h>
+#include <zephyr/sys/printk.h>
+
+#include "iso_fanout.h"
+#include "tx_queue.h"
+
+static struct net_buf_pool *sdu_pool;
+
+static uint32_t fanout_count;
+static uint32_t sdu_count;
+/* SDUs that could not be produced because the pool was empty */
+static uint32_t alloc_fail_count;
+
+void iso_fanout_init(struct net_buf_pool *pool)
+{
+	sdu_pool = pool;
+}
+
+uint8_t iso_fanout_put(const uint8_t *payload, uint16_t len, const uint8_t *chans,
+		       uint8_t count, const struct tx_sched_slot *slot,
+		       k_timeout_t timeout)
+{
+	uint8_t queued = 0U;
+
+	fanout_count++;
+
+	for (uint8_t i = 0U; i < count; i++) {
+		struct net_buf *buf;
+
+		buf = net_buf_alloc(sdu_pool, timeout);
+		if (!buf) {
+			/* The receivers see a lost SDU, keep streaming */
+			alloc_fail_count++;
+			continue;
+		}
+
+		net_buf_reserve(buf, BT_ISO_CHAN_SEND_RESERVE);
+		net_buf_add_mem(buf, payload, len);
+
+		/* The queue owns buf, also when it is dropped */
+		if (!tx_queue_put(chans[i], buf, slot)) {
+			queued++;
+		}
+		sdu_count++;
+	}
+
+	return queued;
+}
+
+void iso_fanout_stats_print(void)
+{
+	printk("Fan-out: %u payloads, %u SDUs, %u allocation failures\n",
+	       fanout_count, sdu_count, alloc_fail_count);
+}
+
+#if defined(CONFIG_ISO_FANOUT_BENCH)
+#include "perf.h"
+
+#define BENCH_BIS_MAX     8
+#define BENCH_SDU_LEN_MAX 240
+#define BENCH_ITERATIONS  1000
+#define BENCH_BUF_SIZE    (BT_ISO_CHAN_SEND_RESERVE + BENCH_SDU_LEN_MAX)
+
+/* Copy fan-out: a buffer with its own data per BIS */
+NET_BUF_POOL_FIXED_DEFINE(bench_copy_pool, BENCH_BIS_MAX, BENCH_BUF_SIZE, 0, NULL);
+/* Shared fan-out: one data block, reference counted by a buffer per BIS. Only
+ * pools with variable size data support references, fixed pools copy on
+ * clone. The heap gets room for the reference count and allocator overhead.
+ */
+NET_BUF_POOL_VAR_DEFINE(bench_shared_pool, BENCH_BIS_MAX, 2 * BENCH_BUF_SIZE, 0, NULL);
+
+static const uint8_t bench_bis_counts[] = { 2, 4, 8 };
+static const uint16_t bench_sdu_lens[] = { 100, 240 };
+
+static uint8_t bench_payload[BENCH_SDU_LEN_MAX];
+
+static int bench_copy(struct net_buf **bufs, uint8_t count, uint16_t len)
+{
+	for (uint8_t i = 0U; i < count; i++) {
+		bufs[i] = net_buf_alloc(&bench_copy_pool, K_NO_WAIT);
+		if (!bufs[i]) {
+			return -ENOMEM;
+		}
+
+		net_buf_reserve(bufs[i], BT_ISO_CHAN_SEND_RESERVE);
+		net_buf_add_mem(bufs[i], bench_payload, len);
+	}
+
+	return 0;
+}
+
+static int bench_shared(struct net_buf **bufs, uint8_t count, uint16_t len)
+{
+	bufs[0] = net_buf_alloc_len(&bench_shared_pool, BENCH_BUF_SIZE, K_NO_WAIT);
+	if (!bufs[0]) {
+		return -ENOMEM;
+	}
+
+	net_buf_reserve(bufs[0], BT_ISO_CHAN_SEND_RESERVE);
+	net_buf_add_mem(bufs[0], bench_payload, len);
+
+	for (uint8_t i = 1U; i < count; i++) {
+		bufs[i] = net_buf_clone(bufs[0], K_NO_WAIT);
+		if (!bufs[i]) {
+			return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
+static void bench_run(const char *name,
+		      int (*fanout)(struct net_buf **bufs, uint8_t count, uint16_t len),
+		      uint8_t count, uint16_t len, size_t data_bytes)
+{
+	struct net_buf *bufs[BENCH_BIS_MAX];
+	struct perf_stat stat;
+
+	perf_stat_reset(&stat);
+
+	for (uint32_t iter = 0U; iter < BENCH_ITERATIONS; iter++) {
+		perf_ts_t start;
+		int err;
+
+		start = perf_now();
+		err = fanout(bufs, count, len);
+		perf_stat_add(&stat, perf_ns(start, perf_now()));
+
+		for (uint8_t i = 0U; i < count; i++) {
+			if (err && !bufs[i]) {
+				break;
+			}
+			net_buf_unref(bufs[i]);
+		}
+
+		if (err) {
+			printk("%s fan-out failed (err %d)\n", name, err);
+			return;
+		}
+	}
+
+	printk("%-6s %u BIS %3u bytes: avg %u max %u ns, %zu data bytes\n", name,
+	       count, len, perf_stat_avg(&stat), stat.max, data_bytes);
+}
+
+void iso_fanout_bench(void)
+{
+	perf_init();
+
+	for (size_t i = 0U; i < sizeof(bench_payload); i++) {
+		bench_payload[i] = (uint8_t)i;
+	}
+
+	printk("Fan-out benchmark, %u iterations\n", BENCH_ITERATIONS);
+
+	for (size_t l = 0U; l < ARRAY_SIZE(bench_sdu_lens); l++) {
+		for (size_t c = 0U; c < ARRAY_SIZE(bench_bis_counts); c++) {
+			uint8_t count = bench_bis_counts[c];
+			uint16_t len = bench_sdu_lens[l];
+
+			bench_run("copy", bench_copy, count, len,
+				  count * (BT_ISO_CHAN_SEND_RESERVE + len));
+			bench_run("shared", bench_shared, count, len,
+				  BT_ISO_CHAN_SEND_RESERVE + len);
+		}
+	}
+}
+#endif /* CONFIG_ISO_FANOUT_BENCH */
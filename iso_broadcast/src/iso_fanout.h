@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef ISO_FANOUT_H_
+#define ISO_FANOUT_H_
+
+#include <stdint.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/net/buf.h>
+
+#include "tx_sched.h"
+
+/* SDU buffers for all BIS are taken from pool */
+void iso_fanout_init(struct net_buf_pool *pool);
+
+/* Queue one payload, produced once, on count BIS. chans lists the BIS indexes
+ * as passed to tx_queue_init(). The payload is copied straight from the caller
+ * into a buffer per BIS: bt_iso_chan_send() pushes the per-BIS ISO and HCI
+ * headers into the buffer itself and the HCI drivers send buf->data only, not
+ * its fragments, so neither a shared buffer nor a shared fragment reaches the
+ * controller. Pool usage and copies grow with count. Returns the number of BIS
+ * the SDU was queued on.
+ */
+uint8_t iso_fanout_put(const uint8_t *payload, uint16_t len, const uint8_t *chans,
+		       uint8_t count, const struct tx_sched_slot *slot,
+		       k_timeout_t timeout);
+
+void iso_fanout_stats_print(void);
+
+#if defined(CONFIG_ISO_FANOUT_BENCH)
+/* Compare copy and shared (reference counted) fan-out for 2, 4 and 8 BIS at
+ * 100 and 240 byte SDUs and print the results. Does not need the controller,
+ * the shared buffers are never sent.
+ */
+void iso_fanout_bench(void);
+#endif /* CONFIG_ISO_FANOUT_BENCH */
+
+#endif /* ISO_FANOUT_H_ */
@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/printk.h>
+
+#include "iso_fanout.h"
+#include "iso_tx.h"
+#if defined(CONFIG_ISO_BROADCAST_PAYLOAD_LATENCY)
+#include "latency_probe.h"
+#endif /* CONFIG_ISO_BROADCAST_PAYLOAD_LATENCY */
+#include "perf.h"
+#include "tx_queue.h"
+#include "tx_sched.h"
+
+#define RING_SIZE CONFIG_ISO_TX_RING_SIZE
+#define RING_MASK (RING_SIZE - 1U)
+
+BUILD_ASSERT(IS_POWER_OF_TWO(RING_SIZE), "CONFIG_ISO_TX_RING_SIZE must be a power of two");
+
+struct iso_tx_sdu {
+	uint16_t len;
+	uint8_t data[CONFIG_BT_ISO_TX_MTU];
+};
+
+/* Single producer, single consumer: head is only written by the producer and
+ * tail only by the ISO TX thread. atomic_set() orders the SDU data before the
+ * index update, so neither side needs a lock.
+ */
+struct iso_tx_ring {
+	struct iso_tx_sdu sdu[RING_SIZE];
+	atomic_t head;
+	atomic_t tail;
+
+	uint32_t produced;
+	uint32_t overrun;
+	uint32_t underrun;
+
+	/* Time the producer spends in iso_tx_produce(), only written by the
+	 * producer of this ring
+	 */
+	struct perf_stat produce_stat;
+};
+
+static struct iso_tx_ring rings[CONFIG_BT_ISO_MAX_CHAN];
+static uint8_t ring_count;
+static uint32_t sdu_interval_us;
+
+#if !defined(CONFIG_ISO_TX_SCHED)
+static K_TIMER_DEFINE(tx_timer, NULL, NULL);
+#endif /* !CONFIG_ISO_TX_SCHED */
+
+static void iso_tx_thread(void *p1, void *p2, void *p3);
+
+K_THREAD_DEFINE(iso_tx_tid, CONFIG_ISO_TX_THREAD_STACK_SIZE, iso_tx_thread, NULL, NULL,
+		NULL, K_PRIO_COOP(CONFIG_ISO_TX_THREAD_PRIO), 0, SYS_FOREVER_MS);
+
+int iso_tx_produce(uint8_t chan, const uint8_t *data, uint16_t len)
+{
+	struct iso_tx_ring *ring = &rings[chan];
+	perf_ts_t start = perf_now();
+	atomic_val_t head = atomic_get(&ring->head);
+	struct iso_tx_sdu *sdu;
+
+	__ASSERT_NO_MSG(len <= sizeof(sdu->data));
+
+	if ((atomic_val_t)(head - atomic_get(&ring->tail)) >= RING_SIZE) {
+		/* The TX thread is behind, drop the newest SDU */
+		ring->overrun++;
+		return -ENOBUFS;
+	}
+
+	sdu = &ring->sdu[head & RING_MASK];
+	sdu->len = len;
+	memcpy(sdu->data, data, len);
+	atomic_set(&ring->head, head + 1);
+
+	ring->produced++;
+	perf_stat_add(&ring->produce_stat, perf_ns(start, perf_now()));
+
+	return 0;
+}
+
+static struct iso_tx_sdu *ring_peek(struct iso_tx_ring *ring)
+{
+	atomic_val_t tail = atomic_get(&ring->tail);
+
+	if (tail == atomic_get(&ring->head)) {
+		return NULL;
+	}
+
+	return &ring->sdu[tail & RING_MASK];
+}
+
+static void ring_release(struct iso_tx_ring *ring)
+{
+	atomic_inc(&ring->tail);
+}
+
+static void iso_tx_thread(void *p1, void *p2, void *p3)
+{
+	uint16_t seq_num = 0U;
+
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+#if !defined(CONFIG_ISO_TX_SCHED)
+	/* The producer and this timer start in the same tick, the first SDU of
+	 * a ring may only be there one interval later
+	 */
+	k_timer_start(&tx_timer, K_USEC(sdu_interval_us), K_USEC(sdu_interval_us));
+#endif /* !CONFIG_ISO_TX_SCHED */
+
+	while (true) {
+		struct tx_sched_slot slot = { .seq_num = seq_num };
+
+#if defined(CONFIG_ISO_TX_SCHED)
+		tx_sched_wait(&slot);
+#else
+		k_timer_status_sync(&tx_timer);
+#endif /* CONFIG_ISO_TX_SCHED */
+
+		for (uint8_t chan = 0U; chan < ring_count; chan++) {
+			struct iso_tx_ring *ring = &rings[chan];
+			struct iso_tx_sdu *sdu = ring_peek(ring);
+
+			if (!sdu) {
+				/* Nothing produced in time, the receivers see a lost SDU.
+				 * Before the first SDU the producer has not started yet.
+				 */
+				if (ring->produced) {
+					ring->underrun++;
+				}
+				continue;
+			}
+
+#if defined(CONFIG_ISO_BROADCAST_PAYLOAD_LATENCY)
+			/* The probe is in the payload of BIS 0. Its sequence number
+			 * is only known here, the producer does not see underruns.
+			 */
+			if (chan == 0U) {
+				latency_probe_sched(sdu->data, slot.seq_num,
+						    slot.timed ? slot.anchor_us : 0U);
+			}
+#endif /* CONFIG_ISO_BROADCAST_PAYLOAD_LATENCY */
+
+			(void)iso_fanout_put(sdu->data, sdu->len, &chan, 1U, &slot, K_NO_WAIT);
+			ring_release(ring);
+		}
+
+		/* The sends are done here, not in the system work queue */
+		tx_queue_drain();
+
+#if defined(CONFIG_ISO_TX_SCHED)
+		tx_sched_done(&slot);
+#endif /* CONFIG_ISO_TX_SCHED */
+
+		seq_num = slot.seq_num + 1U;
+	}
+}
+
+void iso_tx_start(uint8_t count, uint32_t interval_us)
+{
+	__ASSERT_NO_MSG(count <= ARRAY_SIZE(rings));
+
+	perf_init();
+
+	ring_count = count;
+	sdu_interval_us = interval_us;
+
+	for (uint8_t i = 0U; i < count; i++) {
+		atomic_set(&rings[i].head, 0);
+		atomic_set(&rings[i].tail, 0);
+		perf_stat_reset(&rings[i].produce_stat);
+	}
+
+	k_thread_start(iso_tx_tid);
+}
+
+void iso_tx_stats_print(void)
+{
+	for (uint8_t i = 0U; i < ring_count; i++) {
+		struct iso_tx_ring *ring = &rings[i];
+		char name[24];
+
+		printk("ISO TX ring %u: produced %u, level %u/%u, overruns %u, "
+		       "underruns %u\n", i, ring->produced,
+		       (uint32_t)(atomic_get(&ring->head) - atomic_get(&ring->tail)),
+		       RING_SIZE, ring->overrun, ring->underrun);
+
+		snprintk(name, sizeof(name), "ISO TX ring %u produce", i);
+		perf_stat_print(name, &ring->produce_stat);
+	}
+}
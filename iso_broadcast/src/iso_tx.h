@@ -0,0 +1,27 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef ISO_TX_H_
+#define ISO_TX_H_
+
+#include <stdint.h>
+
+/* Reset the rings of count BIS and start the ISO TX thread. It takes one SDU
+ * per BIS from the rings every interval_us, or every BIG event when
+ * CONFIG_ISO_TX_SCHED is enabled, hands it to the TX queue and sends what the
+ * credits allow. The TX queue and fan-out must have been initialized.
+ */
+void iso_tx_start(uint8_t count, uint32_t interval_us);
+
+/* Put an SDU of len bytes for BIS chan in its ring. Never blocks and may be
+ * called from ISR context, but from only one context per BIS. Returns 0 or
+ * -ENOBUFS when the ring is full and the SDU was dropped.
+ */
+int iso_tx_produce(uint8_t chan, const uint8_t *data, uint16_t len);
+
+void iso_tx_stats_print(void);
+
+#endif /* ISO_TX_H_ */
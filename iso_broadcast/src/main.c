@@ -8,14 +8,72 @@
 #include <zephyr/bluetooth/iso.h>
 #include <zephyr/sys/byteorder.h>
 
+#if defined(CONFIG_ISO_BROADCAST_PAYLOAD_LC3)
+#include "audio_enc.h"
+#endif /* CONFIG_ISO_BROADCAST_PAYLOAD_LC3 */
+
+#if defined(CONFIG_ISO_BENCH_SWEEP)
+#include "bench_sweep.h"
+#endif /* CONFIG_ISO_BENCH_SWEEP */
+#include "broadcast_code.h"
+#include "iso_fanout.h"
+#if defined(CONFIG_ISO_BROADCAST_PAYLOAD_LATENCY)
+#include "latency_probe.h"
+#endif /* CONFIG_ISO_BROADCAST_PAYLOAD_LATENCY */
+#if defined(CONFIG_ISO_TX_THREAD)
+#include "iso_tx.h"
+#endif /* CONFIG_ISO_TX_THREAD */
+#include "tx_queue.h"
+
 /* Dit was eerst 10 ms, maar dan werkte de code niet */
 #define BUF_ALLOC_TIMEOUT (50) /* 10 ms */
-#define BIG_TERMINATE_TIMEOUT_US (60 * USEC_PER_SEC) /* 60 s */
+#if !defined(CONFIG_ISO_BIG_RECONFIG_NONE)
+#define BIG_TERMINATE_TIMEOUT_US (CONFIG_ISO_BIG_RECONFIG_INTERVAL_S * USEC_PER_SEC)
+#endif /* !CONFIG_ISO_BIG_RECONFIG_NONE */
+#if defined(CONFIG_ISO_BROADCAST_PAYLOAD_LC3)
+/* One LC3 frame per SDU */
+#define BIG_SDU_INTERVAL_US CONFIG_ISO_AUDIO_FRAME_DURATION_US
+#define ISO_SDU_LEN AUDIO_ENC_SDU_LEN
+/* Elk PCM-kanaal wordt een keer gecodeerd en naar zijn BIS verdeeld */
+#define PAYLOAD_COUNT AUDIO_ENC_PCM_CHAN_COUNT
+#elif defined(CONFIG_ISO_BROADCAST_PAYLOAD_LATENCY)
+#define BIG_SDU_INTERVAL_US (10000) /* 10 ms */
+#define ISO_SDU_LEN LATENCY_PROBE_LEN
+/* Alle BIS krijgen dezelfde tijdstempels */
+#define PAYLOAD_COUNT 1
+#else
 #define BIG_SDU_INTERVAL_US (10000) /* 10 ms */
+#define ISO_SDU_LEN sizeof(uint32_t)
+/* Alle BIS krijgen dezelfde teller */
+#define PAYLOAD_COUNT 1
+#endif /* CONFIG_ISO_BROADCAST_PAYLOAD_LC3 */
 
-#define BIS_ISO_CHAN_COUNT 2
+/* Aantal BIS per BIG en in totaal, zie ISO_BIG<n>_* in Kconfig */
+#define BIG_BIS_COUNT(n, _) CONFIG_ISO_BIG##n##_BIS_COUNT
+#define BIS_ISO_CHAN_COUNT (LISTIFY(CONFIG_ISO_BIG_COUNT, BIG_BIS_COUNT, (+)))
+
+/* Make-before-break heeft een tweede set advertising sets, BIGs en BIS
+ * nodig waarop de nieuwe BIG aangemaakt wordt voor de oude stopt
+ */
+#define BANK_COUNT (IS_ENABLED(CONFIG_ISO_BIG_RECONFIG_MBB) ? 2 : 1)
+
+BUILD_ASSERT(BIS_ISO_CHAN_COUNT * BANK_COUNT <= CONFIG_BT_ISO_MAX_CHAN,
+	     "CONFIG_BT_ISO_MAX_CHAN must cover the BIS of all BIGs");
+BUILD_ASSERT(CONFIG_ISO_BIG_COUNT * BANK_COUNT <= CONFIG_BT_ISO_MAX_BIG,
+	     "CONFIG_BT_ISO_MAX_BIG must cover all BIGs");
+BUILD_ASSERT(CONFIG_ISO_BIG_COUNT * BANK_COUNT <= CONFIG_BT_EXT_ADV_MAX_ADV_SET,
+	     "Every BIG needs its own advertising set");
+
+/* Zendtijd van de MIC (4 bytes) van een versleutelde PDU, voor Coded PHY
+ * met S=8 codering
+ */
+#define MIC_AIR_TIME_US(phy) ((phy) == BT_GAP_LE_PHY_2M ? 16U : \
+			      (phy) == BT_GAP_LE_PHY_CODED ? 256U : 32U)
+
+/* Channel Retransmission Number => 1 retry */
+#define ISO_TX_RTN 1
 /* Een bufferpool is een verzameling van vooraf gedefinieerde geheugenblokken (buffers) die in één keer worden toegewezen en die vervolgens worden beheerd en hergebruikt door de applicatie. Dit voorkomt constante dynamische geheugenallocatie en -deallocatie tijdens de uitvoering van de applicatie */
-NET_BUF_POOL_FIXED_DEFINE(bis_tx_pool, BIS_ISO_CHAN_COUNT,
+NET_BUF_POOL_FIXED_DEFINE(bis_tx_pool, TX_QUEUE_POOL_COUNT(BIS_ISO_CHAN_COUNT),
 			  BT_ISO_SDU_BUF_SIZE(CONFIG_BT_ISO_TX_MTU),
 			  CONFIG_BT_CONN_TX_USER_DATA_SIZE, NULL);
 
@@ -23,19 +81,45 @@ NET_BUF_POOL_FIXED_DEFINE(bis_tx_pool, BIS_ISO_CHAN_COUNT,
 static K_SEM_DEFINE(sem_big_cmplt, 0, BIS_ISO_CHAN_COUNT);
 /* Voor het synchroniseren bij het beëindigen van een BIG */
 static K_SEM_DEFINE(sem_big_term, 0, BIS_ISO_CHAN_COUNT);
-/* Om aan te geven wanneer ISO-data verzonden kan worden */
-static K_SEM_DEFINE(sem_iso_data, CONFIG_BT_ISO_TX_BUF_COUNT,
-				   CONFIG_BT_ISO_TX_BUF_COUNT);
 
+#if defined(CONFIG_ISO_TX_THREAD) || \
+	(!defined(CONFIG_ISO_TX_SCHED) && !defined(CONFIG_ISO_TX_QUEUE_BLOCK))
+/* Drop policies and the TX thread never block the producer, pace it at the
+ * SDU interval
+ */
+static K_TIMER_DEFINE(sdu_timer, NULL, NULL);
+#endif
+
+#if !defined(CONFIG_ISO_BIG_RECONFIG_NONE)
 #define INITIAL_TIMEOUT_COUNTER (BIG_TERMINATE_TIMEOUT_US / BIG_SDU_INTERVAL_US)
+#endif /* !CONFIG_ISO_BIG_RECONFIG_NONE */
 
 /* sequentienummer bij voor het verzenden van ISO-data */
 static uint16_t seq_num;
 
+/* ISO-kanalen van alle BIGs na elkaar, ingevuld in big_tables_init() */
+static struct bt_iso_chan bis_iso_chan[BANK_COUNT][BIS_ISO_CHAN_COUNT];
+static struct bt_iso_chan *bis[BANK_COUNT][BIS_ISO_CHAN_COUNT];
+/* Bank waarop momenteel verzonden wordt */
+static uint8_t bank;
+
+/* BIS die payload n verzenden: BIS chan krijgt payload chan % PAYLOAD_COUNT */
+static uint8_t payload_chans[PAYLOAD_COUNT][BIS_ISO_CHAN_COUNT];
+static uint8_t payload_chan_count[PAYLOAD_COUNT];
+
+/* Aantal herconfiguraties, de audio gap die ze veroorzaken meet iso_receive */
+static uint32_t reconfig_count;
+
+#if defined(CONFIG_ISO_BROADCAST_PAYLOAD_LATENCY)
+static uint32_t local_us(void)
+{
+	return (uint32_t)k_ticks_to_us_floor64(k_uptime_ticks());
+}
+#endif /* CONFIG_ISO_BROADCAST_PAYLOAD_LATENCY */
+
 static void iso_connected(struct bt_iso_chan *chan)
 {
 	printk("ISO Channel %p connected\n", chan);
-	seq_num = 0U;
 	/* incrementeer semafoor met 1 als de max nog niet bereikt is */
 	k_sem_give(&sem_big_cmplt);
 }
@@ -49,7 +133,10 @@ static void iso_disconnected(struct bt_iso_chan *chan, uint8_t reason)
 static void iso_sent(struct bt_iso_chan *chan)
 {
 	// printk("ISO Channel %p send data\n", chan);
-	k_sem_give(&sem_iso_data);
+#if defined(CONFIG_ISO_TX_SCHED)
+	tx_sched_sent(chan);
+#endif /* CONFIG_ISO_TX_SCHED */
+	tx_queue_sent(chan);
 }
 
 static struct bt_iso_chan_ops iso_ops = {
@@ -59,8 +146,8 @@ static struct bt_iso_chan_ops iso_ops = {
 };
 
 static struct bt_iso_chan_io_qos iso_tx_qos = {
-	.sdu = sizeof(uint32_t), /* maximale grootte van SDU in bytes */
-	.rtn = 1, /* Channel Retransmission Number => 1 retry */
+	.sdu = ISO_SDU_LEN, /* maximale grootte van SDU in bytes */
+	.rtn = ISO_TX_RTN,
 	.phy = BT_GAP_LE_PHY_2M, /* 2 Mbps => hogere snelheid, maar lager bereik */
 };
 
@@ -68,91 +155,188 @@ static struct bt_iso_chan_qos bis_iso_qos = {
 	.tx = &iso_tx_qos, /* Channel Transmission QoS (Quality of Service) */
 };
 
-/* Definieert twee ISO-kanalen met de bovenstaande instellingen en callbacks */
-static struct bt_iso_chan bis_iso_chan[] = {
-	{ .ops = &iso_ops, .qos = &bis_iso_qos, },
-	{ .ops = &iso_ops, .qos = &bis_iso_qos, },
+struct big_cfg {
+	uint8_t num_bis;
+	uint8_t packing;
+	uint8_t framing;
 };
 
-static struct bt_iso_chan *bis[] = {
-	&bis_iso_chan[0],
-	&bis_iso_chan[1],
-};
+#define BIG_CFG(n, _)                                                            \
+	{                                                                        \
+		.num_bis = CONFIG_ISO_BIG##n##_BIS_COUNT,                        \
+		.packing = IS_ENABLED(CONFIG_ISO_BIG##n##_PACKING_INTERLEAVED) ? \
+				   BT_ISO_PACKING_INTERLEAVED :                  \
+				   BT_ISO_PACKING_SEQUENTIAL,                    \
+		.framing = IS_ENABLED(CONFIG_ISO_BIG##n##_FRAMED) ?              \
+				   BT_ISO_FRAMING_FRAMED :                       \
+				   BT_ISO_FRAMING_UNFRAMED,                      \
+	}
 
-static struct bt_iso_big_create_param big_create_param = {
-	.num_bis = BIS_ISO_CHAN_COUNT,
-	.bis_channels = bis,
-	.interval = BIG_SDU_INTERVAL_US, /* in microseconds */
-	/* tijd tss data ingevoerd en verzonden in de BIS => ms */
-	.latency = 10,
-	.packing = 0, /* 0 - sequential, 1 - interleaved */
-	.framing = 0, /* 0 - unframed, 1 - framed */
+static const struct big_cfg big_cfg[CONFIG_ISO_BIG_COUNT] = {
+	LISTIFY(CONFIG_ISO_BIG_COUNT, BIG_CFG, (,))
 };
 
+static struct bt_iso_big_create_param big_create_param[BANK_COUNT][CONFIG_ISO_BIG_COUNT];
+static struct bt_le_ext_adv *adv[BANK_COUNT][CONFIG_ISO_BIG_COUNT];
+static struct bt_iso_big *big[BANK_COUNT][CONFIG_ISO_BIG_COUNT];
+
 static const struct bt_data ad[] = {
 	BT_DATA(BT_DATA_NAME_COMPLETE /* 0x09 */, CONFIG_BT_DEVICE_NAME, sizeof(CONFIG_BT_DEVICE_NAME) - 1),
 };
 
-int main(void)
+static void big_tables_init(uint8_t b)
 {
-	uint32_t timeout_counter = INITIAL_TIMEOUT_COUNTER; /* 6000 */
-	struct bt_le_ext_adv *adv;
-	struct bt_iso_big *big;
-	int err;
-
-	uint32_t iso_send_count = 0;
-	uint8_t iso_data[sizeof(iso_send_count)] = { 0 };
+	uint8_t first_bis = 0U;
 
-	printk("Starting ISO Broadcast Demo\n");
+	for (uint8_t chan = 0U; chan < BIS_ISO_CHAN_COUNT; chan++) {
+		bis_iso_chan[b][chan].ops = &iso_ops;
+		bis_iso_chan[b][chan].qos = &bis_iso_qos;
+		bis[b][chan] = &bis_iso_chan[b][chan];
+	}
 
-	/* Initialize the Bluetooth Subsystem */
-	err = bt_enable(NULL);
-	if (err) {
-		printk("Bluetooth init failed (err %d)\n", err);
-		return 0;
+	for (uint8_t i = 0U; i < CONFIG_ISO_BIG_COUNT; i++) {
+		struct bt_iso_big_create_param *param = &big_create_param[b][i];
+
+		param->num_bis = big_cfg[i].num_bis;
+		param->bis_channels = &bis[b][first_bis];
+		param->interval = BIG_SDU_INTERVAL_US; /* in microseconds */
+		/* tijd tss data ingevoerd en verzonden in de BIS => ms */
+		param->latency = 10;
+		/* Interleaved packing wisselt de BIS per subevent af, dat verandert
+		 * de radioplanning en de latency
+		 */
+		param->packing = big_cfg[i].packing;
+		param->framing = big_cfg[i].framing;
+
+		printk("BIG %u.%u: BIS %u..%u, %s packing, %s\n", b, i, first_bis,
+		       first_bis + param->num_bis - 1U,
+		       param->packing == BT_ISO_PACKING_INTERLEAVED ?
+		       "interleaved" : "sequential",
+		       param->framing == BT_ISO_FRAMING_FRAMED ? "framed" : "unframed");
+
+		first_bis += param->num_bis;
 	}
+}
+
+/* Een BIG hoort altijd bij precies een periodic advertising train, dus elke
+ * BIG krijgt zijn eigen advertising set
+ */
+static int adv_create(struct bt_le_ext_adv **adv_set)
+{
+	int err;
 
 	/* Create a non-connectable non-scannable advertising set */
-	err = bt_le_ext_adv_create(BT_LE_EXT_ADV_NCONN, NULL, &adv);
+	err = bt_le_ext_adv_create(BT_LE_EXT_ADV_NCONN, NULL, adv_set);
 	if (err) {
 		printk("Failed to create advertising set (err %d)\n", err);
-		return 0;
+		return err;
 	}
 
 	/* Set advertising data to have complete local name set */
-	err = bt_le_ext_adv_set_data(adv, ad, ARRAY_SIZE(ad), NULL, 0);
+	err = bt_le_ext_adv_set_data(*adv_set, ad, ARRAY_SIZE(ad), NULL, 0);
 	if (err) {
 		printk("Failed to set advertising data (err %d)\n", err);
-		return 0;
+		return err;
 	}
 
 	/* Set periodic advertising parameters */
-	err = bt_le_per_adv_set_param(adv, BT_LE_PER_ADV_DEFAULT);
+	err = bt_le_per_adv_set_param(*adv_set, BT_LE_PER_ADV_DEFAULT);
 	if (err) {
 		printk("Failed to set periodic advertising parameters"
 		       " (err %d)\n", err);
-		return 0;
+		return err;
 	}
 
 	/* Enable Periodic Advertising */
-	err = bt_le_per_adv_start(adv);
+	err = bt_le_per_adv_start(*adv_set);
 	if (err) {
 		printk("Failed to enable periodic advertising (err %d)\n", err);
-		return 0;
+		return err;
 	}
 
 	/* Start extended advertising */
-	err = bt_le_ext_adv_start(adv, BT_LE_EXT_ADV_START_DEFAULT);
+	err = bt_le_ext_adv_start(*adv_set, BT_LE_EXT_ADV_START_DEFAULT);
 	if (err) {
 		printk("Failed to start extended advertising (err %d)\n", err);
-		return 0;
+		return err;
 	}
 
-	/* Create BIG */
-	err = bt_iso_big_create(adv, &big_create_param, &big);
+	return 0;
+}
+
+#if defined(CONFIG_ISO_BIG_RECONFIG_MBB)
+static int adv_delete(struct bt_le_ext_adv *adv_set)
+{
+	int err;
+
+	err = bt_le_per_adv_stop(adv_set);
 	if (err) {
-		printk("Failed to create BIG (err %d)\n", err);
-		return 0;
+		printk("Failed to stop periodic advertising (err %d)\n", err);
+		return err;
+	}
+
+	err = bt_le_ext_adv_stop(adv_set);
+	if (err) {
+		printk("Failed to stop extended advertising (err %d)\n", err);
+		return err;
+	}
+
+	err = bt_le_ext_adv_delete(adv_set);
+	if (err) {
+		printk("Failed to delete advertising set (err %d)\n", err);
+		return err;
+	}
+
+	return 0;
+}
+#endif /* CONFIG_ISO_BIG_RECONFIG_MBB */
+
+/* BIG timing gekozen door de controller. Encryptie voegt een MIC van 4 bytes
+ * toe aan elke PDU, wat de max PDU, sync delay en zendtijd verhoogt.
+ */
+static void big_info_print(uint8_t b, uint8_t i, struct bt_iso_chan *chan)
+{
+	const struct bt_iso_big_create_param *param = &big_create_param[b][i];
+	struct bt_iso_info info;
+	uint32_t mic_us;
+
+	if (bt_iso_chan_get_info(chan, &info)) {
+		return;
+	}
+
+	/* Air time of the MIC of every PDU in a BIG event, on the PHY the
+	 * controller picked for the BIG
+	 */
+	mic_us = param->num_bis * info.max_subevent *
+		 MIC_AIR_TIME_US(info.broadcaster.phy);
+
+	printk("BIG %u.%u: %sencrypted, phy 0x%02x, iso interval %u us, max subevent %u, "
+	       "sync delay %u us, transport latency %u us, max pdu %u, "
+	       "MIC air time %u us per event\n", b, i,
+	       param->encryption ? "" : "not ", info.broadcaster.phy,
+	       info.iso_interval * 1250U,
+	       info.max_subevent, info.broadcaster.sync_delay,
+	       info.broadcaster.transport_latency, info.broadcaster.max_pdu,
+	       param->encryption ? mic_us : 0U);
+}
+
+static int big_create_all(uint8_t b)
+{
+	int err;
+
+	for (uint8_t i = 0U; i < CONFIG_ISO_BIG_COUNT; i++) {
+		struct bt_iso_big_create_param *param = &big_create_param[b][i];
+
+		/* De Broadcast Code kan tijdens het draaien veranderd zijn */
+		param->encryption = broadcast_code_get(param->bcode);
+
+		printk("Create BIG %u.%u...", b, i);
+		err = bt_iso_big_create(adv[b][i], &big_create_param[b][i], &big[b][i]);
+		if (err) {
+			printk("failed (err %d)\n", err);
+			return err;
+		}
+		printk("done.\n");
 	}
 
 	for (uint8_t chan = 0U; chan < BIS_ISO_CHAN_COUNT; chan++) {
@@ -161,92 +345,312 @@ int main(void)
 		err = k_sem_take(&sem_big_cmplt, K_FOREVER);
 		if (err) {
 			printk("failed (err %d)\n", err);
-			return 0;
+			return err;
 		}
 		printk("BIG create complete chan %u.\n", chan);
 	}
 
-	while (true) {
-		for (uint8_t chan = 0U; chan < BIS_ISO_CHAN_COUNT; chan++) {
-			struct net_buf *buf;
-			int ret;
+	for (uint8_t i = 0U; i < CONFIG_ISO_BIG_COUNT; i++) {
+		big_info_print(b, i, big_create_param[b][i].bis_channels[0]);
+	}
 
-			buf = net_buf_alloc(&bis_tx_pool, K_MSEC(BUF_ALLOC_TIMEOUT));
-			if (!buf) {
-				printk("Data buffer allocate timeout on channel %u\n", chan);
-				return 0;
-			}
+	return 0;
+}
 
-			ret = k_sem_take(&sem_iso_data, K_MSEC(BUF_ALLOC_TIMEOUT));
-			if (ret) {
-				printk("k_sem_take for ISO data sent failed\n");
-				/* Decrements the reference count of a buffer => The buffer is put back into the pool if the reference count reaches zero*/
-				net_buf_unref(buf);
-				return 0;
-			}
+static int big_terminate_all(uint8_t b)
+{
+	int err;
 
-			net_buf_reserve(buf, BT_ISO_CHAN_SEND_RESERVE);
-			/* Zet uint32 om in array van bytes in little-endian formaat */
-			sys_put_le32(iso_send_count, iso_data);
-			/* Voeg ISO data toe aan buffer */
-			net_buf_add_mem(buf, iso_data, sizeof(iso_data));
-			/* Verzend de bufferinhoud via het BIS ISO-kanaal */
-			ret = bt_iso_chan_send(&bis_iso_chan[chan], buf, seq_num);
-			if (ret < 0) {
-				printk("Unable to broadcast data on channel %u : %d", chan,ret);
-				net_buf_unref(buf);
-				return 0;
-			}
+	for (uint8_t i = 0U; i < CONFIG_ISO_BIG_COUNT; i++) {
+		printk("BIG %u.%u Terminate...", b, i);
+		err = bt_iso_big_terminate(big[b][i]);
+		if (err) {
+			printk("failed (err %d)\n", err);
+			return err;
+		}
+		printk("done.\n");
+	}
+
+	for (uint8_t chan = 0U; chan < BIS_ISO_CHAN_COUNT; chan++) {
+		printk("Waiting for BIG terminate complete chan %u...\n", chan);
+		err = k_sem_take(&sem_big_term, K_FOREVER);
+		if (err) {
+			printk("failed (err %d)\n", err);
+			return err;
+		}
+		printk("BIG terminate complete chan %u.\n", chan);
+	}
+
+	return 0;
+}
+
+#if defined(CONFIG_ISO_BIG_RECONFIG_MBB)
+/* SDU-intervallen dat de oude bank blijft bestaan na het omschakelen, genoeg
+ * om alle SDUs die al in de host en controller zitten nog uit te zenden
+ */
+#define RETIRE_SDU_COUNT (CONFIG_ISO_TX_QUEUE_DEPTH + TX_QUEUE_INFLIGHT + 1)
+
+static int big_retire(uint8_t b)
+{
+	int err;
+
+	err = big_terminate_all(b);
+	if (err) {
+		return err;
+	}
+
+	for (uint8_t i = 0U; i < CONFIG_ISO_BIG_COUNT; i++) {
+		err = adv_delete(adv[b][i]);
+		if (err) {
+			return err;
 		}
+		adv[b][i] = NULL;
+	}
+
+	return 0;
+}
+#endif /* CONFIG_ISO_BIG_RECONFIG_MBB */
+
+#if !defined(CONFIG_ISO_BIG_RECONFIG_NONE)
+static int big_reconfigure(void)
+{
+	int err;
+
+	reconfig_count++;
+
+#if defined(CONFIG_ISO_BIG_RECONFIG_MBB)
+	/* Make before break: de nieuwe BIGs worden op nieuwe advertising sets
+	 * aangemaakt terwijl de oude nog uitzenden
+	 */
+	for (uint8_t i = 0U; i < CONFIG_ISO_BIG_COUNT; i++) {
+		err = adv_create(&adv[bank ^ 1U][i]);
+		if (err) {
+			return err;
+		}
+	}
+
+	err = big_create_all(bank ^ 1U);
+	if (err) {
+		return err;
+	}
+
+	bank ^= 1U;
+	tx_queue_rebind(bis[bank]);
+#else
+	err = big_terminate_all(bank);
+	if (err) {
+		return err;
+	}
+
+	/* SDUs still queued for the old BIG are never sent */
+	tx_queue_reset();
+
+	err = big_create_all(bank);
+	if (err) {
+		return err;
+	}
+
+	seq_num = 0U;
+#endif /* CONFIG_ISO_BIG_RECONFIG_MBB */
+
+#if defined(CONFIG_ISO_TX_SCHED)
+	tx_sched_start(&bis_iso_chan[bank][0], BIG_SDU_INTERVAL_US);
+#endif /* CONFIG_ISO_TX_SCHED */
+
+	return 0;
+}
+#endif /* !CONFIG_ISO_BIG_RECONFIG_NONE */
+
+int main(void)
+{
+#if !defined(CONFIG_ISO_BIG_RECONFIG_NONE)
+	uint32_t timeout_counter = INITIAL_TIMEOUT_COUNTER; /* 6000 */
+#endif /* !CONFIG_ISO_BIG_RECONFIG_NONE */
+#if defined(CONFIG_ISO_BIG_RECONFIG_MBB)
+	uint32_t retire_counter = 0U;
+#endif /* CONFIG_ISO_BIG_RECONFIG_MBB */
+	int err;
+
+	uint32_t iso_send_count = 0;
+#if defined(CONFIG_ISO_BROADCAST_PAYLOAD_LC3)
+	static uint8_t iso_data[PAYLOAD_COUNT][AUDIO_ENC_SDU_LEN];
+#elif defined(CONFIG_ISO_BROADCAST_PAYLOAD_LATENCY)
+	uint8_t iso_data[PAYLOAD_COUNT][LATENCY_PROBE_LEN] = { 0 };
+#else
+	uint8_t iso_data[PAYLOAD_COUNT][sizeof(iso_send_count)] = { 0 };
+#endif /* CONFIG_ISO_BROADCAST_PAYLOAD_LC3 */
+
+	printk("Starting ISO Broadcast Demo\n");
+
+#if defined(CONFIG_ISO_FANOUT_BENCH)
+	iso_fanout_bench();
+#endif /* CONFIG_ISO_FANOUT_BENCH */
+
+	/* Initialize the Bluetooth Subsystem */
+	err = bt_enable(NULL);
+	if (err) {
+		printk("Bluetooth init failed (err %d)\n", err);
+		return 0;
+	}
+
+#if defined(CONFIG_ISO_BENCH_SWEEP)
+	/* Benchmark mode: sweep the QoS and BIG parameters instead of streaming */
+	(void)bench_sweep_run();
+	return 0;
+#endif /* CONFIG_ISO_BENCH_SWEEP */
+
+#if defined(CONFIG_ISO_BROADCAST_PAYLOAD_LC3)
+	err = audio_enc_init();
+	if (err) {
+		printk("Audio encoder init failed (err %d)\n", err);
+		return 0;
+	}
+#endif /* CONFIG_ISO_BROADCAST_PAYLOAD_LC3 */
+
+	for (uint8_t b = 0U; b < BANK_COUNT; b++) {
+		big_tables_init(b);
+	}
+
+	for (uint8_t i = 0U; i < CONFIG_ISO_BIG_COUNT; i++) {
+		err = adv_create(&adv[bank][i]);
+		if (err) {
+			return 0;
+		}
+	}
+
+	err = big_create_all(bank);
+	if (err) {
+		return 0;
+	}
+
+	tx_queue_init(bis[bank], BIS_ISO_CHAN_COUNT, BIG_SDU_INTERVAL_US);
+	iso_fanout_init(&bis_tx_pool);
+
+	for (uint8_t chan = 0U; chan < BIS_ISO_CHAN_COUNT; chan++) {
+		uint8_t p = chan % PAYLOAD_COUNT;
+
+		payload_chans[p][payload_chan_count[p]++] = chan;
+	}
+
+#if defined(CONFIG_ISO_TX_SCHED)
+	tx_sched_start(&bis_iso_chan[bank][0], BIG_SDU_INTERVAL_US);
+#endif /* CONFIG_ISO_TX_SCHED */
+#if defined(CONFIG_ISO_TX_THREAD)
+	/* main is vanaf hier alleen nog producent, de ISO TX thread verzendt */
+	k_timer_start(&sdu_timer, K_USEC(BIG_SDU_INTERVAL_US), K_USEC(BIG_SDU_INTERVAL_US));
+	iso_tx_start(BIS_ISO_CHAN_COUNT, BIG_SDU_INTERVAL_US);
+#elif !defined(CONFIG_ISO_TX_SCHED) && !defined(CONFIG_ISO_TX_QUEUE_BLOCK)
+	k_timer_start(&sdu_timer, K_USEC(BIG_SDU_INTERVAL_US), K_USEC(BIG_SDU_INTERVAL_US));
+#endif /* CONFIG_ISO_TX_THREAD */
+
+	while (true) {
+#if !defined(CONFIG_ISO_TX_THREAD)
+		struct tx_sched_slot slot = { .seq_num = seq_num };
+#endif /* !CONFIG_ISO_TX_THREAD */
+
+#if defined(CONFIG_ISO_BROADCAST_PAYLOAD_LC3)
+		/* Encode the next frame for all BIS before the first send */
+		err = audio_enc_frame(iso_data);
+		if (err) {
+			printk("Audio encode failed (err %d)\n", err);
+			return 0;
+		}
+#endif /* CONFIG_ISO_BROADCAST_PAYLOAD_LC3 */
+
+#if defined(CONFIG_ISO_TX_THREAD)
+		k_timer_status_sync(&sdu_timer);
+#elif defined(CONFIG_ISO_TX_SCHED)
+		/* Wait for the SDU of the next BIG event, all BIS share it */
+		tx_sched_wait(&slot);
+		seq_num = slot.seq_num;
+#elif !defined(CONFIG_ISO_TX_QUEUE_BLOCK)
+		k_timer_status_sync(&sdu_timer);
+#endif /* CONFIG_ISO_TX_SCHED */
+
+#if defined(CONFIG_ISO_BROADCAST_PAYLOAD_LATENCY)
+		/* Opgenomen na het wachten op het SDU-interval, net voor het verzenden.
+		 * De TX thread kiest zelf het sequence number en het anker, hij vult ze
+		 * in bij het verzenden.
+		 */
+#if defined(CONFIG_ISO_TX_THREAD)
+		latency_probe_put(iso_data[0], iso_send_count, 0U, local_us(), 0U);
+#else
+		latency_probe_put(iso_data[0], iso_send_count, seq_num, local_us(),
+				  slot.timed ? slot.anchor_us : 0U);
+#endif /* CONFIG_ISO_TX_THREAD */
+#elif !defined(CONFIG_ISO_BROADCAST_PAYLOAD_LC3)
+		/* Zet uint32 om in array van bytes in little-endian formaat */
+		sys_put_le32(iso_send_count, iso_data[0]);
+#endif /* CONFIG_ISO_BROADCAST_PAYLOAD_LATENCY */
+
+#if defined(CONFIG_ISO_TX_THREAD)
+		/* Blokkeert nooit, een volle ring dropt de nieuwste SDU */
+		for (uint8_t chan = 0U; chan < BIS_ISO_CHAN_COUNT; chan++) {
+			(void)iso_tx_produce(chan, iso_data[chan % PAYLOAD_COUNT],
+					     sizeof(iso_data[0]));
+		}
+#else
+		/* Elke payload wordt een keer gemaakt en rechtstreeks naar de buffers
+		 * van zijn BIS gekopieerd, de wachtrij is eigenaar van die buffers.
+		 * Nooit langer dan een SDU-interval wachten op een buffer.
+		 */
+		for (uint8_t p = 0U; p < PAYLOAD_COUNT; p++) {
+			(void)iso_fanout_put(iso_data[p], sizeof(iso_data[p]),
+					     payload_chans[p], payload_chan_count[p], &slot,
+					     K_USEC(MIN(BUF_ALLOC_TIMEOUT * USEC_PER_MSEC,
+							BIG_SDU_INTERVAL_US)));
+		}
+		/* main verzendt zelf, niet de system work queue */
+		tx_queue_drain();
+
+#if defined(CONFIG_ISO_TX_SCHED)
+		tx_sched_done(&slot);
+#endif /* CONFIG_ISO_TX_SCHED */
+#endif /* CONFIG_ISO_TX_THREAD */
 
 		/* ISO_PRINT_INTERVAL staat in Kconfig file */
 		if ((iso_send_count % CONFIG_ISO_PRINT_INTERVAL) == 0) {
 			printk("Sending value %u with sequence nr %u\n", iso_send_count, seq_num);
+#if defined(CONFIG_ISO_BROADCAST_PAYLOAD_LC3)
+			audio_enc_stats_print();
+#endif /* CONFIG_ISO_BROADCAST_PAYLOAD_LC3 */
+#if defined(CONFIG_ISO_TX_SCHED)
+			tx_sched_stats_print();
+#endif /* CONFIG_ISO_TX_SCHED */
+#if defined(CONFIG_ISO_TX_THREAD)
+			iso_tx_stats_print();
+#endif /* CONFIG_ISO_TX_THREAD */
+			tx_queue_stats_print();
+			iso_fanout_stats_print();
+			printk("%u BIG reconfigurations\n", reconfig_count);
 		}
 
 		iso_send_count++;
 		seq_num++;
 
+#if defined(CONFIG_ISO_BIG_RECONFIG_MBB)
+		if (retire_counter && !--retire_counter) {
+			err = big_retire(bank ^ 1U);
+			if (err) {
+				return 0;
+			}
+		}
+#endif /* CONFIG_ISO_BIG_RECONFIG_MBB */
+
+#if !defined(CONFIG_ISO_BIG_RECONFIG_NONE)
 		timeout_counter--;
 		if (!timeout_counter) {
 			timeout_counter = INITIAL_TIMEOUT_COUNTER;
 
-			printk("BIG Terminate...");
-			err = bt_iso_big_terminate(big);
+			err = big_reconfigure();
 			if (err) {
-				printk("failed (err %d)\n", err);
 				return 0;
 			}
-			printk("done.\n");
-
-			for (uint8_t chan = 0U; chan < BIS_ISO_CHAN_COUNT;
-			     chan++) {
-				printk("Waiting for BIG terminate complete chan %u...\n", chan);
-				err = k_sem_take(&sem_big_term, K_FOREVER);
-				if (err) {
-					printk("failed (err %d)\n", err);
-					return 0;
-				}
-				printk("BIG terminate complete chan %u.\n", chan);
-			}
 
-			printk("Create BIG...");
-			err = bt_iso_big_create(adv, &big_create_param, &big);
-			if (err) {
-				printk("failed (err %d)\n", err);
-				return 0;
-			}
-			printk("done.\n");
-
-			for (uint8_t chan = 0U; chan < BIS_ISO_CHAN_COUNT; chan++) {
-				printk("Waiting for BIG complete chan %u...\n", chan);
-				err = k_sem_take(&sem_big_cmplt, K_FOREVER);
-				if (err) {
-					printk("failed (err %d)\n", err);
-					return 0;
-				}
-				printk("BIG create complete chan %u.\n", chan);
-			}
+#if defined(CONFIG_ISO_BIG_RECONFIG_MBB)
+			retire_counter = RETIRE_SDU_COUNT;
+#endif /* CONFIG_ISO_BIG_RECONFIG_MBB */
 		}
+#endif /* !CONFIG_ISO_BIG_RECONFIG_NONE */
 	}
 }
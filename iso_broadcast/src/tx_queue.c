@@ -0,0 +1,362 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/iso.h>
+#include <zephyr/net/buf.h>
+#include <zephyr/sys/printk.h>
+
+#include "perf.h"
+#include "tx_queue.h"
+
+#define TX_QUEUE_CHAN_MAX CONFIG_BT_ISO_MAX_CHAN
+/* SDUs per BIS whose send time is kept until iso_sent */
+#define SENT_TIME_COUNT 8
+
+struct tx_queue_entry {
+	struct net_buf *buf;
+	struct tx_sched_slot slot;
+};
+
+struct tx_queue {
+	struct bt_iso_chan *chan;
+	struct tx_queue_entry entries[CONFIG_ISO_TX_QUEUE_DEPTH];
+	uint8_t head;
+	uint8_t count;
+	uint8_t count_max;
+	/* Free entries, only waited on by the block policy */
+	struct k_sem space;
+
+	/* Send times of the SDUs in the host and controller, in order */
+	uint32_t sent_us[SENT_TIME_COUNT];
+	uint32_t sent_wr;
+	uint32_t sent_rd;
+
+	uint32_t queued;
+	uint32_t sent;
+	uint32_t dropped_oldest;
+	uint32_t dropped_newest;
+	uint32_t dropped_expired;
+	uint32_t send_err;
+};
+
+static struct tx_queue queues[TX_QUEUE_CHAN_MAX];
+static uint8_t queue_count;
+static struct k_spinlock queue_lock;
+
+/* SDUs the host may still take, returned by iso_sent */
+static struct k_sem credits;
+static uint8_t credit_count;
+
+/* Longest tx_queue_put() blocks, at most one SDU interval */
+static k_timeout_t block_timeout;
+
+/* Time from handing an SDU to the host until iso_sent, includes encryption
+ * in the controller when the BIG is encrypted
+ */
+static struct perf_stat sent_stat;
+
+static bool entry_pop(struct tx_queue *q, struct tx_queue_entry *entry)
+{
+	k_spinlock_key_t key = k_spin_lock(&queue_lock);
+
+	if (!q->count) {
+		k_spin_unlock(&queue_lock, key);
+		return false;
+	}
+
+	*entry = q->entries[q->head];
+	q->head = (q->head + 1U) % CONFIG_ISO_TX_QUEUE_DEPTH;
+	q->count--;
+
+	k_spin_unlock(&queue_lock, key);
+
+	return true;
+}
+
+static void entry_push(struct tx_queue *q, struct net_buf *buf,
+		       const struct tx_sched_slot *slot)
+{
+	k_spinlock_key_t key = k_spin_lock(&queue_lock);
+	uint8_t tail = (q->head + q->count) % CONFIG_ISO_TX_QUEUE_DEPTH;
+
+	q->entries[tail].buf = buf;
+	q->entries[tail].slot = *slot;
+	q->count++;
+	q->count_max = MAX(q->count_max, q->count);
+	q->queued++;
+
+	k_spin_unlock(&queue_lock, key);
+}
+
+static uint32_t local_us(void)
+{
+	return (uint32_t)k_ticks_to_us_floor64(k_uptime_ticks());
+}
+
+static int entry_send(struct tx_queue *q, struct tx_queue_entry *entry)
+{
+	k_spinlock_key_t key = k_spin_lock(&queue_lock);
+	struct bt_iso_chan *chan = q->chan;
+	bool timed = false;
+	int err;
+
+	if (q->sent_wr - q->sent_rd < SENT_TIME_COUNT) {
+		q->sent_us[q->sent_wr % SENT_TIME_COUNT] = local_us();
+		q->sent_wr++;
+		timed = true;
+	}
+
+	k_spin_unlock(&queue_lock, key);
+
+#if defined(CONFIG_ISO_TX_SCHED)
+	err = tx_sched_send(chan, entry->buf, &entry->slot);
+#else
+	err = bt_iso_chan_send(chan, entry->buf, entry->slot.seq_num);
+#endif /* CONFIG_ISO_TX_SCHED */
+
+	/* No iso_sent follows, take back the send time stored above, if any */
+	if (err < 0 && timed) {
+		key = k_spin_lock(&queue_lock);
+		q->sent_wr--;
+		k_spin_unlock(&queue_lock, key);
+	}
+
+	return err;
+}
+
+/* One BIS at a time so all BIS get their SDU for the same event before the
+ * next one is started
+ */
+void tx_queue_drain(void)
+{
+	bool busy = true;
+
+	while (busy) {
+		busy = false;
+
+		for (uint8_t i = 0U; i < queue_count; i++) {
+			struct tx_queue *q = &queues[i];
+			struct tx_queue_entry entry;
+			int err;
+
+			if (k_sem_take(&credits, K_NO_WAIT)) {
+				return;
+			}
+
+			if (!entry_pop(q, &entry)) {
+				k_sem_give(&credits);
+				continue;
+			}
+
+			k_sem_give(&q->space);
+			busy = true;
+
+			err = entry_send(q, &entry);
+			if (err < 0) {
+				/* Expired SDUs are counted by the scheduler */
+				if (err != -ETIMEDOUT) {
+					q->send_err++;
+				}
+				net_buf_unref(entry.buf);
+				k_sem_give(&credits);
+				continue;
+			}
+
+			q->sent++;
+		}
+	}
+}
+
+void tx_queue_init(struct bt_iso_chan **chans, uint8_t count, uint32_t interval_us)
+{
+	__ASSERT_NO_MSG(count <= TX_QUEUE_CHAN_MAX);
+
+	queue_count = count;
+	for (uint8_t i = 0U; i < count; i++) {
+		queues[i].chan = chans[i];
+		k_sem_init(&queues[i].space, CONFIG_ISO_TX_QUEUE_DEPTH,
+			   CONFIG_ISO_TX_QUEUE_DEPTH);
+	}
+
+	perf_stat_reset(&sent_stat);
+
+	credit_count = TX_QUEUE_INFLIGHT;
+	k_sem_init(&credits, credit_count, credit_count);
+
+	block_timeout = K_NO_WAIT;
+	if (IS_ENABLED(CONFIG_ISO_TX_QUEUE_BLOCK)) {
+		block_timeout = K_USEC(MIN(CONFIG_ISO_TX_QUEUE_BLOCK_TIMEOUT_MS * USEC_PER_MSEC,
+					   interval_us));
+	}
+}
+
+/* Wait until iso_sent returned a credit and send what it allows, false when
+ * the wait timed out
+ */
+static bool credit_wait(k_timepoint_t end)
+{
+	if (k_sem_take(&credits, sys_timepoint_timeout(end))) {
+		return false;
+	}
+
+	k_sem_give(&credits);
+	tx_queue_drain();
+
+	return true;
+}
+
+int tx_queue_put(uint8_t chan, struct net_buf *buf,
+		 const struct tx_sched_slot *slot)
+{
+	struct tx_queue *q = &queues[chan];
+	k_timepoint_t end = sys_timepoint_calc(block_timeout);
+
+	while (k_sem_take(&q->space, K_NO_WAIT)) {
+		struct tx_queue_entry oldest;
+
+		/* The caller is also the one that sends, so it drains the queue
+		 * itself while it waits for space
+		 */
+		if (IS_ENABLED(CONFIG_ISO_TX_QUEUE_BLOCK) && credit_wait(end)) {
+			continue;
+		}
+
+		if (!IS_ENABLED(CONFIG_ISO_TX_QUEUE_DROP_OLDEST)) {
+			/* Drop newest, or blocked for too long: keep streaming what is
+			 * already queued.
+			 */
+			q->dropped_newest++;
+			net_buf_unref(buf);
+			return -ENOBUFS;
+		}
+
+		/* The entry of the oldest SDU is taken over by the new one. If the
+		 * queue was drained in the meantime there is space again.
+		 */
+		if (entry_pop(q, &oldest)) {
+			q->dropped_oldest++;
+			net_buf_unref(oldest.buf);
+			break;
+		}
+	}
+
+	entry_push(q, buf, slot);
+
+	return 0;
+}
+
+void tx_queue_sent(struct bt_iso_chan *chan)
+{
+	k_spinlock_key_t key = k_spin_lock(&queue_lock);
+
+	for (uint8_t i = 0U; i < queue_count; i++) {
+		struct tx_queue *q = &queues[i];
+
+		if (q->chan != chan) {
+			continue;
+		}
+
+		if (q->sent_rd != q->sent_wr) {
+			perf_stat_add(&sent_stat, (local_us() -
+				      q->sent_us[q->sent_rd % SENT_TIME_COUNT]) *
+				      NSEC_PER_USEC);
+			q->sent_rd++;
+		}
+		break;
+	}
+
+	k_spin_unlock(&queue_lock, key);
+
+	k_sem_give(&credits);
+}
+
+void tx_queue_reset(void)
+{
+	for (uint8_t i = 0U; i < queue_count; i++) {
+		struct tx_queue *q = &queues[i];
+		struct tx_queue_entry entry;
+
+		while (entry_pop(q, &entry)) {
+			net_buf_unref(entry.buf);
+		}
+
+		k_sem_init(&q->space, CONFIG_ISO_TX_QUEUE_DEPTH,
+			   CONFIG_ISO_TX_QUEUE_DEPTH);
+		q->sent_rd = q->sent_wr;
+	}
+
+	k_sem_init(&credits, credit_count, credit_count);
+}
+
+/* Drop the SDUs whose BIG anchor passed while they were queued. The time stamps
+ * of the others belong to the old BIG, they are sent untimed on the new one.
+ */
+static void entries_expire(struct tx_queue *q)
+{
+	struct net_buf *expired[CONFIG_ISO_TX_QUEUE_DEPTH];
+	uint8_t expired_count = 0U;
+	k_spinlock_key_t key = k_spin_lock(&queue_lock);
+	uint32_t now = local_us();
+	uint8_t count = 0U;
+
+	for (uint8_t i = 0U; i < q->count; i++) {
+		struct tx_queue_entry *entry =
+			&q->entries[(q->head + i) % CONFIG_ISO_TX_QUEUE_DEPTH];
+
+		if (entry->slot.timed && (int32_t)(entry->slot.anchor_us - now) <= 0) {
+			expired[expired_count++] = entry->buf;
+			continue;
+		}
+
+		entry->slot.timed = false;
+		q->entries[(q->head + count) % CONFIG_ISO_TX_QUEUE_DEPTH] = *entry;
+		count++;
+	}
+
+	q->count = count;
+	q->dropped_expired += expired_count;
+
+	k_spin_unlock(&queue_lock, key);
+
+	for (uint8_t i = 0U; i < expired_count; i++) {
+		net_buf_unref(expired[i]);
+		k_sem_give(&q->space);
+	}
+}
+
+void tx_queue_rebind(struct bt_iso_chan **chans)
+{
+	k_spinlock_key_t key = k_spin_lock(&queue_lock);
+
+	for (uint8_t i = 0U; i < queue_count; i++) {
+		queues[i].chan = chans[i];
+		/* SDUs in flight on the old BIS are not reported to this queue */
+		queues[i].sent_rd = queues[i].sent_wr;
+	}
+
+	k_spin_unlock(&queue_lock, key);
+
+	for (uint8_t i = 0U; i < queue_count; i++) {
+		entries_expire(&queues[i]);
+	}
+}
+
+void tx_queue_stats_print(void)
+{
+	for (uint8_t i = 0U; i < queue_count; i++) {
+		struct tx_queue *q = &queues[i];
+
+		printk("TX queue %u: queued %u sent %u depth %u/%u max %u, "
+		       "dropped oldest %u newest %u expired %u, send errors %u\n",
+		       i, q->queued, q->sent, q->count, CONFIG_ISO_TX_QUEUE_DEPTH,
+		       q->count_max, q->dropped_oldest, q->dropped_newest,
+		       q->dropped_expired, q->send_err);
+	}
+	perf_stat_print("TX send to sent", &sent_stat);
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef TX_QUEUE_H_
+#define TX_QUEUE_H_
+
+#include <stdint.h>
+
+#include <zephyr/bluetooth/iso.h>
+#include <zephyr/net/buf.h>
+
+#include "tx_sched.h"
+
+/* SDUs of all BIS together that can be in the host and controller at the same
+ * time. The controller retransmits from the buffer it already holds, so this
+ * does not depend on the RTN. It is bounded by the host ISO TX buffers and, when
+ * the controller is built in, by its ISO TX buffers. With the controller on
+ * another core its buffers are only known at runtime, the host then waits for
+ * the HCI credits the controller returns.
+ */
+#if defined(CONFIG_BT_CTLR_ISO_TX_BUFFERS)
+#define TX_QUEUE_INFLIGHT MIN(CONFIG_BT_ISO_TX_BUF_COUNT, CONFIG_BT_CTLR_ISO_TX_BUFFERS)
+#else
+#define TX_QUEUE_INFLIGHT CONFIG_BT_ISO_TX_BUF_COUNT
+#endif /* CONFIG_BT_CTLR_ISO_TX_BUFFERS */
+
+/* Buffers needed to feed count BIS: a full queue plus the one SDU the producer
+ * holds while it is being queued per BIS, and the in-flight SDUs.
+ */
+#define TX_QUEUE_POOL_COUNT(count) \
+	((count) * (CONFIG_ISO_TX_QUEUE_DEPTH + 1) + TX_QUEUE_INFLIGHT)
+
+/* chans must stay valid. At most TX_QUEUE_INFLIGHT SDUs of all BIS are handed
+ * to the host before iso_sent returns their credit. interval_us is the SDU
+ * interval, the block policy never waits longer than that.
+ */
+void tx_queue_init(struct bt_iso_chan **chans, uint8_t count, uint32_t interval_us);
+
+/* Queue buf for BIS chan according to the configured full-queue policy. The
+ * queue owns buf afterwards, also when it is dropped. Returns 0 when buf was
+ * queued, -ENOBUFS when it was dropped. The block policy drains the queues
+ * while it waits, so this must be called from the context that sends.
+ */
+int tx_queue_put(uint8_t chan, struct net_buf *buf,
+		 const struct tx_sched_slot *slot);
+
+/* Hand queued SDUs to the host while it has credits. Only called from the
+ * context that sends: the ISO TX thread with CONFIG_ISO_TX_THREAD, the main
+ * loop otherwise.
+ */
+void tx_queue_drain(void);
+
+/* Called from the iso_sent callback, returns a TX credit. The SDUs it allows
+ * are sent by the next tx_queue_drain().
+ */
+void tx_queue_sent(struct bt_iso_chan *chan);
+
+/* Drop everything queued and restore all credits, e.g. after the BIG has
+ * been terminated.
+ */
+void tx_queue_reset(void);
+
+/* Send everything queued from now on on chans, in the same order as passed to
+ * tx_queue_init(). Used to move the stream to a new BIG. SDUs whose BIG anchor
+ * already passed are dropped and counted as expired, the others are sent
+ * without time stamp on the new BIG.
+ */
+void tx_queue_rebind(struct bt_iso_chan **chans);
+
+void tx_queue_stats_print(void);
+
+#endif /* TX_QUEUE_H_ */
@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/iso.h>
+#include <zephyr/sys/printk.h>
+
+#include "perf.h"
+#include "tx_sched.h"
+
+/* Outstanding SDUs on the reference BIS, matched against iso_sent */
+#define PENDING_SEQ_COUNT 16
+
+static struct bt_iso_chan *ref_chan;
+static uint32_t sdu_interval_us;
+static uint32_t sync_delay_us;
+
+/* Controller time stamp ref_ts belongs to sequence number ref_seq */
+static bool ref_valid;
+static uint16_t ref_seq;
+static uint32_t ref_ts;
+static uint32_t sdus_since_sync;
+
+/* Controller clock minus local clock (us) */
+static bool offset_valid;
+static volatile uint32_t clk_offset;
+
+static uint16_t next_seq;
+
+static uint16_t pending_seq[PENDING_SEQ_COUNT];
+static volatile uint32_t pending_wr;
+static volatile uint32_t pending_rd;
+
+static uint32_t sched_count;
+static uint32_t late_count;
+static uint32_t missed_count;
+static uint32_t expired_count;
+/* Time between handing an SDU to the host and its BIG anchor */
+static struct perf_stat lead_stat;
+
+static uint32_t local_us(void)
+{
+	return (uint32_t)k_ticks_to_us_floor64(k_uptime_ticks());
+}
+
+static uint32_t slot_ts(uint16_t seq_num)
+{
+	return ref_ts + (int16_t)(seq_num - ref_seq) * (int32_t)sdu_interval_us;
+}
+
+static void tx_sync_read(void)
+{
+	struct bt_iso_tx_info info;
+	int err;
+
+	err = bt_iso_chan_get_tx_sync(ref_chan, &info);
+	if (err) {
+		/* Nothing sent yet, or controller without TX sync support */
+		return;
+	}
+
+	ref_seq = info.seq_num;
+	ref_ts = info.ts;
+	ref_valid = true;
+	sdus_since_sync = 0U;
+}
+
+void tx_sched_start(struct bt_iso_chan *chan, uint32_t interval_us)
+{
+	struct bt_iso_info info;
+
+	ref_chan = chan;
+	sdu_interval_us = interval_us;
+	ref_valid = false;
+	offset_valid = false;
+	next_seq = 0U;
+	pending_wr = 0U;
+	pending_rd = 0U;
+
+	sync_delay_us = 0U;
+	if (!bt_iso_chan_get_info(chan, &info)) {
+		sync_delay_us = info.broadcaster.sync_delay;
+	}
+
+	if (!lead_stat.count) {
+		perf_stat_reset(&lead_stat);
+	}
+}
+
+void tx_sched_sent(struct bt_iso_chan *chan)
+{
+	uint32_t now = local_us();
+	uint32_t offset;
+	uint16_t seq_num;
+
+	if (chan != ref_chan || pending_rd == pending_wr) {
+		return;
+	}
+
+	seq_num = pending_seq[pending_rd % PENDING_SEQ_COUNT];
+	pending_rd++;
+
+	if (!ref_valid) {
+		return;
+	}
+
+	/* The SDU completes at the earliest sync_delay after its anchor, so this
+	 * is a lower bound of the clock offset. Keep the tightest bound, but
+	 * follow the clocks when they drift back by more than an interval.
+	 */
+	offset = slot_ts(seq_num) + sync_delay_us - now;
+	if (!offset_valid || (int32_t)(offset - clk_offset) > 0 ||
+	    (int32_t)(clk_offset - offset) > (int32_t)sdu_interval_us) {
+		clk_offset = offset;
+		offset_valid = true;
+	}
+}
+
+void tx_sched_wait(struct tx_sched_slot *slot)
+{
+	uint32_t target;
+	int32_t delta;
+
+	if (!ref_valid || sdus_since_sync >= CONFIG_ISO_TX_SCHED_RESYNC_INTERVAL) {
+		tx_sync_read();
+	}
+	sdus_since_sync++;
+
+	if (!ref_valid || !offset_valid) {
+		/* Not locked to the BIG yet, let the buffers pace the caller */
+		slot->seq_num = next_seq++;
+		slot->ts = 0U;
+		slot->anchor_us = 0U;
+		slot->timed = false;
+		return;
+	}
+
+	while (true) {
+		slot->seq_num = next_seq++;
+		slot->ts = slot_ts(slot->seq_num);
+		slot->anchor_us = slot->ts - clk_offset;
+		slot->timed = true;
+
+		if ((int32_t)(slot->anchor_us - local_us()) > 0) {
+			break;
+		}
+
+		/* Too late for this BIG event, the receivers see a lost SDU */
+		missed_count++;
+	}
+
+	target = slot->anchor_us - CONFIG_ISO_TX_SCHED_MARGIN_US;
+	delta = (int32_t)(target - local_us());
+	if (delta > 0) {
+		k_sleep(K_USEC(delta));
+	}
+}
+
+int tx_sched_send(struct bt_iso_chan *chan, struct net_buf *buf,
+		  const struct tx_sched_slot *slot)
+{
+	bool pending = false;
+	int err;
+
+	/* The SDU may have waited in the TX queue, check its deadline now */
+	if (slot->timed) {
+		int32_t lead = (int32_t)(slot->anchor_us - local_us());
+
+		if (lead <= 0) {
+			/* Past its BIG event, the receivers see a lost SDU */
+			expired_count++;
+			return -ETIMEDOUT;
+		}
+
+		if (lead < CONFIG_ISO_TX_SCHED_MARGIN_US) {
+			late_count++;
+		}
+
+		perf_stat_add(&lead_stat, (uint32_t)lead * NSEC_PER_USEC);
+	}
+
+	if (chan == ref_chan &&
+	    (pending_wr - pending_rd) < PENDING_SEQ_COUNT) {
+		pending_seq[pending_wr % PENDING_SEQ_COUNT] = slot->seq_num;
+		pending_wr++;
+		pending = true;
+	}
+
+	if (slot->timed) {
+		err = bt_iso_chan_send_ts(chan, buf, slot->seq_num, slot->ts);
+	} else {
+		err = bt_iso_chan_send(chan, buf, slot->seq_num);
+	}
+
+	/* No iso_sent follows, take back the entry pushed above, if any */
+	if (err < 0 && pending) {
+		pending_wr--;
+	}
+
+	return err;
+}
+
+void tx_sched_done(const struct tx_sched_slot *slot)
+{
+	if (slot->timed) {
+		sched_count++;
+	}
+}
+
+void tx_sched_stats_print(void)
+{
+	printk("TX sched: %s, offset %u us, %u timed, %u missed, "
+	       "SDUs %u late %u expired\n",
+	       offset_valid ? "locked" : "unlocked", clk_offset, sched_count,
+	       missed_count, late_count, expired_count);
+	perf_stat_print("TX sched lead before anchor", &lead_stat);
+}
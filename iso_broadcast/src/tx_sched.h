@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef TX_SCHED_H_
+#define TX_SCHED_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <zephyr/bluetooth/iso.h>
+
+/* The SDU to send on every BIS of the BIG in the next BIG event */
+struct tx_sched_slot {
+	uint16_t seq_num;
+	/* Controller time stamp of the SDU, only valid when timed is set */
+	uint32_t ts;
+	/* Local time (us) of the BIG anchor this SDU is scheduled for */
+	uint32_t anchor_us;
+	bool timed;
+};
+
+/* (Re)start scheduling after the BIG has been created. ref_chan is the BIS
+ * used to read the TX sync info from the controller.
+ */
+void tx_sched_start(struct bt_iso_chan *ref_chan, uint32_t interval_us);
+
+/* Sleep until the SDU for the next BIG event is due and return its slot.
+ * SDUs whose anchor already passed are skipped and counted as missed. Until
+ * the controller has reported TX sync info the slot is not timed and the
+ * caller is paced by its buffers only.
+ */
+void tx_sched_wait(struct tx_sched_slot *slot);
+
+/* Send buf on chan for the given slot, time-stamped when possible. A timed SDU
+ * sent within the margin is counted as late. One whose anchor already passed is
+ * not sent, counted as expired, and -ETIMEDOUT is returned; the caller still
+ * owns buf then, as on any error.
+ */
+int tx_sched_send(struct bt_iso_chan *chan, struct net_buf *buf,
+		  const struct tx_sched_slot *slot);
+
+/* Called from the iso_sent callback of every BIS */
+void tx_sched_sent(struct bt_iso_chan *chan);
+
+/* Called once all BIS have been given their SDU for the slot, counts the
+ * timed slots
+ */
+void tx_sched_done(const struct tx_sched_slot *slot);
+
+void tx_sched_stats_print(void);
+
+#endif /* TX_SCHED_H_ */
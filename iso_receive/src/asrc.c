@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/sys/util.h>
+
+#include "asrc.h"
+
+#define POS_FRAC_BITS 30
+/* Interpolation weight precision */
+#define WEIGHT_BITS   15
+
+void asrc_init(struct asrc *asrc, uint8_t chan_count)
+{
+	__ASSERT_NO_MSG(chan_count <= ASRC_CHAN_MAX);
+
+	asrc->chan_count = chan_count;
+	/* The first output sample is the first input sample */
+	asrc->pos = ASRC_RATIO_ONE;
+	memset(asrc->last, 0, sizeof(asrc->last));
+}
+
+size_t asrc_process(struct asrc *asrc, uint32_t ratio, const int16_t *in, size_t in_frames,
+		    int16_t *out, size_t out_max)
+{
+	const uint8_t chans = asrc->chan_count;
+	uint64_t pos = asrc->pos;
+	size_t out_frames = 0U;
+
+	if (!in_frames) {
+		return 0U;
+	}
+
+	/* Output sample k lies between input idx - 1 and idx, idx 0 pairs with
+	 * the last sample of the previous call
+	 */
+	while (out_frames < out_max) {
+		uint32_t idx = (uint32_t)(pos >> POS_FRAC_BITS);
+		int32_t w1;
+		int32_t w0;
+
+		if (idx >= in_frames) {
+			break;
+		}
+
+		w1 = (int32_t)((pos >> (POS_FRAC_BITS - WEIGHT_BITS)) & BIT_MASK(WEIGHT_BITS));
+		w0 = BIT(WEIGHT_BITS) - w1;
+
+		for (uint8_t c = 0U; c < chans; c++) {
+			int32_t x0 = idx ? in[(idx - 1U) * chans + c] : asrc->last[c];
+			int32_t x1 = in[idx * chans + c];
+
+			*out++ = (int16_t)((x0 * w0 + x1 * w1) >> WEIGHT_BITS);
+		}
+
+		out_frames++;
+		pos += ratio;
+	}
+
+	/* Skip input that did not fit in out */
+	pos = MAX(pos, (uint64_t)in_frames << POS_FRAC_BITS);
+	asrc->pos = (uint32_t)(pos - ((uint64_t)in_frames << POS_FRAC_BITS));
+	for (uint8_t c = 0U; c < chans; c++) {
+		asrc->last[c] = in[(in_frames - 1U) * chans + c];
+	}
+
+	return out_frames;
+}
+
+#if defined(CONFIG_ISO_ASRC_BENCH)
+#include "perf.h"
+
+#define BENCH_FRAMES     480
+#define BENCH_ITERATIONS 1000
+
+static int16_t bench_in[BENCH_FRAMES * ASRC_CHAN_MAX];
+/* Room for the output of the fastest ratio */
+static int16_t bench_out[(BENCH_FRAMES + BENCH_FRAMES / 8) * ASRC_CHAN_MAX];
+
+static const int32_t bench_ppm[] = { 0, 100, -100, 1000 };
+
+void asrc_bench(void)
+{
+	struct asrc asrc;
+
+	perf_init();
+
+	/* A triangle, the values do not matter for the timing */
+	for (size_t i = 0U; i < ARRAY_SIZE(bench_in); i++) {
+		bench_in[i] = (int16_t)((i % 256U) * 128U - 16384);
+	}
+
+	printk("ASRC benchmark, %u stereo frames x %u iterations\n", BENCH_FRAMES,
+	       BENCH_ITERATIONS);
+
+	for (size_t r = 0U; r < ARRAY_SIZE(bench_ppm); r++) {
+		uint32_t ratio = ASRC_RATIO_ONE +
+				 (int32_t)(((int64_t)ASRC_RATIO_ONE * bench_ppm[r]) / 1000000);
+		uint64_t samples = 0U;
+		perf_ts_t start;
+		uint32_t ns;
+
+		asrc_init(&asrc, ASRC_CHAN_MAX);
+
+		start = perf_now();
+		for (uint32_t iter = 0U; iter < BENCH_ITERATIONS; iter++) {
+			samples += asrc_process(&asrc, ratio, bench_in, BENCH_FRAMES, bench_out,
+						ARRAY_SIZE(bench_out) / ASRC_CHAN_MAX);
+		}
+		ns = perf_ns(start, perf_now());
+
+		samples *= ASRC_CHAN_MAX;
+#if defined(CONFIG_ARCH_POSIX)
+		printk("ratio %+d ppm: %u ns for %llu samples, %u ps per sample\n",
+		       bench_ppm[r], ns, samples, (uint32_t)((uint64_t)ns * 1000U / samples));
+#else
+		/* Core cycles, the timing API counts at the CPU clock */
+		printk("ratio %+d ppm: %u ns for %llu samples, %u.%02u cycles per sample\n",
+		       bench_ppm[r], ns, samples,
+		       (uint32_t)((uint64_t)ns * timing_freq_get_mhz() / 1000U / samples),
+		       (uint32_t)(((uint64_t)ns * timing_freq_get_mhz() / 10U / samples) % 100U));
+#endif /* CONFIG_ARCH_POSIX */
+	}
+}
+#endif /* CONFIG_ISO_ASRC_BENCH */
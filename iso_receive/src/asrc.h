@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef ASRC_H_
+#define ASRC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <zephyr/sys/util.h>
+
+/* Fixed-point fractional resampler for interleaved 16-bit PCM, linear
+ * interpolation between neighbouring input samples. The ratio is the number of
+ * input samples per output sample in Q30 and may be changed between calls,
+ * the position is carried over so the output stays continuous.
+ */
+
+#define ASRC_RATIO_ONE BIT(30)
+#define ASRC_CHAN_MAX  2
+
+struct asrc {
+	uint8_t chan_count;
+	/* Position of the next output sample in Q30 input samples, relative to
+	 * the last sample of the previous call (index -1)
+	 */
+	uint32_t pos;
+	int16_t last[ASRC_CHAN_MAX];
+};
+
+void asrc_init(struct asrc *asrc, uint8_t chan_count);
+
+/* Resample in_frames frames from in into at most out_max frames in out at the
+ * given ratio. Returns the number of frames written; input that does not fit
+ * in out is dropped.
+ */
+size_t asrc_process(struct asrc *asrc, uint32_t ratio, const int16_t *in, size_t in_frames,
+		    int16_t *out, size_t out_max);
+
+#if defined(CONFIG_ISO_ASRC_BENCH)
+/* Resample a tone at a few ratios and print the cost per output sample */
+void asrc_bench(void);
+#endif /* CONFIG_ISO_ASRC_BENCH */
+
+#endif /* ASRC_H_ */
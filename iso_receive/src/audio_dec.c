@@ -0,0 +1,544 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+
+#include <lc3.h>
+
+#include "audio_dec.h"
+#include "perf.h"
+#if defined(CONFIG_ISO_ASRC)
+#include "asrc.h"
+#include "drift.h"
+#endif /* CONFIG_ISO_ASRC */
+
+#define FRAME_PCM_SAMPLES (AUDIO_DEC_FRAME_SAMPLES * AUDIO_DEC_CHAN_COUNT)
+/* Largest LC3 frame, bounded by what the host can receive */
+#define SDU_LEN_MAX       MIN(CONFIG_BT_ISO_RX_MTU, 400)
+/* Frames queued between the RX context and the decoder thread */
+#define SLOT_COUNT        CONFIG_ISO_AUDIO_DEC_QUEUE_DEPTH
+#define STATS_PRINT_FRAMES 1000
+
+BUILD_ASSERT(IS_POWER_OF_TWO(SLOT_COUNT), "CONFIG_ISO_AUDIO_DEC_QUEUE_DEPTH must be a power of two");
+
+/* The SDUs of all channels for one sequence number */
+struct dec_slot {
+	uint16_t seq_num;
+	uint8_t present;
+	uint8_t valid;
+	uint16_t len[AUDIO_DEC_CHAN_COUNT];
+	uint16_t gain_start[AUDIO_DEC_CHAN_COUNT];
+	uint16_t gain_end[AUDIO_DEC_CHAN_COUNT];
+	uint8_t data[AUDIO_DEC_CHAN_COUNT][SDU_LEN_MAX];
+};
+
+static struct dec_slot slots[SLOT_COUNT];
+/* slots[wr] is being filled while assembling is set, slots[rd] up to wr are
+ * queued for the decoder thread
+ */
+static uint32_t slot_wr;
+static uint32_t slot_rd;
+static bool assembling;
+/* Set by audio_dec_start(), the decoder thread then skips the slots up to
+ * reset_wr and sets up the decoders again. Only that thread touches the
+ * decoders and advances slot_rd, so it is never interrupted halfway.
+ */
+static bool dec_reset;
+static uint32_t reset_wr;
+/* Channels received, the others repeat channel 0 */
+static uint8_t dec_count = AUDIO_DEC_CHAN_COUNT;
+static struct k_spinlock slot_lock;
+static K_SEM_DEFINE(slot_sem, 0, SLOT_COUNT);
+
+static lc3_decoder_mem_48k_t lc3_dec_mem[AUDIO_DEC_CHAN_COUNT];
+static lc3_decoder_t lc3_dec[AUDIO_DEC_CHAN_COUNT];
+
+/* Interleaved PCM output, one buffer is being filled while the other is played
+ * (by I2S DMA on hardware)
+ */
+static int16_t pcm_out[2][FRAME_PCM_SAMPLES];
+static uint8_t pcm_out_idx;
+
+/* Time to decode one frame for all channels */
+static struct perf_stat frame_stat;
+static uint32_t frame_count;
+static uint32_t deadline_miss_count;
+static uint32_t plc_count;
+static uint32_t dropped_count;
+
+#if defined(CONFIG_ISO_ASRC)
+/* PCM frames (one sample per channel) buffered between the decoder, which
+ * runs on the SDU clock of the broadcaster, and the output, which runs on the
+ * local audio clock. The ASRC keeps the level around the target.
+ */
+#define RING_FRAMES   (CONFIG_ISO_ASRC_RING_BLOCKS * AUDIO_DEC_FRAME_SAMPLES)
+#define RING_TARGET   (RING_FRAMES / 2)
+/* Ratio correction per PCM frame the level is off target, and in total */
+#define LEVEL_GAIN_PPB 1000
+#define ASRC_PPB_MAX   1000000
+/* The ASRC output of one frame, up to 1/8 longer than its input */
+#define ASRC_OUT_FRAMES (AUDIO_DEC_FRAME_SAMPLES + AUDIO_DEC_FRAME_SAMPLES / 8)
+
+static int16_t pcm_dec[FRAME_PCM_SAMPLES];
+static int16_t pcm_asrc[ASRC_OUT_FRAMES * AUDIO_DEC_CHAN_COUNT];
+static int16_t ring[RING_FRAMES * AUDIO_DEC_CHAN_COUNT];
+static uint32_t ring_wr;
+static uint32_t ring_rd;
+static bool ring_started;
+static struct k_spinlock ring_lock;
+
+static struct asrc asrc;
+static int32_t asrc_ppb;
+static uint32_t underrun_count;
+static uint32_t overrun_count;
+
+/* Local audio clock, stands in for the I2S frame clock */
+static K_TIMER_DEFINE(out_timer, NULL, NULL);
+#endif /* CONFIG_ISO_ASRC */
+
+#if defined(CONFIG_ISO_AUDIO_SINK_FILE)
+#include <fcntl.h>
+
+#include <nsi_host_trampolines.h>
+#include <cmdline.h>
+#include <posix_native_task.h>
+
+static const char *pcm_out_path = CONFIG_ISO_AUDIO_OUT_PATH;
+static int pcm_out_fd = -1;
+static uint32_t sink_err_count;
+/* Little-endian copy of the frame, too large for the decoder thread stack */
+static int16_t pcm_le[FRAME_PCM_SAMPLES];
+
+static void pcm_out_options(void)
+{
+	static struct args_struct_t pcm_out_opts[] = {
+		{
+			.option = "pcm-out",
+			.name = "path",
+			.type = 's',
+			.dest = (void *)&pcm_out_path,
+			.descript = "File or named pipe receiving the decoded raw "
+				    "S16LE stereo PCM",
+		},
+		ARG_TABLE_ENDMARKER,
+	};
+
+	native_add_command_line_opts(pcm_out_opts);
+}
+NATIVE_TASK(pcm_out_options, PRE_BOOT_1, 1);
+
+static int pcm_sink_init(void)
+{
+	pcm_out_fd = nsi_host_open(pcm_out_path, O_WRONLY | O_CREAT | O_TRUNC);
+	if (pcm_out_fd < 0) {
+		printk("Unable to open PCM output %s\n", pcm_out_path);
+		return -ENOENT;
+	}
+
+	return 0;
+}
+
+static void pcm_sink_write(const int16_t *pcm)
+{
+	const uint8_t *src = (const uint8_t *)pcm_le;
+	size_t len = sizeof(pcm_le);
+
+	for (size_t i = 0U; i < FRAME_PCM_SAMPLES; i++) {
+		pcm_le[i] = sys_cpu_to_le16(pcm[i]);
+	}
+
+	while (len > 0) {
+		long ret = nsi_host_write(pcm_out_fd, src, len);
+
+		if (ret <= 0) {
+			sink_err_count++;
+			return;
+		}
+
+		src += ret;
+		len -= ret;
+	}
+}
+#else
+static int pcm_sink_init(void)
+{
+	return 0;
+}
+
+/* The finished buffer is where an I2S TX DMA would pick it up, it is not
+ * touched again until the other buffer has been decoded.
+ */
+static void pcm_sink_write(const int16_t *pcm)
+{
+	ARG_UNUSED(pcm);
+}
+#endif /* CONFIG_ISO_AUDIO_SINK_FILE */
+
+static int decoders_setup(void)
+{
+	for (uint8_t chan = 0U; chan < AUDIO_DEC_CHAN_COUNT; chan++) {
+		lc3_dec[chan] = lc3_setup_decoder(CONFIG_ISO_AUDIO_FRAME_DURATION_US,
+						  CONFIG_ISO_AUDIO_SAMPLE_RATE_HZ, 0,
+						  &lc3_dec_mem[chan]);
+		if (lc3_dec[chan] == NULL) {
+			printk("Failed to setup LC3 decoder %u\n", chan);
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+int audio_dec_init(void)
+{
+	int err;
+
+	perf_init();
+	perf_stat_reset(&frame_stat);
+
+	err = decoders_setup();
+	if (err) {
+		return err;
+	}
+
+	err = pcm_sink_init();
+	if (err) {
+		return err;
+	}
+
+	printk("LC3 decoder: %u us frames, %u Hz, %u channels\n",
+	       CONFIG_ISO_AUDIO_FRAME_DURATION_US, CONFIG_ISO_AUDIO_SAMPLE_RATE_HZ,
+	       AUDIO_DEC_CHAN_COUNT);
+
+	return 0;
+}
+
+void audio_dec_start(uint8_t count)
+{
+	k_spinlock_key_t key = k_spin_lock(&slot_lock);
+
+	dec_count = CLAMP(count, 1U, AUDIO_DEC_CHAN_COUNT);
+	assembling = false;
+	/* The PLC history of the previous stream is forgotten by the decoder
+	 * thread before it decodes the first new frame
+	 */
+	reset_wr = slot_wr;
+	dec_reset = true;
+	k_sem_reset(&slot_sem);
+
+	k_spin_unlock(&slot_lock, key);
+
+#if defined(CONFIG_ISO_ASRC)
+	key = k_spin_lock(&ring_lock);
+	ring_rd = ring_wr;
+	ring_started = false;
+	k_spin_unlock(&ring_lock, key);
+
+	k_timer_start(&out_timer, K_USEC(CONFIG_ISO_AUDIO_FRAME_DURATION_US),
+		      K_USEC(CONFIG_ISO_AUDIO_FRAME_DURATION_US));
+#endif /* CONFIG_ISO_ASRC */
+}
+
+/* Hand the slot being filled to the decoder thread, lock held */
+static void slot_commit(void)
+{
+	slot_wr++;
+	assembling = false;
+	k_sem_give(&slot_sem);
+}
+
+void audio_dec_put(uint8_t chan, uint16_t seq_num, bool valid, const uint8_t *data,
+		   uint16_t len, uint16_t gain_start, uint16_t gain_end)
+{
+	k_spinlock_key_t key;
+	struct dec_slot *slot;
+
+	if (chan >= dec_count) {
+		return;
+	}
+
+	key = k_spin_lock(&slot_lock);
+
+	slot = &slots[slot_wr % SLOT_COUNT];
+
+	/* A newer SDU completes the frame, missing channels are concealed */
+	if (assembling && slot->seq_num != seq_num) {
+		slot_commit();
+		slot = &slots[slot_wr % SLOT_COUNT];
+	}
+
+	if (!assembling) {
+		/* Slots from before a reset are free already */
+		if (slot_wr - (dec_reset ? reset_wr : slot_rd) >= SLOT_COUNT) {
+			/* Decoder behind */
+			dropped_count++;
+			k_spin_unlock(&slot_lock, key);
+			return;
+		}
+
+		slot->seq_num = seq_num;
+		slot->present = 0U;
+		slot->valid = 0U;
+		for (uint8_t i = 0U; i < AUDIO_DEC_CHAN_COUNT; i++) {
+			slot->gain_start[i] = AUDIO_DEC_GAIN_ONE;
+			slot->gain_end[i] = AUDIO_DEC_GAIN_ONE;
+		}
+		assembling = true;
+	}
+
+	slot->present |= BIT(chan);
+	slot->gain_start[chan] = gain_start;
+	slot->gain_end[chan] = gain_end;
+	if (valid && len > 0U && len <= SDU_LEN_MAX) {
+		memcpy(slot->data[chan], data, len);
+		slot->len[chan] = len;
+		slot->valid |= BIT(chan);
+	}
+
+	if (slot->present == BIT_MASK(dec_count)) {
+		slot_commit();
+	}
+
+	k_spin_unlock(&slot_lock, key);
+}
+
+/* Scale channel chan of an interleaved frame by a linear gain ramp */
+static void gain_ramp(int16_t *pcm, uint8_t chan, uint16_t start, uint16_t end)
+{
+	int32_t step = (int32_t)end - (int32_t)start;
+
+	if (start == AUDIO_DEC_GAIN_ONE && end == AUDIO_DEC_GAIN_ONE) {
+		return;
+	}
+
+	for (size_t i = 0U; i < AUDIO_DEC_FRAME_SAMPLES; i++) {
+		int32_t gain = start + step * (int32_t)(i + 1U) / AUDIO_DEC_FRAME_SAMPLES;
+		int16_t *sample = &pcm[i * AUDIO_DEC_CHAN_COUNT + chan];
+
+		*sample = (int16_t)((*sample * gain) >> 15);
+	}
+}
+
+static void frame_decode(const struct dec_slot *slot, int16_t *pcm)
+{
+	for (uint8_t chan = 0U; chan < dec_count; chan++) {
+		bool valid = (slot->valid & BIT(chan)) != 0U;
+		int err;
+
+		/* A NULL frame runs the packet loss concealment of the decoder */
+		err = lc3_decode(lc3_dec[chan], valid ? slot->data[chan] : NULL,
+				 valid ? slot->len[chan] : 0, LC3_PCM_FORMAT_S16,
+				 &pcm[chan], AUDIO_DEC_CHAN_COUNT);
+		if (!valid || err) {
+			plc_count++;
+		}
+
+		gain_ramp(pcm, chan, slot->gain_start[chan], slot->gain_end[chan]);
+	}
+
+	/* A single BIS is played on all output channels */
+	for (uint8_t chan = dec_count; chan < AUDIO_DEC_CHAN_COUNT; chan++) {
+		for (size_t i = 0U; i < AUDIO_DEC_FRAME_SAMPLES; i++) {
+			pcm[i * AUDIO_DEC_CHAN_COUNT + chan] = pcm[i * AUDIO_DEC_CHAN_COUNT];
+		}
+	}
+}
+
+#if defined(CONFIG_ISO_ASRC)
+static uint32_t ring_level(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&ring_lock);
+	uint32_t level = ring_wr - ring_rd;
+
+	k_spin_unlock(&ring_lock, key);
+
+	return level;
+}
+
+/* Resample the decoded frame to the local audio clock and queue it for the
+ * output. The drift estimate sets the ratio, the ring level trims it so the
+ * ring neither runs empty nor fills up.
+ */
+static void frame_resample(const int16_t *pcm)
+{
+	int32_t level_err = (int32_t)ring_level() - RING_TARGET;
+	k_spinlock_key_t key;
+	uint32_t ratio;
+	size_t frames;
+
+	asrc_ppb = CLAMP(level_err * LEVEL_GAIN_PPB - drift_ppb(), -ASRC_PPB_MAX,
+			 ASRC_PPB_MAX);
+	ratio = ASRC_RATIO_ONE + (int32_t)(((int64_t)ASRC_RATIO_ONE * asrc_ppb) /
+					   (int64_t)NSEC_PER_SEC);
+
+	frames = asrc_process(&asrc, ratio, pcm, AUDIO_DEC_FRAME_SAMPLES, pcm_asrc,
+			      ASRC_OUT_FRAMES);
+
+	key = k_spin_lock(&ring_lock);
+
+	for (size_t i = 0U; i < frames; i++) {
+		if (ring_wr - ring_rd >= RING_FRAMES) {
+			overrun_count++;
+			break;
+		}
+
+		memcpy(&ring[(ring_wr % RING_FRAMES) * AUDIO_DEC_CHAN_COUNT],
+		       &pcm_asrc[i * AUDIO_DEC_CHAN_COUNT], sizeof(int16_t) * AUDIO_DEC_CHAN_COUNT);
+		ring_wr++;
+	}
+
+	k_spin_unlock(&ring_lock, key);
+}
+
+/* Takes one frame from the ring every frame duration of the local clock */
+static void audio_out_thread(void *p1, void *p2, void *p3)
+{
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	while (true) {
+		int16_t *pcm = pcm_out[pcm_out_idx];
+		k_spinlock_key_t key;
+		size_t i;
+
+		k_timer_status_sync(&out_timer);
+
+		key = k_spin_lock(&ring_lock);
+
+		/* Prefill to the target before the output starts */
+		if (!ring_started && ring_wr - ring_rd >= RING_TARGET) {
+			ring_started = true;
+		}
+
+		for (i = 0U; ring_started && i < AUDIO_DEC_FRAME_SAMPLES &&
+			     ring_rd != ring_wr; i++) {
+			memcpy(&pcm[i * AUDIO_DEC_CHAN_COUNT],
+			       &ring[(ring_rd % RING_FRAMES) * AUDIO_DEC_CHAN_COUNT],
+			       sizeof(int16_t) * AUDIO_DEC_CHAN_COUNT);
+			ring_rd++;
+		}
+
+		if (ring_started && i < AUDIO_DEC_FRAME_SAMPLES) {
+			underrun_count++;
+		}
+
+		k_spin_unlock(&ring_lock, key);
+
+		memset(&pcm[i * AUDIO_DEC_CHAN_COUNT], 0,
+		       sizeof(int16_t) * AUDIO_DEC_CHAN_COUNT * (AUDIO_DEC_FRAME_SAMPLES - i));
+
+		pcm_sink_write(pcm);
+		pcm_out_idx ^= 1U;
+	}
+}
+
+K_THREAD_DEFINE(audio_out_tid, CONFIG_ISO_ASRC_OUT_THREAD_STACK_SIZE, audio_out_thread,
+		NULL, NULL, NULL, K_PRIO_COOP(CONFIG_ISO_AUDIO_DEC_THREAD_PRIO), 0, 0);
+#endif /* CONFIG_ISO_ASRC */
+
+static void audio_dec_thread(void *p1, void *p2, void *p3)
+{
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	while (true) {
+#if defined(CONFIG_ISO_ASRC)
+		int16_t *pcm = pcm_dec;
+#else
+		int16_t *pcm = pcm_out[pcm_out_idx];
+#endif /* CONFIG_ISO_ASRC */
+		k_spinlock_key_t key;
+		perf_ts_t start;
+		bool reset;
+		bool empty;
+		uint32_t ns;
+
+		k_sem_take(&slot_sem, K_FOREVER);
+
+		key = k_spin_lock(&slot_lock);
+		reset = dec_reset;
+		if (reset) {
+			slot_rd = reset_wr;
+			dec_reset = false;
+		}
+		empty = (slot_rd == slot_wr);
+		k_spin_unlock(&slot_lock, key);
+
+		if (reset) {
+			/* Forget the PLC history of the previous stream */
+			(void)decoders_setup();
+#if defined(CONFIG_ISO_ASRC)
+			asrc_init(&asrc, AUDIO_DEC_CHAN_COUNT);
+#endif /* CONFIG_ISO_ASRC */
+		}
+
+		if (empty) {
+			continue;
+		}
+
+		start = perf_now();
+
+		/* Only this thread advances slot_rd, the slot stays valid until then */
+		frame_decode(&slots[slot_rd % SLOT_COUNT], pcm);
+
+		ns = perf_ns(start, perf_now());
+		perf_stat_add(&frame_stat, ns);
+		frame_count++;
+
+		/* All channels must be decoded within one frame duration */
+		if (ns > (CONFIG_ISO_AUDIO_FRAME_DURATION_US * NSEC_PER_USEC)) {
+			deadline_miss_count++;
+		}
+
+		key = k_spin_lock(&slot_lock);
+		slot_rd++;
+		k_spin_unlock(&slot_lock, key);
+
+#if defined(CONFIG_ISO_ASRC)
+		frame_resample(pcm);
+#else
+		pcm_sink_write(pcm);
+		pcm_out_idx ^= 1U;
+#endif /* CONFIG_ISO_ASRC */
+
+		if ((frame_count % STATS_PRINT_FRAMES) == 0U) {
+			audio_dec_stats_print();
+		}
+	}
+}
+
+K_THREAD_DEFINE(audio_dec_tid, CONFIG_ISO_AUDIO_DEC_THREAD_STACK_SIZE, audio_dec_thread,
+		NULL, NULL, NULL, K_PRIO_COOP(CONFIG_ISO_AUDIO_DEC_THREAD_PRIO), 0, 0);
+
+void audio_dec_stats_print(void)
+{
+	uint32_t avg_ns = perf_stat_avg(&frame_stat);
+
+	perf_stat_print("LC3 frame decode", &frame_stat);
+	/* Share of the app core the decoder takes, in 0.1 % */
+	printk("LC3 decode load %u.%u%%, deadline misses %u of %u frames, "
+	       "concealed %u, dropped %u\n",
+	       avg_ns / (CONFIG_ISO_AUDIO_FRAME_DURATION_US * 10U),
+	       (avg_ns / CONFIG_ISO_AUDIO_FRAME_DURATION_US) % 10U,
+	       deadline_miss_count, frame_count, plc_count, dropped_count);
+#if defined(CONFIG_ISO_ASRC)
+	printk("ASRC %d ppb, ring %u/%u frames, underruns %u overruns %u\n", asrc_ppb,
+	       ring_level(), RING_FRAMES, underrun_count, overrun_count);
+	drift_print();
+#endif /* CONFIG_ISO_ASRC */
+#if defined(CONFIG_ISO_AUDIO_SINK_FILE)
+	if (sink_err_count) {
+		printk("PCM output write errors %u\n", sink_err_count);
+	}
+#endif /* CONFIG_ISO_AUDIO_SINK_FILE */
+}
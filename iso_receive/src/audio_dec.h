@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef AUDIO_DEC_H_
+#define AUDIO_DEC_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Number of decoded channels, BIS n is PCM channel n (left, right) */
+#define AUDIO_DEC_CHAN_COUNT 2
+
+#define AUDIO_DEC_FRAME_SAMPLES ((CONFIG_ISO_AUDIO_SAMPLE_RATE_HZ / 100) * \
+				 CONFIG_ISO_AUDIO_FRAME_DURATION_US / 10000)
+
+/* Unity gain, Q15 as the jitter buffer fade ramp */
+#define AUDIO_DEC_GAIN_ONE 0x8000U
+
+/* Set up the LC3 decoders and the PCM sink. Returns 0 or negative errno. */
+int audio_dec_init(void);
+
+/* Drop everything queued and restart the decoders, e.g. after a new BIG sync
+ * of count BIS. With fewer BIS than output channels channel 0 is repeated.
+ * The decoders are set up again by the decoder thread before the next frame,
+ * so this may be called while it is decoding.
+ */
+void audio_dec_start(uint8_t count);
+
+/* Queue the SDU of BIS chan for decoding, may be called from the Bluetooth RX
+ * context. The SDUs of all channels with the same seq_num make up one frame,
+ * a channel that is not valid is concealed by the decoder. data is copied.
+ * The decoded samples are scaled by a gain going linearly from gain_start to
+ * gain_end over the frame, AUDIO_DEC_GAIN_ONE for both leaves them untouched.
+ */
+void audio_dec_put(uint8_t chan, uint16_t seq_num, bool valid, const uint8_t *data,
+		   uint16_t len, uint16_t gain_start, uint16_t gain_end);
+
+void audio_dec_stats_print(void);
+
+#endif /* AUDIO_DEC_H_ */
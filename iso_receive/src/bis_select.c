@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/iso.h>
+#include <zephyr/bluetooth/uuid.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/printk.h>
+
+#include "bis_select.h"
+
+/* BIS indexes are 1 to 31 */
+#define BIS_INDEX_MAX 31
+#define MSE_MAX       0x1F
+
+/* LTV types of the BAP codec configuration and metadata */
+#define LTV_CHAN_ALLOCATION 0x03
+#define LTV_LANGUAGE        0x04
+#define LANGUAGE_LEN        3
+
+struct base_bis {
+	bool present;
+	uint32_t location;
+	char language[LANGUAGE_LEN];
+};
+
+static struct base_bis base_bis[BIS_INDEX_MAX + 1];
+static bool base_valid;
+static struct k_spinlock base_lock;
+
+BUILD_ASSERT(sizeof(CONFIG_ISO_BIS_SELECT_LANGUAGE) - 1 == 0 ||
+	     sizeof(CONFIG_ISO_BIS_SELECT_LANGUAGE) - 1 == LANGUAGE_LEN,
+	     "CONFIG_ISO_BIS_SELECT_LANGUAGE must be an ISO 639-3 code");
+
+/* Walk the LTV structures in data and pick out the audio location and
+ * language, both are left as they are when absent.
+ */
+static void ltv_parse(const uint8_t *data, uint8_t len, uint32_t *location, char *language)
+{
+	while (len > 1U) {
+		uint8_t ltv_len = data[0];
+
+		if (!ltv_len || ltv_len >= len) {
+			return;
+		}
+
+		if (data[1] == LTV_CHAN_ALLOCATION && ltv_len == 1U + sizeof(uint32_t) && location) {
+			*location = sys_get_le32(&data[2]);
+		} else if (data[1] == LTV_LANGUAGE && ltv_len == 1U + LANGUAGE_LEN && language) {
+			memcpy(language, &data[2], LANGUAGE_LEN);
+		}
+
+		data += ltv_len + 1U;
+		len -= ltv_len + 1U;
+	}
+}
+
+/* Parse the BASE after its UUID, returns false when it is malformed */
+static bool base_parse(struct net_buf_simple *base)
+{
+	uint8_t subgroups;
+
+	if (base->len < 4U) {
+		return false;
+	}
+
+	(void)net_buf_simple_pull_le24(base); /* presentation delay */
+	subgroups = net_buf_simple_pull_u8(base);
+
+	while (subgroups--) {
+		uint32_t location = 0U;
+		char language[LANGUAGE_LEN] = { 0 };
+		uint8_t bis_count;
+		uint8_t len;
+
+		if (base->len < 1U + 5U + 1U) {
+			return false;
+		}
+
+		bis_count = net_buf_simple_pull_u8(base);
+		(void)net_buf_simple_pull_mem(base, 5U); /* codec ID */
+
+		len = net_buf_simple_pull_u8(base);
+		if (base->len < len + 1U) {
+			return false;
+		}
+		ltv_parse(net_buf_simple_pull_mem(base, len), len, &location, NULL);
+
+		len = net_buf_simple_pull_u8(base);
+		if (base->len < len) {
+			return false;
+		}
+		ltv_parse(net_buf_simple_pull_mem(base, len), len, NULL, language);
+
+		while (bis_count--) {
+			struct base_bis *bis;
+			uint8_t index;
+
+			if (base->len < 2U) {
+				return false;
+			}
+
+			index = net_buf_simple_pull_u8(base);
+			len = net_buf_simple_pull_u8(base);
+			if (index == 0U || index > BIS_INDEX_MAX || base->len < len) {
+				return false;
+			}
+
+			bis = &base_bis[index];
+			bis->present = true;
+			bis->location = location;
+			memcpy(bis->language, language, LANGUAGE_LEN);
+			/* The BIS level configuration overrides the subgroup */
+			ltv_parse(net_buf_simple_pull_mem(base, len), len, &bis->location, NULL);
+		}
+	}
+
+	return true;
+}
+
+void bis_select_base_reset(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&base_lock);
+
+	base_valid = false;
+	memset(base_bis, 0, sizeof(base_bis));
+
+	k_spin_unlock(&base_lock, key);
+}
+
+void bis_select_base_parse(const struct net_buf_simple *ad)
+{
+	struct net_buf_simple buf;
+	k_spinlock_key_t key;
+
+	if (base_valid) {
+		return;
+	}
+
+	net_buf_simple_init_with_data(&buf, ad->data, ad->len);
+
+	key = k_spin_lock(&base_lock);
+
+	while (buf.len > 1U && !base_valid) {
+		uint8_t len = net_buf_simple_pull_u8(&buf);
+		struct net_buf_simple base;
+		uint8_t type;
+
+		if (!len || len > buf.len) {
+			break;
+		}
+
+		type = net_buf_simple_pull_u8(&buf);
+		net_buf_simple_init_with_data(&base, net_buf_simple_pull_mem(&buf, len - 1U),
+					      len - 1U);
+
+		if (type != BT_DATA_SVC_DATA16 || base.len < BT_UUID_SIZE_16 ||
+		    net_buf_simple_pull_le16(&base) != BT_UUID_BASIC_AUDIO_VAL) {
+			continue;
+		}
+
+		if (base_parse(&base)) {
+			base_valid = true;
+		} else {
+			memset(base_bis, 0, sizeof(base_bis));
+		}
+	}
+
+	k_spin_unlock(&base_lock, key);
+}
+
+static bool bis_wanted(const struct base_bis *bis)
+{
+	const char *language = CONFIG_ISO_BIS_SELECT_LANGUAGE;
+
+	if (!bis->present) {
+		return false;
+	}
+
+	/* Location 0 is mono, it goes with every channel */
+	if (CONFIG_ISO_BIS_SELECT_LOCATION && bis->location &&
+	    !(bis->location & CONFIG_ISO_BIS_SELECT_LOCATION)) {
+		return false;
+	}
+
+	return !language[0] || !memcmp(bis->language, language, LANGUAGE_LEN);
+}
+
+int bis_select(const struct bis_select_big *big, uint8_t chan_max, struct bis_select *sel)
+{
+	k_spinlock_key_t key;
+	uint8_t count_max;
+
+	if (big->max_sdu > CONFIG_BT_ISO_RX_MTU) {
+		return -EMSGSIZE;
+	}
+
+	count_max = MIN(chan_max, CONFIG_ISO_BIS_SELECT_MAX);
+	sel->count = 0U;
+	sel->bitfield = 0U;
+
+	key = k_spin_lock(&base_lock);
+
+	for (uint8_t index = 1U; index <= big->num_bis && sel->count < count_max; index++) {
+		if (base_valid && !bis_wanted(&base_bis[index])) {
+			continue;
+		}
+
+		/* Without a BASE the first BIS are taken */
+		sel->bitfield |= BIT(index - 1U);
+		sel->count++;
+	}
+
+	k_spin_unlock(&base_lock, key);
+
+	if (!sel->count) {
+		return -ENOENT;
+	}
+
+	/* Listen to only the first repetitions of every PDU, bounded by the IRC
+	 * of the BIG. Each repetition left out is a retransmission a lost PDU
+	 * can no longer be recovered from. When the BIG has no more repetitions
+	 * than configured, all subevents are listened to.
+	 */
+	if (CONFIG_ISO_BIS_SELECT_MSE_REPETITIONS && big->bn && big->nse &&
+	    CONFIG_ISO_BIS_SELECT_MSE_REPETITIONS < big->irc) {
+		sel->mse = CLAMP(big->bn * CONFIG_ISO_BIS_SELECT_MSE_REPETITIONS, 1,
+				 MIN(big->nse, MSE_MAX));
+	} else {
+		sel->mse = BT_ISO_SYNC_MSE_ANY;
+	}
+
+	printk("BIS selected 0x%08x, %u of %u BIS%s, MSE %u of %u subevents\n",
+	       sel->bitfield, sel->count, big->num_bis, base_valid ? " (BASE)" : "",
+	       sel->mse == BT_ISO_SYNC_MSE_ANY ? big->nse : sel->mse, big->nse);
+
+	return 0;
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef BIS_SELECT_H_
+#define BIS_SELECT_H_
+
+#include <stdint.h>
+
+#include <zephyr/net/buf.h>
+
+/* Picks the BIS to sync to from the BIGInfo and, when the periodic
+ * advertising carries one, the BASE (Basic Audio Announcement) with the audio
+ * location and language of every BIS. Only the BIS that are needed are synced
+ * to and the controller is told to listen to as few subevents as possible, to
+ * save radio time and host RX load.
+ */
+
+/* The BIGInfo fields the selection depends on */
+struct bis_select_big {
+	uint8_t num_bis;
+	uint8_t nse;
+	uint8_t bn;
+	/* Immediate repetition count, transmissions of every PDU */
+	uint8_t irc;
+	uint16_t max_sdu;
+};
+
+struct bis_select {
+	uint8_t count;
+	/* bis_bitfield of the BIG sync, bit n - 1 for BIS index n */
+	uint32_t bitfield;
+	uint8_t mse;
+};
+
+/* Forget the BASE, e.g. before syncing to another periodic advertiser */
+void bis_select_base_reset(void);
+
+/* Look for a BASE in the periodic advertising data, may be called from the
+ * Bluetooth RX context. Stops parsing once a BASE has been found.
+ */
+void bis_select_base_parse(const struct net_buf_simple *ad);
+
+/* Select at most chan_max BIS. Returns 0, -ENOENT when no BIS matches the
+ * filter or -EMSGSIZE when the SDUs do not fit CONFIG_BT_ISO_RX_MTU.
+ */
+int bis_select(const struct bis_select_big *big, uint8_t chan_max, struct bis_select *sel);
+
+#endif /* BIS_SELECT_H_ */
@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdlib.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/printk.h>
+
+#include "drift.h"
+
+#define WINDOW_US  (CONFIG_ISO_DRIFT_WINDOW_MS * USEC_PER_MSEC)
+/* New slopes weigh 1/2^FILTER_SHIFT */
+#define FILTER_SHIFT 3
+/* Slopes beyond this are a clock jump or a new stream, not drift */
+#define DRIFT_PPB_MAX 1000000
+
+/* Only written from the ISO recv callback of the reference BIS */
+static uint32_t interval_us;
+static bool first_valid;
+static uint16_t last_seq;
+static uint32_t remote_us;
+static uint32_t base_offset;
+static bool window_valid;
+static uint32_t window_start;
+static uint32_t window_min_at;
+static int32_t window_min;
+static bool prev_valid;
+static uint32_t prev_min_at;
+static int32_t prev_min;
+static uint32_t window_count;
+static uint32_t reject_count;
+
+/* Filtered estimate, read from other threads */
+static atomic_t estimate_ppb;
+
+void drift_reset(uint32_t sdu_interval_us)
+{
+	interval_us = sdu_interval_us;
+	first_valid = false;
+	window_valid = false;
+	prev_valid = false;
+	window_count = 0U;
+	atomic_set(&estimate_ppb, 0);
+}
+
+static void window_add(int32_t offset)
+{
+	int64_t slope;
+	int32_t est;
+
+	if (!window_valid) {
+		window_valid = true;
+		window_start = remote_us;
+		window_min_at = remote_us;
+		window_min = offset;
+		return;
+	}
+
+	if (offset < window_min) {
+		window_min = offset;
+		window_min_at = remote_us;
+	}
+
+	if ((remote_us - window_start) < WINDOW_US) {
+		return;
+	}
+
+	/* Window complete, the slope runs between the minima of two windows */
+	if (prev_valid && window_min_at != prev_min_at) {
+		slope = ((int64_t)(window_min - prev_min) * NSEC_PER_SEC) /
+			(int32_t)(window_min_at - prev_min_at);
+
+		if (slope > DRIFT_PPB_MAX || slope < -DRIFT_PPB_MAX) {
+			reject_count++;
+		} else {
+			est = (int32_t)atomic_get(&estimate_ppb);
+			if (window_count == 1U) {
+				est = (int32_t)slope;
+			} else {
+				est += ((int32_t)slope - est) >> FILTER_SHIFT;
+			}
+			atomic_set(&estimate_ppb, est);
+			window_count++;
+		}
+	} else {
+		window_count = 1U;
+	}
+
+	prev_valid = true;
+	prev_min_at = window_min_at;
+	prev_min = window_min;
+
+	window_start = remote_us;
+	window_min_at = remote_us;
+	window_min = offset;
+}
+
+void drift_update(const struct bt_iso_recv_info *info)
+{
+	if ((info->flags & (BT_ISO_FLAGS_VALID | BT_ISO_FLAGS_TS)) !=
+	    (BT_ISO_FLAGS_VALID | BT_ISO_FLAGS_TS) || !interval_us) {
+		return;
+	}
+
+	/* Lost SDUs still count, the sequence number wraps at 16 bits */
+	if (!first_valid) {
+		first_valid = true;
+		remote_us = 0U;
+		base_offset = info->ts;
+	} else {
+		remote_us += (uint16_t)(info->seq_num - last_seq) * interval_us;
+	}
+	last_seq = info->seq_num;
+
+	/* Relative to the first SDU so the offset stays far from the wrap */
+	window_add((int32_t)(info->ts - remote_us - base_offset));
+}
+
+int32_t drift_ppb(void)
+{
+	return (int32_t)atomic_get(&estimate_ppb);
+}
+
+void drift_print(void)
+{
+	int32_t ppb = drift_ppb();
+
+	printk("Clock drift %s%d.%03d ppm over %u windows, %u rejected\n",
+	       ppb < 0 ? "-" : "", abs(ppb) / 1000, abs(ppb) % 1000,
+	       window_count, reject_count);
+}
@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef DRIFT_H_
+#define DRIFT_H_
+
+#include <stdint.h>
+
+#include <zephyr/bluetooth/iso.h>
+
+/* Estimates how fast the local clock runs against the SDU clock of the
+ * broadcaster. The remote time of an SDU is its sequence number times the SDU
+ * interval, the local time is its time stamp from the controller. Per window
+ * the smallest difference between the two is kept, which filters out the
+ * jitter of the radio and host, and the slope between windows is low-pass
+ * filtered.
+ */
+
+/* Forget the estimate, e.g. after a new BIG sync */
+void drift_reset(uint32_t sdu_interval_us);
+
+/* SDU of the reference BIS, called from the ISO recv callback. Only SDUs
+ * that are valid and carry a time stamp are used.
+ */
+void drift_update(const struct bt_iso_recv_info *info);
+
+/* Local clock minus SDU clock rate in parts per billion, positive when the
+ * local clock runs fast. 0 until two windows have passed.
+ */
+int32_t drift_ppb(void);
+
+void drift_print(void);
+
+#endif /* DRIFT_H_ */
@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/iso.h>
+#include <zephyr/sys/printk.h>
+
+#include "jitter_buf.h"
+
+#define DEPTH CONFIG_ISO_JB_DEPTH
+#define CHAN_MAX CONFIG_BT_ISO_MAX_CHAN
+
+BUILD_ASSERT(IS_POWER_OF_TWO(DEPTH), "CONFIG_ISO_JB_DEPTH must be a power of two");
+
+struct jb_slot {
+	bool used;
+	bool valid;
+	uint16_t seq_num;
+	uint16_t len;
+	uint8_t data[CONFIG_BT_ISO_RX_MTU];
+};
+
+struct jb_chan {
+	struct jb_slot slots[DEPTH];
+	/* Last frame played, repeated to conceal a lost one */
+	uint8_t last[CONFIG_BT_ISO_RX_MTU];
+	uint16_t last_len;
+	uint8_t conceal_run;
+	/* Gain at the end of the last frame played */
+	uint16_t gain;
+
+	uint32_t played;
+	uint32_t concealed;
+	uint32_t invalid;
+	uint32_t underrun;
+	uint32_t overrun;
+	uint32_t late;
+};
+
+static struct jb_chan chans[CHAN_MAX];
+static uint8_t chan_count;
+static struct k_spinlock jb_lock;
+
+static jitter_buf_play_cb_t play_cb;
+static uint32_t sdu_interval_us;
+static volatile bool running;
+
+/* Controller clock (SDU time stamps) mapped to the local clock: the smallest
+ * arrival delay seen is taken as offset, SDU n is played at its time stamp
+ * plus offset plus the presentation delay. The minimum is taken over the
+ * current and the previous window of CONFIG_ISO_JB_OFFSET_WINDOW SDUs, so the
+ * offset follows the clocks drifting apart in both directions.
+ */
+static bool timing_valid;
+static uint16_t ref_seq;
+static uint32_t ref_ts;
+static int32_t clk_offset;
+static int32_t offset_min_prev;
+static int32_t offset_min;
+static uint32_t offset_count;
+static uint16_t play_seq;
+
+static K_SEM_DEFINE(sem_start, 0, 1);
+
+static uint32_t local_us(void)
+{
+	return (uint32_t)k_ticks_to_us_floor64(k_uptime_ticks());
+}
+
+static void offset_update(int32_t offset)
+{
+	offset_min = MIN(offset_min, offset);
+	clk_offset = MIN(offset_min_prev, offset_min);
+
+	if (++offset_count >= CONFIG_ISO_JB_OFFSET_WINDOW) {
+		offset_min_prev = offset_min;
+		offset_min = INT32_MAX;
+		offset_count = 0U;
+	}
+}
+
+static uint32_t play_time_us(uint16_t seq_num)
+{
+	return ref_ts + (int16_t)(seq_num - ref_seq) * (int32_t)sdu_interval_us +
+	       clk_offset + CONFIG_ISO_JB_PRESENTATION_DELAY_US;
+}
+
+void jitter_buf_put(uint8_t chan, const struct bt_iso_recv_info *info,
+		    const struct net_buf *buf)
+{
+	struct jb_chan *jc = &chans[chan];
+	uint32_t now = local_us();
+	/* Without time stamps from the controller the arrival time is used */
+	uint32_t ts = (info->flags & BT_ISO_FLAGS_TS) ? info->ts : now;
+	k_spinlock_key_t key;
+	struct jb_slot *slot;
+	int16_t ahead;
+
+	if (!running || chan >= chan_count) {
+		return;
+	}
+
+	key = k_spin_lock(&jb_lock);
+
+	if (!timing_valid) {
+		ref_seq = info->seq_num;
+		ref_ts = ts;
+		clk_offset = (int32_t)(now - ts);
+		offset_min_prev = clk_offset;
+		offset_min = clk_offset;
+		offset_count = 0U;
+		play_seq = info->seq_num;
+		timing_valid = true;
+		k_sem_give(&sem_start);
+	} else {
+		/* Follow the time stamps of the SDU stream */
+		ref_seq = info->seq_num;
+		ref_ts = ts;
+		offset_update((int32_t)(now - ts));
+	}
+
+	ahead = (int16_t)(info->seq_num - play_seq);
+	if (ahead < 0) {
+		/* Its playout time already passed */
+		jc->late++;
+		k_spin_unlock(&jb_lock, key);
+		return;
+	}
+
+	if (ahead >= DEPTH) {
+		jc->overrun++;
+		k_spin_unlock(&jb_lock, key);
+		return;
+	}
+
+	slot = &jc->slots[info->seq_num & (DEPTH - 1U)];
+	slot->used = true;
+	slot->seq_num = info->seq_num;
+	slot->valid = (info->flags & BT_ISO_FLAGS_VALID) && buf->len > 0U;
+	slot->len = MIN(buf->len, sizeof(slot->data));
+	memcpy(slot->data, buf->data, slot->len);
+
+	k_spin_unlock(&jb_lock, key);
+}
+
+/* Take the frame for play_seq from the buffer of jc, or conceal it */
+static void frame_take(struct jb_chan *jc, struct jitter_buf_frame *frame)
+{
+	struct jb_slot *slot = &jc->slots[play_seq & (DEPTH - 1U)];
+
+	frame->seq_num = play_seq;
+	frame->gain_start = jc->gain;
+
+	if (slot->used && slot->seq_num == play_seq && slot->valid) {
+		memcpy(jc->last, slot->data, slot->len);
+		jc->last_len = slot->len;
+		jc->conceal_run = 0U;
+		jc->played++;
+
+		/* Fade back in after concealment */
+		jc->gain = JITTER_BUF_GAIN_ONE;
+		frame->concealed = false;
+	} else {
+		if (slot->used && slot->seq_num == play_seq) {
+			jc->invalid++;
+		} else {
+			jc->underrun++;
+		}
+
+		/* Repeat the last frame while the gain ramps down, then silence */
+		if (jc->conceal_run < CONFIG_ISO_JB_CONCEAL_REPEAT_MAX) {
+			jc->conceal_run++;
+			jc->gain = JITTER_BUF_GAIN_ONE *
+				   (CONFIG_ISO_JB_CONCEAL_REPEAT_MAX - jc->conceal_run) /
+				   CONFIG_ISO_JB_CONCEAL_REPEAT_MAX;
+		} else {
+			memset(jc->last, 0, jc->last_len);
+			jc->gain = 0U;
+		}
+		jc->concealed++;
+
+		frame->concealed = true;
+	}
+
+	frame->gain_end = jc->gain;
+	slot->used = false;
+	frame->len = jc->last_len;
+	frame->data = jc->last;
+}
+
+static void playout_thread(void *p1, void *p2, void *p3)
+{
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	while (true) {
+		k_sem_take(&sem_start, K_FOREVER);
+
+		while (running) {
+			k_spinlock_key_t key = k_spin_lock(&jb_lock);
+			int32_t delta = (int32_t)(play_time_us(play_seq) - local_us());
+
+			k_spin_unlock(&jb_lock, key);
+
+			if (delta > 0) {
+				k_sleep(K_USEC(delta));
+				continue;
+			}
+
+			for (uint8_t i = 0U; i < chan_count; i++) {
+				struct jitter_buf_frame frame;
+
+				key = k_spin_lock(&jb_lock);
+				frame_take(&chans[i], &frame);
+				k_spin_unlock(&jb_lock, key);
+
+				play_cb(i, &frame);
+			}
+
+			key = k_spin_lock(&jb_lock);
+			play_seq++;
+			k_spin_unlock(&jb_lock, key);
+		}
+	}
+}
+
+K_THREAD_DEFINE(jb_playout_tid, CONFIG_ISO_JB_THREAD_STACK_SIZE, playout_thread, NULL, NULL,
+		NULL, K_PRIO_COOP(CONFIG_ISO_JB_THREAD_PRIO), 0, 0);
+
+void jitter_buf_start(uint8_t count, uint32_t interval_us, jitter_buf_play_cb_t cb)
+{
+	k_spinlock_key_t key;
+
+	__ASSERT_NO_MSG(count <= CHAN_MAX);
+
+	k_sem_reset(&sem_start);
+
+	key = k_spin_lock(&jb_lock);
+
+	chan_count = count;
+	sdu_interval_us = interval_us;
+	play_cb = cb;
+	timing_valid = false;
+
+	for (uint8_t i = 0U; i < count; i++) {
+		for (uint8_t s = 0U; s < DEPTH; s++) {
+			chans[i].slots[s].used = false;
+		}
+		chans[i].last_len = 0U;
+		chans[i].conceal_run = 0U;
+		chans[i].gain = JITTER_BUF_GAIN_ONE;
+	}
+
+	running = true;
+
+	k_spin_unlock(&jb_lock, key);
+}
+
+void jitter_buf_stop(void)
+{
+	running = false;
+}
+
+void jitter_buf_stats_print(void)
+{
+	for (uint8_t i = 0U; i < chan_count; i++) {
+		struct jb_chan *jc = &chans[i];
+
+		printk("Jitter buffer %u: played %u, concealed %u (invalid %u, "
+		       "underrun %u), overrun %u, late %u\n", i, jc->played,
+		       jc->concealed, jc->invalid, jc->underrun, jc->overrun,
+		       jc->late);
+	}
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef JITTER_BUF_H_
+#define JITTER_BUF_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <zephyr/bluetooth/iso.h>
+#include <zephyr/net/buf.h>
+
+/* Unity gain of the fade ramp, Q15 */
+#define JITTER_BUF_GAIN_ONE 0x8000U
+
+/* A frame handed to the audio path every SDU interval. When concealed is set
+ * the SDU was lost, late or invalid and data holds the last good frame
+ * (repeat) or silence once too many frames in a row were lost. A decoder with
+ * its own packet loss concealment should ignore data in that case.
+ *
+ * The audio path scales the decoded samples of the frame by a gain that goes
+ * linearly from gain_start to gain_end over the frame. Concealed frames fade
+ * out to silence over CONFIG_ISO_JB_CONCEAL_REPEAT_MAX frames, the first good
+ * frame after them fades back in.
+ */
+struct jitter_buf_frame {
+	uint16_t seq_num;
+	bool concealed;
+	uint16_t len;
+	const uint8_t *data;
+	uint16_t gain_start;
+	uint16_t gain_end;
+};
+
+typedef void (*jitter_buf_play_cb_t)(uint8_t chan, const struct jitter_buf_frame *frame);
+
+/* Start buffering count BIS with the given SDU interval, play_cb is called
+ * from the playout thread for every BIS every SDU interval once the first SDU
+ * has been received.
+ */
+void jitter_buf_start(uint8_t count, uint32_t sdu_interval_us, jitter_buf_play_cb_t play_cb);
+
+/* Stop playout, e.g. when the BIG sync is lost */
+void jitter_buf_stop(void);
+
+/* Called from the ISO recv callback */
+void jitter_buf_put(uint8_t chan, const struct bt_iso_recv_info *info,
+		    const struct net_buf *buf);
+
+void jitter_buf_stats_print(void);
+
+#endif /* JITTER_BUF_H_ */
@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+
+#include "latency.h"
+#include "latency_probe.h"
+
+#define SAMPLE_COUNT CONFIG_ISO_LATENCY_SAMPLES
+/* Receive times kept until the SDU is played out, covers the jitter buffer */
+#define RX_TIME_COUNT 32
+
+enum latency_seg {
+	SEG_CAPTURE_ANCHOR,
+	SEG_ANCHOR_TS,
+	SEG_CAPTURE_TS,
+	SEG_TS_RX,
+	SEG_TS_PLAYOUT,
+	SEG_CAPTURE_PLAYOUT,
+	SEG_COUNT,
+};
+
+static const char *const seg_str[SEG_COUNT] = {
+	"capture to anchor", "anchor to SDU ts", "capture to SDU ts",
+	"SDU ts to receive", "SDU ts to playout", "capture to playout",
+};
+
+/* The last SAMPLE_COUNT latencies of a segment, count is the total added */
+struct seg_samples {
+	int32_t us[SAMPLE_COUNT];
+	uint32_t count;
+};
+
+static struct seg_samples segs[SEG_COUNT];
+
+struct rx_time {
+	uint32_t count;
+	uint32_t ts_us;
+	bool valid;
+};
+
+static struct rx_time rx_times[RX_TIME_COUNT];
+
+/* Between the ISO recv callback, the playout thread and the report */
+static struct k_spinlock lock;
+static uint32_t sdu_interval;
+
+/* Controller clock minus local clock (us), only used by the ISO recv callback */
+static bool offset_valid;
+static uint32_t clk_offset;
+
+/* Sorted copy of one segment, only used by the report */
+static int32_t sorted[SAMPLE_COUNT];
+
+static void latency_report(struct k_work *work)
+{
+	latency_print();
+}
+
+static K_WORK_DEFINE(report_work, latency_report);
+
+static void sample_add(enum latency_seg seg, uint32_t us)
+{
+	struct seg_samples *s = &segs[seg];
+
+	s->us[s->count % SAMPLE_COUNT] = (int32_t)us;
+	s->count++;
+}
+
+/* Called with the lock held once per SDU */
+static void sdu_done(void)
+{
+	if ((segs[SEG_CAPTURE_PLAYOUT].count % CONFIG_ISO_LATENCY_REPORT_INTERVAL) == 0U) {
+		k_work_submit(&report_work);
+	}
+}
+
+void latency_reset(uint32_t sdu_interval_us)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	for (uint8_t seg = 0U; seg < SEG_COUNT; seg++) {
+		segs[seg].count = 0U;
+	}
+	for (uint8_t i = 0U; i < RX_TIME_COUNT; i++) {
+		rx_times[i].valid = false;
+	}
+	sdu_interval = sdu_interval_us;
+	offset_valid = false;
+
+	k_spin_unlock(&lock, key);
+}
+
+/* The local time of the controller time stamp. The SDU arrives after its time
+ * stamp, so the largest offset has the smallest host delay. The offset follows
+ * the clocks when they drift back by more than an interval.
+ */
+static uint32_t ts_to_local(uint32_t ts_us, uint32_t rx_us)
+{
+	uint32_t offset = ts_us - rx_us;
+
+	if (!offset_valid || (int32_t)(offset - clk_offset) > 0 ||
+	    (int32_t)(clk_offset - offset) > (int32_t)sdu_interval) {
+		clk_offset = offset;
+		offset_valid = true;
+	}
+
+	return ts_us - clk_offset;
+}
+
+void latency_rx(const struct bt_iso_recv_info *info, const uint8_t *data, uint16_t len,
+		uint32_t rx_us)
+{
+	struct latency_probe probe;
+	k_spinlock_key_t key;
+	uint32_t ts_us;
+
+	if (!latency_probe_get(data, len, &probe)) {
+		return;
+	}
+
+	key = k_spin_lock(&lock);
+
+	if (info->flags & BT_ISO_FLAGS_TS) {
+		ts_us = ts_to_local(info->ts, rx_us);
+		sample_add(SEG_TS_RX, rx_us - ts_us);
+	} else {
+		ts_us = rx_us;
+	}
+
+	if (probe.anchor_us) {
+		sample_add(SEG_CAPTURE_ANCHOR, probe.anchor_us - probe.capture_us);
+		sample_add(SEG_ANCHOR_TS, ts_us - probe.anchor_us);
+	}
+	sample_add(SEG_CAPTURE_TS, ts_us - probe.capture_us);
+
+	if (IS_ENABLED(CONFIG_ISO_JITTER_BUFFER)) {
+		struct rx_time *t = &rx_times[probe.count % RX_TIME_COUNT];
+
+		t->count = probe.count;
+		t->ts_us = ts_us;
+		t->valid = true;
+	} else {
+		/* Played as soon as it is received */
+		sample_add(SEG_CAPTURE_PLAYOUT, rx_us - probe.capture_us);
+		sdu_done();
+	}
+
+	k_spin_unlock(&lock, key);
+}
+
+void latency_playout(const uint8_t *data, uint16_t len, uint32_t play_us)
+{
+	struct latency_probe probe;
+	k_spinlock_key_t key;
+	struct rx_time *t;
+
+	if (!latency_probe_get(data, len, &probe)) {
+		return;
+	}
+
+	key = k_spin_lock(&lock);
+
+	t = &rx_times[probe.count % RX_TIME_COUNT];
+	if (t->valid && t->count == probe.count) {
+		sample_add(SEG_TS_PLAYOUT, play_us - t->ts_us);
+		t->valid = false;
+	}
+	sample_add(SEG_CAPTURE_PLAYOUT, play_us - probe.capture_us);
+	sdu_done();
+
+	k_spin_unlock(&lock, key);
+}
+
+static int latency_cmp(const void *a, const void *b)
+{
+	int32_t x = *(const int32_t *)a;
+	int32_t y = *(const int32_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+void latency_print(void)
+{
+	printk("Latency, SDU interval %u us, %s:\n", sdu_interval,
+	       IS_ENABLED(CONFIG_ISO_JITTER_BUFFER) ? "jitter buffer" : "no jitter buffer");
+
+	for (uint8_t seg = 0U; seg < SEG_COUNT; seg++) {
+		k_spinlock_key_t key = k_spin_lock(&lock);
+		uint32_t total = segs[seg].count;
+		uint32_t n = MIN(total, SAMPLE_COUNT);
+
+		memcpy(sorted, segs[seg].us, n * sizeof(sorted[0]));
+		k_spin_unlock(&lock, key);
+
+		if (!n) {
+			continue;
+		}
+
+		qsort(sorted, n, sizeof(sorted[0]), latency_cmp);
+
+		printk("  %-18s: min %d p50 %d p99 %d max %d us over %u SDUs\n",
+		       seg_str[seg], sorted[0], sorted[n / 2U], sorted[(n * 99U) / 100U],
+		       sorted[n - 1U], n);
+	}
+}
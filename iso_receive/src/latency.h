@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef LATENCY_H_
+#define LATENCY_H_
+
+#include <stdint.h>
+
+#include <zephyr/bluetooth/iso.h>
+
+/* End-to-end latency from the time-stamped SDUs of the iso_broadcast sample
+ * built with CONFIG_ISO_BROADCAST_PAYLOAD_LATENCY, see latency_probe.h.
+ *
+ * An SDU is anchored at its controller time stamp, mapped to the local clock
+ * with the smallest delay seen between a time stamp and its recv callback.
+ * Times of the broadcaster and the receiver are only comparable when both run
+ * on the same clock, as under BabbleSim. On hardware every segment that spans
+ * both devices includes the offset between their clocks.
+ */
+
+/* Forget the samples, e.g. after a new BIG sync */
+void latency_reset(uint32_t sdu_interval_us);
+
+/* A valid SDU of the reference BIS, called from the ISO recv callback with the
+ * local time it was received. Without a jitter buffer this is also its
+ * playout time. SDUs without a time stamp are anchored at rx_us.
+ */
+void latency_rx(const struct bt_iso_recv_info *info, const uint8_t *data, uint16_t len,
+		uint32_t rx_us);
+
+/* The SDU is played out at local time play_us, called by the playout thread */
+void latency_playout(const uint8_t *data, uint16_t len, uint32_t play_us);
+
+/* p50, p99 and max per segment over the kept samples */
+void latency_print(void);
+
+#endif /* LATENCY_H_ */
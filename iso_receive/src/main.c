@@ -4,17 +4,46 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <errno.h>
+
 #include <zephyr/device.h>
 #include <zephyr/bluetooth/bluetooth.h>
 #include <zephyr/bluetooth/conn.h>
 #include <zephyr/bluetooth/iso.h>
 #include <zephyr/sys/byteorder.h>
 
+#if defined(CONFIG_ISO_AUDIO_DECODE)
+#include "audio_dec.h"
+#endif /* CONFIG_ISO_AUDIO_DECODE */
+#if defined(CONFIG_ISO_ASRC)
+#include "asrc.h"
+#include "drift.h"
+#endif /* CONFIG_ISO_ASRC */
+#include "bis_select.h"
+#include "broadcast_code.h"
+#if defined(CONFIG_ISO_LATENCY)
+#include "latency.h"
+#endif /* CONFIG_ISO_LATENCY */
+#include "rx_stats.h"
+#include "scan_filter.h"
+#if defined(CONFIG_ISO_MULTI_SOURCE)
+#include "sources.h"
+#endif /* CONFIG_ISO_MULTI_SOURCE */
+#include "trace.h"
+#if defined(CONFIG_ISO_JITTER_BUFFER)
+#include "jitter_buf.h"
+#endif /* CONFIG_ISO_JITTER_BUFFER */
+
 #define TIMEOUT_SYNC_CREATE K_SECONDS(10)
-#define NAME_LEN            30
 
-/* Actieve scan en kan scan-responses sturen */
-#define BT_LE_SCAN_CUSTOM BT_LE_SCAN_PARAM(BT_LE_SCAN_TYPE_ACTIVE, \
+/* Actieve scan kan scan-responses opvragen, passief luistert enkel */
+#if defined(CONFIG_ISO_SCAN_PASSIVE)
+#define SCAN_TYPE BT_LE_SCAN_TYPE_PASSIVE
+#else
+#define SCAN_TYPE BT_LE_SCAN_TYPE_ACTIVE
+#endif /* CONFIG_ISO_SCAN_PASSIVE */
+
+#define BT_LE_SCAN_CUSTOM BT_LE_SCAN_PARAM(SCAN_TYPE, \
 					   BT_LE_SCAN_OPT_NONE, \
 					   BT_GAP_SCAN_FAST_INTERVAL, \
 					   BT_GAP_SCAN_FAST_WINDOW) /* duur van de scan */
@@ -22,7 +51,8 @@
 /* periodiek advertentie (PA) */
 #define PA_RETRY_COUNT 6
 
-#define BIS_ISO_CHAN_COUNT 2
+/* Maximaal aantal BIS, hoeveel er effectief gesynct worden volgt uit de BIGInfo */
+#define BIS_ISO_CHAN_MAX CONFIG_BT_ISO_MAX_CHAN
 
 static bool         per_adv_found;
 static bool         per_adv_lost;
@@ -30,71 +60,167 @@ static bt_addr_le_t per_addr;
 static uint8_t      per_sid;
 static uint32_t     per_interval_us;
 
-static uint32_t     iso_recv_count;
+/* Alleen voor het print-interval, statistieken per BIS staan in rx_stats */
+static atomic_t     iso_recv_count;
+
+/* Uit de BIGInfo: BIG versleuteld of niet */
+static bool         big_encrypted;
+static uint32_t     big_sdu_interval_us;
+static struct bis_select_big big_params;
+
+/* Gesynchroniseerde BIS, gekozen uit de BIGInfo en BASE */
+static uint8_t      bis_count;
+
+/* PA sync waarop de BIG sync gebeurt, andere syncs hebben geen BASE nodig */
+static struct bt_le_per_adv_sync *big_pa_sync;
+
+/* BIG sync verloren door een MIC-fout (verkeerde Broadcast Code) */
+static uint32_t     mic_fail_count;
+
+/* Hoe de audio na een verlies van de sync terugkomt */
+enum resync_path {
+	/* PA sync bleef actief, enkel de BIG sync opnieuw */
+	RESYNC_PATH_BIG,
+	/* PA sync naar de gecachte bron, zonder scan */
+	RESYNC_PATH_FAST,
+	/* Volledige scan */
+	RESYNC_PATH_SCAN,
+	/* BIG sync op de warme PA sync van een andere bron */
+	RESYNC_PATH_STANDBY,
+	RESYNC_PATH_COUNT,
+};
 
-static K_SEM_DEFINE(sem_per_adv, 0, 1);
-static K_SEM_DEFINE(sem_per_sync, 0, 1);
-static K_SEM_DEFINE(sem_per_sync_lost, 0, 1);
-static K_SEM_DEFINE(sem_per_big_info, 0, 1);
-static K_SEM_DEFINE(sem_big_sync, 0, BIS_ISO_CHAN_COUNT);
-static K_SEM_DEFINE(sem_big_sync_lost, 0, BIS_ISO_CHAN_COUNT);
+static const char *const resync_path_str[RESYNC_PATH_COUNT] = {
+	"BIG sync", "fast resync", "scan", "standby failover",
+};
 
+struct time_stat {
+	uint32_t last_us;
+	uint32_t min_us;
+	uint32_t max_us;
+	uint64_t sum_us;
+	uint32_t count;
+};
 
-/* Callback functie die naam uit de advertising bluetooth data haalt */
-static bool data_cb(struct bt_data *data, void *user_data)
-{
-	char *name = user_data;
-	uint8_t len;
+/* Time to audio: van het verlies van de BIG sync tot de eerste geldige SDU */
+static struct time_stat   resync_stats[RESYNC_PATH_COUNT];
+static enum resync_path   resync_path;
+/* Pad van de resync waarvan de time to audio gemeten wordt */
+static enum resync_path   resync_audio_path;
+static uint32_t           resync_loss_us;
+static bool               resync_loss_pending;
+/* Gezet zolang er op de eerste geldige SDU na een resync gewacht wordt */
+static atomic_t           resync_audio_wait;
+static uint32_t           resync_audio_us;
+
+/* Audio gap: tijd zonder geldige SDU op BIS 0 bovenop het SDU-interval. De
+ * controller time stamps lopen door over het verlies en herstel van de BIG
+ * sync, ook als de broadcaster zijn BIG herconfigureert.
+ */
+static bool               gap_ts_valid;
+static uint32_t           gap_last_ts;
+static uint32_t           gap_last_us;
+static uint32_t           gap_max_us;
+static uint32_t           gap_count;
+
+#if defined(CONFIG_ISO_FAST_RESYNC)
+/* Bron en BIGInfo van de laatste gelukte BIG sync zijn gecacht */
+static bool         resync_cached;
+static bool         resync_pa_list;
+static uint8_t      resync_fail_count;
+#endif /* CONFIG_ISO_FAST_RESYNC */
+
+/* Toestanden van de ontvanger, elke toestand heeft een timeout */
+enum rx_state {
+	RX_STATE_IDLE,
+	/* Scannen tot er een periodieke advertentie gevonden wordt */
+	RX_STATE_SCAN,
+	/* Verder scannen om de bronnen te rangschikken */
+	RX_STATE_DISCOVER,
+	/* Wachten op de PA sync */
+	RX_STATE_PA_SYNC,
+	/* Wachten op de BIGInfo */
+	RX_STATE_BIGINFO,
+	/* Wachten tot alle BIS verbonden zijn */
+	RX_STATE_BIG_SYNC,
+	RX_STATE_STREAMING,
+	/* Wachten op een Broadcast Code, een BIS of na een fout */
+	RX_STATE_RETRY,
+	RX_STATE_COUNT,
+};
 
-	switch (data->type) {
-	case BT_DATA_NAME_SHORTENED:
-	case BT_DATA_NAME_COMPLETE:
-		len = MIN(data->data_len, NAME_LEN - 1);
-		memcpy(name, data->data, len);
-		/* null-terminator toegevoegd om een geldige C-string te maken. */
-		name[len] = '\0';
-		return false;
-	default:
-		return true;
-	}
-}
+static const char *const rx_state_str[RX_STATE_COUNT] = {
+	"idle", "scan", "discover", "PA sync", "BIG info", "BIG sync", "streaming",
+	"retry",
+};
+
+/* Gebeurtenissen van de callbacks, in de volgorde waarin ze verwerkt worden */
+enum rx_evt {
+	RX_EVT_START,
+	RX_EVT_PER_ADV,
+	RX_EVT_PA_SYNCED,
+	RX_EVT_BIGINFO,
+	RX_EVT_BIS_CONNECTED,
+	RX_EVT_BIS_LOST,
+	RX_EVT_PA_LOST,
+	RX_EVT_COUNT,
+	/* Niet gepost, komt van de timeout van de toestand */
+	RX_EVT_TIMEOUT = RX_EVT_COUNT,
+};
 
-/* Vertaald de PHY-snelheid (snelheid waarmee gegevens over de fysieke laag van de radio worden verzonden) naar een string die niet gewijzigd kan worden */
-static const char *phy2str(uint8_t phy)
+BUILD_ASSERT(RX_EVT_COUNT <= ATOMIC_BITS, "Too many receiver events");
+
+static enum rx_state rx_state;
+static atomic_t      rx_events;
+static k_timepoint_t rx_deadline;
+/* Lokale tijd van de laatste overgang */
+static uint32_t      rx_state_us;
+/* Tijd per toestand sinds de vorige keer streaming */
+static uint32_t      rx_acquire_us[RX_STATE_COUNT];
+static struct time_stat rx_state_stats[RX_STATE_COUNT];
+/* RETRY gaat verder met een volledige acquisitie in plaats van de BIG sync */
+static bool          rx_retry_scan;
+
+static struct bt_iso_big *rx_big;
+static atomic_t      bis_connected;
+static atomic_t      bis_lost;
+
+/* SDUs ontvangen, voor de watchdog tijdens streaming */
+static atomic_t      sdu_count;
+static atomic_val_t  sdu_count_last;
+
+static void rx_sm_event(struct k_work *work);
+static void rx_sm_expire(struct k_work *work);
+
+static K_THREAD_STACK_DEFINE(rx_sm_stack, CONFIG_ISO_RX_SM_STACK_SIZE);
+static struct k_work_q rx_sm_workq;
+static K_WORK_DEFINE(rx_event_work, rx_sm_event);
+static K_WORK_DELAYABLE_DEFINE(rx_timeout_work, rx_sm_expire);
+
+/* Vanuit de callbacks: de toestandsmachine verwerkt de gebeurtenis in zijn work queue */
+static void rx_sm_post(enum rx_evt evt)
 {
-	switch (phy) {
-	case 0: return "No packets";
-	case BT_GAP_LE_PHY_1M: return "LE 1M";
-	case BT_GAP_LE_PHY_2M: return "LE 2M";
-	case BT_GAP_LE_PHY_CODED: return "LE Coded";
-	default: return "Unknown";
-	}
+	atomic_set_bit(&rx_events, evt);
+	(void)k_work_submit_to_queue(&rx_sm_workq, &rx_event_work);
 }
 
-/* verwerkt gegevens die worden ontvangen tijdens een BLE scan. Deze functie ontvangt een advertentiepakket van een apparaat en drukt verschillende eigenschappen daarvan af */
+
+/* verwerkt gegevens die worden ontvangen tijdens een BLE scan. Deze functie ontvangt een advertentiepakket van een apparaat, het afdrukken gebeurt later door de trace thread */
 static void scan_recv(const struct bt_le_scan_recv_info *info,
 		      struct net_buf_simple *buf)
 {
-	char le_addr[BT_ADDR_LE_STR_LEN];
-	char name[NAME_LEN];
-
-	(void)memset(name, 0, sizeof(name));
+	/* Eerst filteren, afgewezen rapporten worden niet gekopieerd of geprint */
+	if (!scan_filter_accept(info, buf)) {
+		return;
+	}
 
-	bt_data_parse(buf, data_cb, name);
+	trace_scan(info, buf);
 
-	bt_addr_le_to_str(info->addr, le_addr, sizeof(le_addr));
-	/* BT_GAP_ADV_TYPE_ADV_IND = 0x00 , BT_GAP_ADV_TYPE_ADV_DIRECT_IND = 0x01 , BT_GAP_ADV_TYPE_ADV_SCAN_IND = 0x02 , BT_GAP_ADV_TYPE_ADV_NONCONN_IND = 0x03 , BT_GAP_ADV_TYPE_SCAN_RSP = 0x04 , BT_GAP_ADV_TYPE_EXT_ADV = 0x05 */
-	printk("[DEVICE]: %s, AD evt type %u, Tx Pwr: %i, RSSI %i %s "
-	       "C:%u S:%u D:%u SR:%u E:%u Prim: %s, Secn: %s, "
-	       "Interval: 0x%04x (%u us), SID: %u\n",
-	       le_addr, info->adv_type, info->tx_power, info->rssi, name,
-	       (info->adv_props & BT_GAP_ADV_PROP_CONNECTABLE) != 0,
-	       (info->adv_props & BT_GAP_ADV_PROP_SCANNABLE) != 0,
-	       (info->adv_props & BT_GAP_ADV_PROP_DIRECTED) != 0,
-	       (info->adv_props & BT_GAP_ADV_PROP_SCAN_RESPONSE) != 0,
-	       (info->adv_props & BT_GAP_ADV_PROP_EXT_ADV) != 0,
-	       phy2str(info->primary_phy), phy2str(info->secondary_phy),
-	       info->interval, BT_CONN_INTERVAL_TO_US(info->interval), info->sid);
+#if defined(CONFIG_ISO_MULTI_SOURCE)
+	if (info->interval) {
+		sources_scan_report(info);
+	}
+#endif /* CONFIG_ISO_MULTI_SOURCE */
 
 	if (!per_adv_found && info->interval) {
 		per_adv_found = true;
@@ -103,7 +229,7 @@ static void scan_recv(const struct bt_le_scan_recv_info *info,
 		per_interval_us = BT_CONN_INTERVAL_TO_US(info->interval);
 		bt_addr_le_copy(&per_addr, info->addr);
 
-		k_sem_give(&sem_per_adv);
+		rx_sm_post(RX_EVT_PER_ADV);
 	}
 }
 
@@ -124,7 +250,14 @@ static void sync_cb(struct bt_le_per_adv_sync *sync,
 	       bt_le_per_adv_sync_get_index(sync), le_addr,
 	       info->interval, info->interval * 5 / 4, phy2str(info->phy));
 
-	k_sem_give(&sem_per_sync);
+#if defined(CONFIG_ISO_MULTI_SOURCE)
+	if (sources_synced(sync)) {
+		/* Standby bron, niet de sync waarop main wacht */
+		return;
+	}
+#endif /* CONFIG_ISO_MULTI_SOURCE */
+
+	rx_sm_post(RX_EVT_PA_SYNCED);
 }
 
 /* callback die wordt aangeroepen wanneer een periodieke advertentie-synchronisatie is beëindigd */
@@ -138,8 +271,18 @@ static void term_cb(struct bt_le_per_adv_sync *sync,
 	printk("PER_ADV_SYNC[%u]: [DEVICE]: %s sync terminated\n",
 	       bt_le_per_adv_sync_get_index(sync), le_addr);
 
-	per_adv_lost = true;
-	k_sem_give(&sem_per_sync_lost);
+#if defined(CONFIG_ISO_MULTI_SOURCE)
+	if (sources_term(sync)) {
+		return;
+	}
+#endif /* CONFIG_ISO_MULTI_SOURCE */
+
+	/* Een verwijderde sync of een sync van voor de laatste acquisitie */
+	if (sync != big_pa_sync) {
+		return;
+	}
+
+	rx_sm_post(RX_EVT_PA_LOST);
 }
 
 /* callback die wordt aangeroepen wanneer gegevens worden ontvangen van een gesynchroniseerde periodieke BLE-advertentie => This callback notifies the application about changes to the sync state */
@@ -147,45 +290,38 @@ static void recv_cb(struct bt_le_per_adv_sync *sync,
 		    const struct bt_le_per_adv_sync_recv_info *info,
 		    struct net_buf_simple *buf)
 {
-	char le_addr[BT_ADDR_LE_STR_LEN];
-	char data_str[129];
+	trace_pa(bt_le_per_adv_sync_get_index(sync), info, buf);
 
-	bt_addr_le_to_str(info->addr, le_addr, sizeof(le_addr));
-	bin2hex(buf->data, buf->len, data_str, sizeof(data_str));
+	if (sync == big_pa_sync) {
+		bis_select_base_parse(buf);
+	}
 
-	printk("PER_ADV_SYNC[%u]: [DEVICE]: %s, tx_power %i, "
-	       "RSSI %i, CTE %u, data length %u, data: %s\n",
-	       bt_le_per_adv_sync_get_index(sync), le_addr, info->tx_power,
-	       info->rssi, info->cte_type, buf->len, data_str);
+#if defined(CONFIG_ISO_MULTI_SOURCE)
+	sources_pa_report(sync, info);
+#endif /* CONFIG_ISO_MULTI_SOURCE */
 }
 
 /* callback die wordt aangeroepen wanneer er informatie ontvangen wordt over een BIG (Broadcast Isochronous Group) in een BLE Isochronous Channel */
 static void biginfo_cb(struct bt_le_per_adv_sync *sync,
 		       const struct bt_iso_biginfo *biginfo)
 {
-	char le_addr[BT_ADDR_LE_STR_LEN];
-
-	bt_addr_le_to_str(biginfo->addr, le_addr, sizeof(le_addr));
+	trace_biginfo(bt_le_per_adv_sync_get_index(sync), biginfo);
 
-	printk("BIG INFO[%u]: [DEVICE]: %s, sid 0x%02x, "
-	       "num_bis %u, nse %u, interval 0x%04x (%u ms), "
-	       "bn %u, pto %u, irc %u, max_pdu %u, "
-	       "sdu_interval %u us, max_sdu %u, phy %s, "
-	       "%s framing, %sencrypted\n",
-	       bt_le_per_adv_sync_get_index(sync), le_addr, biginfo->sid,
-		   /* aantal BIS (Broadcast Isochronous Streams), wat het aantal isochrone datastromen in de BIG aangeeft.*/
-	       biginfo->num_bis, 
-		   biginfo->sub_evt_count,
-	       biginfo->iso_interval,
-	       (biginfo->iso_interval * 5 / 4),
-	       biginfo->burst_number, biginfo->offset,
-	       biginfo->rep_count, biginfo->max_pdu, biginfo->sdu_interval,
-	       biginfo->max_sdu, phy2str(biginfo->phy),
-	       biginfo->framing ? "with" : "without",
-	       biginfo->encryption ? "" : "not ");
+#if defined(CONFIG_ISO_MULTI_SOURCE)
+	if (sources_biginfo(sync, biginfo)) {
+		return;
+	}
+#endif /* CONFIG_ISO_MULTI_SOURCE */
 
+	big_encrypted = biginfo->encryption;
+	big_sdu_interval_us = biginfo->sdu_interval;
+	big_params.num_bis = biginfo->num_bis;
+	big_params.nse = biginfo->sub_evt_count;
+	big_params.bn = biginfo->burst_number;
+	big_params.irc = biginfo->rep_count;
+	big_params.max_sdu = biginfo->max_sdu;
 
-	k_sem_give(&sem_per_big_info);
+	rx_sm_post(RX_EVT_BIGINFO);
 }
 
 static struct bt_le_per_adv_sync_cb sync_callbacks = {
@@ -195,43 +331,225 @@ static struct bt_le_per_adv_sync_cb sync_callbacks = {
 	.biginfo = biginfo_cb,
 };
 
+static struct bt_iso_chan bis_iso_chan[BIS_ISO_CHAN_MAX];
+
+static uint32_t local_us(void)
+{
+	return (uint32_t)k_ticks_to_us_floor64(k_uptime_ticks());
+}
+
+static void time_stat_add(struct time_stat *stat, uint32_t us)
+{
+	stat->last_us = us;
+	stat->min_us = stat->count ? MIN(stat->min_us, us) : us;
+	stat->max_us = MAX(stat->max_us, us);
+	stat->sum_us += us;
+	stat->count++;
+}
+
+/* Verwerkt de time to audio buiten de ISO RX context */
+static void resync_report(struct k_work *work)
+{
+	struct time_stat *stat;
+
+	time_stat_add(&resync_stats[resync_audio_path], resync_audio_us);
+
+	for (uint8_t path = 0U; path < RESYNC_PATH_COUNT; path++) {
+		stat = &resync_stats[path];
+		if (!stat->count) {
+			continue;
+		}
+
+		printk("Time to audio via %s: last %u ms, min %u max %u avg %u ms "
+		       "over %u\n", resync_path_str[path], stat->last_us / USEC_PER_MSEC,
+		       stat->min_us / USEC_PER_MSEC, stat->max_us / USEC_PER_MSEC,
+		       (uint32_t)(stat->sum_us / stat->count / USEC_PER_MSEC),
+		       stat->count);
+	}
+}
+
+static K_WORK_DEFINE(resync_work, resync_report);
+
+static void gap_report(struct k_work *work)
+{
+	printk("Audio gap %u us, max %u us over %u gaps\n", gap_last_us, gap_max_us,
+	       gap_count);
+}
+
+static K_WORK_DEFINE(gap_work, gap_report);
+
+/* Vergelijkt de time stamps van opeenvolgende geldige SDUs, een sprong van
+ * meer dan anderhalf SDU-interval is een gap
+ */
+static void audio_gap_update(const struct bt_iso_recv_info *info)
+{
+	int32_t gap;
+
+	if ((info->flags & (BT_ISO_FLAGS_VALID | BT_ISO_FLAGS_TS)) !=
+	    (BT_ISO_FLAGS_VALID | BT_ISO_FLAGS_TS) || !big_sdu_interval_us) {
+		return;
+	}
+
+	gap = (int32_t)(info->ts - gap_last_ts) - (int32_t)big_sdu_interval_us;
+	if (gap_ts_valid && gap > (int32_t)big_sdu_interval_us / 2) {
+		gap_last_us = gap;
+		gap_max_us = MAX(gap_max_us, gap_last_us);
+		gap_count++;
+		k_work_submit(&gap_work);
+	}
+
+	gap_last_ts = info->ts;
+	gap_ts_valid = true;
+}
+
+#if defined(CONFIG_ISO_FAST_RESYNC)
+/* Onthoud de bron na een gelukte BIG sync, per_addr, per_sid, per_interval_us
+ * en de BIGInfo blijven staan tot een volgende scan.
+ */
+static void resync_cache(void)
+{
+	int err;
+
+	resync_fail_count = 0U;
+	if (resync_cached) {
+		return;
+	}
+	resync_cached = true;
+
+	if (!IS_ENABLED(CONFIG_ISO_FAST_RESYNC_PA_LIST)) {
+		return;
+	}
+
+	/* De controller synct dan zelf op de bron uit de lijst */
+	(void)bt_le_per_adv_list_clear();
+	err = bt_le_per_adv_list_add(&per_addr, per_sid);
+	if (err) {
+		printk("Periodic advertiser list add failed (err %d)\n", err);
+	}
+	resync_pa_list = !err;
+}
+
+static void resync_fail(void)
+{
+	if (resync_path != RESYNC_PATH_FAST) {
+		return;
+	}
+
+	resync_fail_count++;
+	if (resync_fail_count >= CONFIG_ISO_FAST_RESYNC_ATTEMPTS) {
+		printk("Fast resync failed %u times, scanning again\n", resync_fail_count);
+		resync_cached = false;
+		resync_pa_list = false;
+		resync_fail_count = 0U;
+	}
+}
+#endif /* CONFIG_ISO_FAST_RESYNC */
+
+#if defined(CONFIG_ISO_JITTER_BUFFER)
+/* Audio-pad: krijgt elk SDU-interval een frame per BIS van de jitter buffer */
+static void playout(uint8_t chan, const struct jitter_buf_frame *frame)
+{
+	static uint32_t play_count;
+
+#if defined(CONFIG_ISO_AUDIO_DECODE)
+	/* Verborgen frames laat de LC3 decoder zelf maskeren */
+	audio_dec_put(chan, frame->seq_num, !frame->concealed, frame->data, frame->len,
+		      frame->gain_start, frame->gain_end);
+#endif /* CONFIG_ISO_AUDIO_DECODE */
+
+	if (chan != 0U) {
+		return;
+	}
+
+#if defined(CONFIG_ISO_LATENCY)
+	if (!frame->concealed) {
+		latency_playout(frame->data, frame->len, local_us());
+	}
+#endif /* CONFIG_ISO_LATENCY */
+
+	if ((play_count % CONFIG_ISO_PRINT_INTERVAL) == 0) {
+		printk("Playout seq_num %u len %u%s\n", frame->seq_num, frame->len,
+		       frame->concealed ? " (concealed)" : "");
+		jitter_buf_stats_print();
+	}
+
+	play_count++;
+}
+#endif /* CONFIG_ISO_JITTER_BUFFER */
+
 /* callback die wordt aangeroepen wanneer er ISO (Isochronous) data wordt ontvangen via een ISO-channel in BLE */
 static void iso_recv(struct bt_iso_chan *chan, const struct bt_iso_recv_info *info, struct net_buf *buf)
 {
-	char data_str[128];
-	size_t str_len;
-	uint32_t count = 0; /* only valid if the data is a counter */
-
-	if (buf->len == sizeof(count)) {
+	/* Geen formattering of printk hier, dat gebeurt in de trace thread */
+	if (IS_ENABLED(CONFIG_ISO_ALIGN_PRINT_INTERVALS) && buf->len == sizeof(uint32_t)) {
 		/* little-endian systeem worden de least significant bytes (LSB) van een getal als eerste opgeslagen. host-endian => dewelke die door het systeem gebruikt wordt */
-		count = sys_get_le32(buf->data);
-		if (IS_ENABLED(CONFIG_ISO_ALIGN_PRINT_INTERVALS)) {
-			iso_recv_count = count;
-		}
+		atomic_set(&iso_recv_count, sys_get_le32(buf->data));
+	}
+
+	rx_stats_update(ARRAY_INDEX(bis_iso_chan, chan), info);
+	if (chan == &bis_iso_chan[0]) {
+		audio_gap_update(info);
+	}
+	trace_iso(ARRAY_INDEX(bis_iso_chan, chan), info, buf, atomic_get(&iso_recv_count));
+
+	atomic_inc(&iso_recv_count);
+	atomic_inc(&sdu_count);
+
+#if defined(CONFIG_ISO_ASRC)
+	/* De drift van de klok van de broadcaster volgt uit de sequence numbers
+	 * en time stamps van BIS 0
+	 */
+	if (chan == &bis_iso_chan[0]) {
+		drift_update(info);
+	}
+#endif /* CONFIG_ISO_ASRC */
+
+#if defined(CONFIG_ISO_LATENCY)
+	/* Tijdstempels van de broadcaster vergelijken met de time stamp van de controller */
+	if (chan == &bis_iso_chan[0] && (info->flags & BT_ISO_FLAGS_VALID)) {
+		latency_rx(info, buf->data, buf->len, local_us());
 	}
+#endif /* CONFIG_ISO_LATENCY */
 
-	if ((iso_recv_count % CONFIG_ISO_PRINT_INTERVAL) == 0) {
-		str_len = bin2hex(buf->data, buf->len, data_str, sizeof(data_str));
-		printk("Incoming data channel %p flags 0x%x seq_num %u ts %u len %u: "
-		       "%s (counter value %u)\n", chan, info->flags, info->seq_num,
-		       info->ts, buf->len, data_str, count);
+	if ((info->flags & BT_ISO_FLAGS_VALID) && atomic_cas(&resync_audio_wait, 1, 0)) {
+		resync_audio_us = local_us() - resync_loss_us;
+		k_work_submit(&resync_work);
 	}
 
-	iso_recv_count++;
+#if defined(CONFIG_ISO_JITTER_BUFFER)
+	jitter_buf_put(ARRAY_INDEX(bis_iso_chan, chan), info, buf);
+#elif defined(CONFIG_ISO_AUDIO_DECODE)
+	/* Enkel kopiëren, decoderen gebeurt in de decoder thread */
+	audio_dec_put(ARRAY_INDEX(bis_iso_chan, chan), info->seq_num,
+		      (info->flags & BT_ISO_FLAGS_VALID) != 0U, buf->data, buf->len,
+		      AUDIO_DEC_GAIN_ONE, AUDIO_DEC_GAIN_ONE);
+#endif /* CONFIG_ISO_JITTER_BUFFER */
 }
 
 static void iso_connected(struct bt_iso_chan *chan)
 {
 	printk("ISO Channel %p connected\n", chan);
-	k_sem_give(&sem_big_sync);
+	atomic_inc(&bis_connected);
+	rx_sm_post(RX_EVT_BIS_CONNECTED);
 }
 
 static void iso_disconnected(struct bt_iso_chan *chan, uint8_t reason)
 {
-	printk("ISO Channel %p disconnected with reason 0x%02x\n", chan, reason);
+	if (reason == BT_HCI_ERR_TERM_DUE_TO_MIC_FAIL) {
+		/* Verkeerde Broadcast Code */
+		mic_fail_count++;
+	}
+
+	/* Geen printk in de Bluetooth context, de trace thread print dit */
+	trace_iso_disconnected(ARRAY_INDEX(bis_iso_chan, chan), reason, mic_fail_count);
 
-	if (reason != BT_HCI_ERR_OP_CANCELLED_BY_HOST) {
-		k_sem_give(&sem_big_sync_lost);
+	/* bt_iso_big_terminate() meldt de BIS synchroon met LOCALHOST_TERM_CONN,
+	 * dat verlies heeft de toestandsmachine zelf veroorzaakt
+	 */
+	if (reason != BT_HCI_ERR_OP_CANCELLED_BY_HOST &&
+	    reason != BT_HCI_ERR_LOCALHOST_TERM_CONN) {
+		atomic_inc(&bis_lost);
+		rx_sm_post(RX_EVT_BIS_LOST);
 	}
 }
 
@@ -241,203 +559,670 @@ static struct bt_iso_chan_ops iso_ops = {
 	.disconnected	= iso_disconnected,
 };
 
-static struct bt_iso_chan_io_qos iso_rx_qos[BIS_ISO_CHAN_COUNT];
-
-static struct bt_iso_chan_qos bis_iso_qos[] = {
-	{ .rx = &iso_rx_qos[0], },
-	{ .rx = &iso_rx_qos[1], },
-};
-
-static struct bt_iso_chan bis_iso_chan[] = {
-	{ .ops = &iso_ops,
-	  .qos = &bis_iso_qos[0], },
-	{ .ops = &iso_ops,
-	  .qos = &bis_iso_qos[1], },
-};
-
-static struct bt_iso_chan *bis[] = {
-	&bis_iso_chan[0],
-	&bis_iso_chan[1],
-};
+static struct bt_iso_chan_io_qos iso_rx_qos[BIS_ISO_CHAN_MAX];
+static struct bt_iso_chan_qos bis_iso_qos[BIS_ISO_CHAN_MAX];
+static struct bt_iso_chan *bis[BIS_ISO_CHAN_MAX];
 
+/* num_bis, bis_bitfield en mse worden voor elke BIG sync door bis_select gekozen */
 static struct bt_iso_big_sync_param big_sync_param = {
 	.bis_channels = bis,
-	.num_bis = BIS_ISO_CHAN_COUNT,
-	.bis_bitfield = (BIT_MASK(BIS_ISO_CHAN_COUNT) << 1),
+	.num_bis = BIS_ISO_CHAN_MAX,
+	.bis_bitfield = BIT_MASK(BIS_ISO_CHAN_MAX),
 	.mse = BT_ISO_SYNC_MSE_ANY, /* any number of subevents, controller chooses*/
 	.sync_timeout = 100, /* in 10 ms units */
 };
 
-/* Zorgt ervoor dat alle semoforen unavailable zijn */
-static void reset_semaphores(void)
+static void bis_chans_init(void)
 {
-	k_sem_reset(&sem_per_adv);
-	k_sem_reset(&sem_per_sync);
-	k_sem_reset(&sem_per_sync_lost);
-	k_sem_reset(&sem_per_big_info);
-	k_sem_reset(&sem_big_sync);
-	k_sem_reset(&sem_big_sync_lost);
+	for (uint8_t i = 0U; i < BIS_ISO_CHAN_MAX; i++) {
+		bis_iso_qos[i].rx = &iso_rx_qos[i];
+		bis_iso_chan[i].ops = &iso_ops;
+		bis_iso_chan[i].qos = &bis_iso_qos[i];
+		bis[i] = &bis_iso_chan[i];
+	}
 }
 
-int main(void)
+static void rx_sm_timeout(k_timeout_t timeout)
 {
-	struct bt_le_per_adv_sync_param sync_create_param;
-	struct bt_le_per_adv_sync *sync;
-	struct bt_iso_big *big;
-	uint32_t sem_timeout_us;
+	rx_deadline = sys_timepoint_calc(timeout);
+	(void)k_work_reschedule_for_queue(&rx_sm_workq, &rx_timeout_work, timeout);
+}
+
+/* Tijd per toestand van de laatste acquisitie en over alle acquisities */
+static void rx_sm_acquired(void)
+{
+	uint32_t total_us = 0U;
+
+	for (uint8_t state = 0U; state < RX_STATE_COUNT; state++) {
+		total_us += rx_acquire_us[state];
+	}
+
+	printk("Acquired in %u ms:", total_us / USEC_PER_MSEC);
+	for (uint8_t state = 0U; state < RX_STATE_COUNT; state++) {
+		if (rx_acquire_us[state]) {
+			printk(" %s %u ms", rx_state_str[state],
+			       rx_acquire_us[state] / USEC_PER_MSEC);
+		}
+		rx_acquire_us[state] = 0U;
+	}
+	printk("\n");
+
+	for (uint8_t state = 0U; state < RX_STATE_COUNT; state++) {
+		struct time_stat *stat = &rx_state_stats[state];
+
+		if (!stat->count || state == RX_STATE_STREAMING) {
+			continue;
+		}
+
+		printk("State %s: last %u ms, min %u max %u avg %u ms over %u\n",
+		       rx_state_str[state], stat->last_us / USEC_PER_MSEC,
+		       stat->min_us / USEC_PER_MSEC, stat->max_us / USEC_PER_MSEC,
+		       (uint32_t)(stat->sum_us / stat->count / USEC_PER_MSEC),
+		       stat->count);
+	}
+}
+
+/* Overgang naar state, met tijdstempel en de tijd in de vorige toestand */
+static void rx_sm_set(enum rx_state state, k_timeout_t timeout)
+{
+	uint32_t now = local_us();
+	uint32_t spent_us = now - rx_state_us;
+
+	if (rx_state != RX_STATE_IDLE) {
+		time_stat_add(&rx_state_stats[rx_state], spent_us);
+		if (rx_state != RX_STATE_STREAMING) {
+			rx_acquire_us[rx_state] += spent_us;
+		}
+	}
+
+	printk("[%u ms] %s -> %s after %u ms\n", k_uptime_get_32(),
+	       rx_state_str[rx_state], rx_state_str[state], spent_us / USEC_PER_MSEC);
+
+	rx_state = state;
+	rx_state_us = now;
+	rx_sm_timeout(timeout);
+
+	if (state == RX_STATE_STREAMING) {
+		rx_sm_acquired();
+	}
+}
+
+static void rx_acquire(void);
+static void rx_recover(bool big_failed);
+
+static void rx_retry(bool scan)
+{
+	rx_retry_scan = scan;
+	rx_sm_set(RX_STATE_RETRY, K_MSEC(CONFIG_ISO_RX_RETRY_MS));
+}
+
+static void pa_sync_delete(void)
+{
+	struct bt_le_per_adv_sync *sync = big_pa_sync;
 	int err;
 
-	iso_recv_count = 0;
+	big_pa_sync = NULL;
 
-	printk("Starting Synchronized Receiver Demo\n");
+	printk("Deleting Periodic Advertising Sync...");
+	err = bt_le_per_adv_sync_delete(sync);
+	if (err) {
+		printk("failed (err %d)\n", err);
+		return;
+	}
+	printk("done.\n");
+}
 
-	/* Initialize the Bluetooth Subsystem */
-	err = bt_enable(NULL);
+static void big_sync_create(void)
+{
+	struct bis_select bis_sel;
+	int err;
+
+	err = bis_select(&big_params, BIS_ISO_CHAN_MAX, &bis_sel);
 	if (err) {
-		printk("Bluetooth init failed (err %d)\n", err);
-		return 0;
+		printk("No BIS to sync to (err %d)\n", err);
+		rx_retry(false);
+		return;
+	}
+	bis_count = bis_sel.count;
+	big_sync_param.num_bis = bis_sel.count;
+	big_sync_param.bis_bitfield = bis_sel.bitfield;
+	big_sync_param.mse = bis_sel.mse;
+
+	big_sync_param.encryption = big_encrypted;
+	if (big_encrypted && !broadcast_code_get(big_sync_param.bcode)) {
+		/* Wacht tot er een Broadcast Code ingesteld wordt */
+		printk("BIG is encrypted, set a Broadcast Code\n");
+		rx_retry(false);
+		return;
 	}
 
-	printk("Scan callbacks register...");
-	bt_le_scan_cb_register(&scan_callbacks);
+	/* bis_lost telt enkel de BIS van deze BIG, gebeurtenissen van een vorige
+	 * BIG die nog niet verwerkt zijn vervallen
+	 */
+	atomic_clear(&bis_connected);
+	atomic_clear(&bis_lost);
+	atomic_clear_bit(&rx_events, RX_EVT_BIS_CONNECTED);
+	atomic_clear_bit(&rx_events, RX_EVT_BIS_LOST);
+
+	printk("Create BIG Sync...");
+	err = bt_iso_big_sync(big_pa_sync, &big_sync_param, &rx_big);
+	if (err) {
+		printk("failed (err %d)\n", err);
+		rx_big = NULL;
+		rx_retry(false);
+		return;
+	}
 	printk("success.\n");
 
-	printk("Periodic Advertising callbacks register...");
-	bt_le_per_adv_sync_cb_register(&sync_callbacks);
-	printk("Success.\n");
+	printk("Waiting for BIG sync...\n");
+	rx_sm_set(RX_STATE_BIG_SYNC, TIMEOUT_SYNC_CREATE);
+}
 
-	do {
-		reset_semaphores();
-		per_adv_lost = false;
+static void big_sync_failed(bool terminate)
+{
+	int err;
 
-		printk("Start scanning...");
-		err = bt_le_scan_start(BT_LE_SCAN_CUSTOM, NULL);
-		if (err) {
-			printk("failed (err %d)\n", err);
-			return 0;
-		}
-		printk("success.\n");
+	printk("BIG sync failed.\n");
 
-		printk("Waiting for periodic advertising...\n");
-		per_adv_found = false;
-		/* zal oneindig lang wachten tot callback scan_recv opgeroepen wordt en deze de sem_per_adv semafoor vrijgeeft*/
-		err = k_sem_take(&sem_per_adv, K_FOREVER);
+	if (terminate) {
+		printk("BIG Sync Terminate...");
+		err = bt_iso_big_terminate(rx_big);
 		if (err) {
 			printk("failed (err %d)\n", err);
-			return 0;
+		} else {
+			printk("done.\n");
 		}
-		printk("Found periodic advertising.\n");
+	}
+	rx_big = NULL;
 
-		printk("Stop scanning...");
-		err = bt_le_scan_stop();
-		if (err) {
-			printk("failed (err %d)\n", err);
-			return 0;
-		}
-		printk("success.\n");
-
-		printk("Creating Periodic Advertising Sync...");
-		/* kopieer adress van BLE broadcaster naar lokale variabele in main */
-		bt_addr_le_copy(&sync_create_param.addr, &per_addr);
-		sync_create_param.options = 0;
-		sync_create_param.sid = per_sid;
-		sync_create_param.skip = 0;
-		/* Multiple PA interval with retry count and convert to unit of 10 ms */
-		sync_create_param.timeout = (per_interval_us * PA_RETRY_COUNT) /
-						(10 * USEC_PER_MSEC);
-		sem_timeout_us = per_interval_us * PA_RETRY_COUNT;
-		err = bt_le_per_adv_sync_create(&sync_create_param, &sync);
-		if (err) {
-			printk("failed (err %d)\n", err);
-			return 0;
-		}
-		printk("success.\n");
+#if defined(CONFIG_ISO_FAST_RESYNC)
+	resync_fail();
+#endif /* CONFIG_ISO_FAST_RESYNC */
 
-		printk("Waiting for periodic sync...\n");
-		err = k_sem_take(&sem_per_sync, K_USEC(sem_timeout_us));
-		if (err) {
-			printk("failed (err %d)\n", err);
+	rx_recover(true);
+}
 
-			printk("Deleting Periodic Advertising Sync...");
-			err = bt_le_per_adv_sync_delete(sync);
-			if (err) {
-				printk("failed (err %d)\n", err);
-				return 0;
-			}
-			continue;
+static void big_synced(void)
+{
+	printk("BIG sync established.\n");
+
+#if defined(CONFIG_ISO_FAST_RESYNC)
+	resync_cache();
+#endif /* CONFIG_ISO_FAST_RESYNC */
+
+#if defined(CONFIG_ISO_MULTI_SOURCE)
+	int err = sources_standby_start();
+
+	if (err && err != -ENOENT) {
+		printk("Standby PA sync failed (err %d)\n", err);
+	}
+#endif /* CONFIG_ISO_MULTI_SOURCE */
+
+	if (resync_loss_pending) {
+		resync_loss_pending = false;
+		resync_audio_path = resync_path;
+		atomic_set(&resync_audio_wait, 1);
+	}
+
+	rx_stats_reset(bis_count, big_sdu_interval_us);
+
+#if defined(CONFIG_ISO_ASRC)
+	drift_reset(big_sdu_interval_us);
+#endif /* CONFIG_ISO_ASRC */
+
+#if defined(CONFIG_ISO_LATENCY)
+	latency_reset(big_sdu_interval_us);
+#endif /* CONFIG_ISO_LATENCY */
+
+#if defined(CONFIG_ISO_AUDIO_DECODE)
+	audio_dec_start(bis_count);
+#endif /* CONFIG_ISO_AUDIO_DECODE */
+
+#if defined(CONFIG_ISO_JITTER_BUFFER)
+	jitter_buf_start(bis_count, big_sdu_interval_us, playout);
+#endif /* CONFIG_ISO_JITTER_BUFFER */
+
+	sdu_count_last = atomic_get(&sdu_count);
+	rx_sm_set(RX_STATE_STREAMING, K_MSEC(CONFIG_ISO_RX_STREAM_TIMEOUT_MS));
+}
+
+static void big_lost(void)
+{
+	printk("BIG sync lost.\n");
+	rx_big = NULL;
+
+	atomic_clear(&resync_audio_wait);
+	resync_loss_us = local_us();
+	resync_loss_pending = true;
+
+#if defined(CONFIG_ISO_JITTER_BUFFER)
+	jitter_buf_stop();
+#endif /* CONFIG_ISO_JITTER_BUFFER */
+
+	rx_recover(false);
+}
+
+/* Watchdog: de controller meldt het verlies normaal na de sync timeout */
+static void stream_check(void)
+{
+	atomic_val_t count = atomic_get(&sdu_count);
+	int err;
+
+	if (count != sdu_count_last) {
+		sdu_count_last = count;
+		rx_sm_timeout(K_MSEC(CONFIG_ISO_RX_STREAM_TIMEOUT_MS));
+		return;
+	}
+
+	printk("No SDUs for %u ms, BIG Sync Terminate...", CONFIG_ISO_RX_STREAM_TIMEOUT_MS);
+	err = bt_iso_big_terminate(rx_big);
+	if (err) {
+		printk("failed (err %d)\n", err);
+	} else {
+		printk("done.\n");
+	}
+
+	big_lost();
+}
+
+/* Na een verlies of een mislukte BIG sync: standby bron, enkel de BIG sync of
+ * een nieuwe acquisitie als de PA sync ook weg is.
+ */
+static void rx_recover(bool big_failed)
+{
+	printk("Check for periodic sync lost...\n");
+
+#if defined(CONFIG_ISO_MULTI_SOURCE)
+	if (per_adv_lost || big_failed) {
+		/* Bron weg of BIG sync mislukt: BIG sync op de standby bron */
+		struct sources_info source;
+		struct bt_le_per_adv_sync *standby_sync = sources_failover(per_adv_lost, &source);
+
+		if (standby_sync) {
+			printk("Failover to standby source SID %u\n", source.sid);
+			/* BASE van de nieuwe bron volgt met de volgende PA rapporten */
+			bis_select_base_reset();
+			big_pa_sync = standby_sync;
+			big_params.num_bis = source.num_bis;
+			big_params.nse = source.nse;
+			big_params.bn = source.bn;
+			big_params.irc = source.irc;
+			big_params.max_sdu = source.max_sdu;
+			bt_addr_le_copy(&per_addr, &source.addr);
+			per_sid = source.sid;
+			per_interval_us = source.interval_us;
+			big_encrypted = source.encrypted;
+			big_sdu_interval_us = source.sdu_interval_us;
+
+			per_adv_lost = false;
+#if defined(CONFIG_ISO_FAST_RESYNC)
+			/* Opnieuw cachen voor de nieuwe bron */
+			resync_cached = false;
+#endif /* CONFIG_ISO_FAST_RESYNC */
+			resync_path = RESYNC_PATH_STANDBY;
+			sources_print();
+			big_sync_create();
+			return;
 		}
-		printk("Periodic sync established.\n");
+	}
+#endif /* CONFIG_ISO_MULTI_SOURCE */
 
-		printk("Waiting for BIG info...\n");
-		err = k_sem_take(&sem_per_big_info, K_USEC(sem_timeout_us));
-		if (err) {
-			printk("failed (err %d)\n", err);
+	if (!per_adv_lost) {
+		/* Periodic Sync active, go back to creating BIG Sync */
+		resync_path = RESYNC_PATH_BIG;
+		big_sync_create();
+		return;
+	}
 
-			if (per_adv_lost) {
-				continue;
-			}
+	printk("Periodic sync lost.\n");
+	rx_acquire();
+}
 
-			printk("Deleting Periodic Advertising Sync...");
-			err = bt_le_per_adv_sync_delete(sync);
-			if (err) {
-				printk("failed (err %d)\n", err);
-				return 0;
-			}
-			continue;
+static void pa_sync_create(void)
+{
+	struct bt_le_per_adv_sync_param sync_create_param = { 0 };
+	struct bt_le_per_adv_sync *sync;
+	int err;
+
+#if defined(CONFIG_ISO_FAST_RESYNC)
+	if (resync_path == RESYNC_PATH_FAST && resync_pa_list) {
+		sync_create_param.options = BT_LE_PER_ADV_SYNC_OPT_USE_PER_ADV_LIST;
+	}
+#endif /* CONFIG_ISO_FAST_RESYNC */
+
+	printk("Creating Periodic Advertising Sync...");
+	/* kopieer adress van BLE broadcaster naar de sync parameters */
+	bt_addr_le_copy(&sync_create_param.addr, &per_addr);
+	sync_create_param.sid = per_sid;
+	sync_create_param.skip = 0;
+	/* Multiple PA interval with retry count and convert to unit of 10 ms */
+	sync_create_param.timeout = (per_interval_us * PA_RETRY_COUNT) /
+					(10 * USEC_PER_MSEC);
+	bis_select_base_reset();
+	err = bt_le_per_adv_sync_create(&sync_create_param, &sync);
+	if (err) {
+		printk("failed (err %d)\n", err);
+
+#if defined(CONFIG_ISO_FAST_RESYNC)
+		resync_fail();
+#endif /* CONFIG_ISO_FAST_RESYNC */
+
+		rx_retry(true);
+		return;
+	}
+	big_pa_sync = sync;
+	printk("success.\n");
+
+	printk("Waiting for periodic sync...\n");
+	rx_sm_set(RX_STATE_PA_SYNC, K_USEC(per_interval_us * PA_RETRY_COUNT));
+}
+
+static void pa_synced(void)
+{
+	printk("Periodic sync established.\n");
+
+#if defined(CONFIG_ISO_MULTI_SOURCE)
+	sources_active_set(big_pa_sync, &per_addr, per_sid, per_interval_us);
+#endif /* CONFIG_ISO_MULTI_SOURCE */
+
+	if (resync_path == RESYNC_PATH_FAST) {
+		/* BIGInfo van de vorige sync, BIG sync meteen aanvragen */
+		printk("Using cached BIG info.\n");
+		big_sync_create();
+		return;
+	}
+
+	printk("Waiting for BIG info...\n");
+	rx_sm_set(RX_STATE_BIGINFO, K_USEC(per_interval_us * PA_RETRY_COUNT));
+}
+
+/* Timeout of verlies tijdens het wachten op de PA sync */
+static void pa_sync_failed(bool timeout)
+{
+	printk("Periodic sync failed.\n");
+
+#if defined(CONFIG_ISO_FAST_RESYNC)
+	resync_fail();
+#endif /* CONFIG_ISO_FAST_RESYNC */
+
+	if (timeout) {
+		pa_sync_delete();
+	}
+
+	rx_acquire();
+}
+
+static void scan_done(void)
+{
+	int err;
+
+	printk("Stop scanning...");
+	err = bt_le_scan_stop();
+	if (err) {
+		printk("failed (err %d)\n", err);
+		rx_retry(true);
+		return;
+	}
+	printk("success.\n");
+
+#if defined(CONFIG_ISO_MULTI_SOURCE)
+	struct sources_info source;
+
+	if (sources_best(&source)) {
+		bt_addr_le_copy(&per_addr, &source.addr);
+		per_sid = source.sid;
+		per_interval_us = source.interval_us;
+	}
+	sources_print();
+#endif /* CONFIG_ISO_MULTI_SOURCE */
+
+	pa_sync_create();
+}
+
+static void scan_found(void)
+{
+	printk("Found periodic advertising.\n");
+	scan_filter_stats_print();
+
+#if defined(CONFIG_ISO_MULTI_SOURCE)
+	/* Verder scannen om andere bronnen te vinden en te rangschikken */
+	rx_sm_set(RX_STATE_DISCOVER, K_MSEC(CONFIG_ISO_SOURCE_DISCOVERY_MS));
+#else
+	scan_done();
+#endif /* CONFIG_ISO_MULTI_SOURCE */
+}
+
+static void scan_start(void)
+{
+	int err;
+
+	per_adv_found = false;
+
+	printk("Start scanning...");
+	err = bt_le_scan_start(BT_LE_SCAN_CUSTOM, NULL);
+	if (err) {
+		printk("failed (err %d)\n", err);
+		rx_retry(true);
+		return;
+	}
+	printk("success.\n");
+
+	printk("Waiting for periodic advertising...\n");
+	rx_sm_set(RX_STATE_SCAN, K_MSEC(CONFIG_ISO_RX_SCAN_TIMEOUT_MS));
+}
+
+/* Geen periodieke advertentie gevonden, de scan opnieuw starten */
+static void scan_restart(void)
+{
+	printk("No periodic advertising found.\n");
+	scan_filter_stats_print();
+
+	(void)bt_le_scan_stop();
+	scan_start();
+}
+
+/* Nieuwe acquisitie: fast resync naar de gecachte bron of een volledige scan */
+static void rx_acquire(void)
+{
+	per_adv_lost = false;
+	big_pa_sync = NULL;
+	resync_path = RESYNC_PATH_SCAN;
+
+#if defined(CONFIG_ISO_MULTI_SOURCE)
+	/* Geen failover mogelijk, de standby sync zou de nieuwe PA sync blokkeren */
+	sources_standby_stop();
+#endif /* CONFIG_ISO_MULTI_SOURCE */
+
+#if defined(CONFIG_ISO_FAST_RESYNC)
+	if (resync_cached) {
+		resync_path = RESYNC_PATH_FAST;
+		printk("Fast resync to cached periodic advertiser, attempt %u\n",
+		       resync_fail_count + 1U);
+		pa_sync_create();
+		return;
+	}
+#endif /* CONFIG_ISO_FAST_RESYNC */
+
+	scan_start();
+}
+
+static void rx_sm_handle(enum rx_evt evt)
+{
+	switch (rx_state) {
+	case RX_STATE_IDLE:
+		if (evt == RX_EVT_START) {
+			rx_acquire();
 		}
-		printk("Periodic sync established.\n");
+		break;
 
-big_sync_create:
-		printk("Create BIG Sync...\n");
-		err = bt_iso_big_sync(sync, &big_sync_param, &big);
-		if (err) {
-			printk("failed (err %d)\n", err);
-			return 0;
+	case RX_STATE_SCAN:
+		if (evt == RX_EVT_PER_ADV) {
+			scan_found();
+		} else if (evt == RX_EVT_TIMEOUT) {
+			scan_restart();
 		}
-		printk("success.\n");
+		break;
 
-		for (uint8_t chan = 0U; chan < BIS_ISO_CHAN_COUNT; chan++) {
-			printk("Waiting for BIG sync chan %u...\n", chan);
-			err = k_sem_take(&sem_big_sync, TIMEOUT_SYNC_CREATE);
-			if (err) {
-				break;
-			}
-			printk("BIG sync chan %u successful.\n", chan);
+	case RX_STATE_DISCOVER:
+		if (evt == RX_EVT_TIMEOUT) {
+			scan_done();
 		}
-		if (err) {
-			printk("failed (err %d)\n", err);
+		break;
 
-			printk("BIG Sync Terminate...");
-			err = bt_iso_big_terminate(big);
-			if (err) {
-				printk("failed (err %d)\n", err);
-				return 0;
+	case RX_STATE_PA_SYNC:
+		if (evt == RX_EVT_PA_SYNCED) {
+			pa_synced();
+		} else if (evt == RX_EVT_PA_LOST || evt == RX_EVT_TIMEOUT) {
+			pa_sync_failed(evt == RX_EVT_TIMEOUT);
+		}
+		break;
+
+	case RX_STATE_BIGINFO:
+		if (evt == RX_EVT_BIGINFO) {
+			printk("BIG info received.\n");
+			big_sync_create();
+		} else if (evt == RX_EVT_PA_LOST) {
+			printk("Periodic sync lost.\n");
+			rx_acquire();
+		} else if (evt == RX_EVT_TIMEOUT) {
+			printk("No BIG info.\n");
+			pa_sync_delete();
+			rx_acquire();
+		}
+		break;
+
+	case RX_STATE_BIG_SYNC:
+		if (evt == RX_EVT_BIS_CONNECTED) {
+			if (atomic_get(&bis_connected) >= bis_count) {
+				big_synced();
 			}
-			printk("done.\n");
+		} else if (evt == RX_EVT_BIS_LOST) {
+			/* Enkel een BIS van de huidige BIG, de host heeft die BIG
+			 * dan al vrijgegeven
+			 */
+			if (rx_big && atomic_get(&bis_lost) > 0) {
+				big_sync_failed(false);
+			}
+		} else if (evt == RX_EVT_PA_LOST) {
+			/* De BIG sync gaat door zonder PA sync */
+			per_adv_lost = true;
+		} else if (evt == RX_EVT_TIMEOUT) {
+			big_sync_failed(true);
+		}
+		break;
 
-			goto per_sync_lost_check;
+	case RX_STATE_STREAMING:
+		if (evt == RX_EVT_BIS_LOST) {
+			if (atomic_get(&bis_lost) >= bis_count) {
+				big_lost();
+			}
+		} else if (evt == RX_EVT_PA_LOST) {
+			printk("Periodic sync lost, BIG sync continues.\n");
+			per_adv_lost = true;
+		} else if (evt == RX_EVT_TIMEOUT) {
+			stream_check();
 		}
-		printk("BIG sync established.\n");
-
-		for (uint8_t chan = 0U; chan < BIS_ISO_CHAN_COUNT; chan++) {
-			printk("Waiting for BIG sync lost chan %u...\n", chan);
-			/* Zolang de synchronistaie niet verloren gaat zal er hier gewacht worden en zal bij elke iso_recv data naar de console geprint worden */
-			err = k_sem_take(&sem_big_sync_lost, K_FOREVER);
-			if (err) {
-				printk("failed (err %d)\n", err);
-				return 0;
+		break;
+
+	case RX_STATE_RETRY:
+		if (evt == RX_EVT_PA_LOST) {
+			per_adv_lost = true;
+			if (!rx_retry_scan) {
+				rx_recover(false);
+			}
+		} else if (evt == RX_EVT_TIMEOUT) {
+			if (rx_retry_scan) {
+				rx_acquire();
+			} else {
+				rx_recover(false);
 			}
-			printk("BIG sync lost chan %u.\n", chan);
 		}
-		printk("BIG sync lost.\n");
+		break;
 
-per_sync_lost_check:
-		printk("Check for periodic sync lost...\n");
-		err = k_sem_take(&sem_per_sync_lost, K_NO_WAIT);
-		if (err) {
-			/* Periodic Sync active, go back to creating BIG Sync */
-			goto big_sync_create;
+	default:
+		break;
+	}
+}
+
+static void rx_sm_event(struct k_work *work)
+{
+	atomic_val_t events = atomic_clear(&rx_events);
+
+	for (uint8_t evt = 0U; evt < RX_EVT_COUNT; evt++) {
+		if (events & BIT(evt)) {
+			rx_sm_handle(evt);
 		}
-		printk("Periodic sync lost.\n");
-	} while (true);
+	}
+}
+
+static void rx_sm_expire(struct k_work *work)
+{
+	/* Al ingediend voor de timeout verschoven werd */
+	if (!sys_timepoint_expired(rx_deadline)) {
+		return;
+	}
+
+	rx_sm_handle(RX_EVT_TIMEOUT);
+}
+
+int main(void)
+{
+	const struct k_work_queue_config rx_sm_cfg = {
+		.name = "rx_sm",
+	};
+	int err;
+
+	atomic_clear(&iso_recv_count);
+	bis_chans_init();
+
+	printk("Starting Synchronized Receiver Demo\n");
+
+#if defined(CONFIG_ISO_SCAN_FILTER_BENCH)
+	scan_filter_bench();
+#endif /* CONFIG_ISO_SCAN_FILTER_BENCH */
+
+#if defined(CONFIG_ISO_ASRC_BENCH)
+	asrc_bench();
+#endif /* CONFIG_ISO_ASRC_BENCH */
+
+	err = scan_filter_init();
+	if (err) {
+		return 0;
+	}
+
+#if defined(CONFIG_ISO_AUDIO_DECODE)
+	err = audio_dec_init();
+	if (err) {
+		printk("Audio decoder init failed (err %d)\n", err);
+		return 0;
+	}
+#endif /* CONFIG_ISO_AUDIO_DECODE */
+
+	/* De toestandsmachine draait op de prioriteit van main, main zelf is vrij */
+	k_work_queue_start(&rx_sm_workq, rx_sm_stack, K_THREAD_STACK_SIZEOF(rx_sm_stack),
+			   CONFIG_MAIN_THREAD_PRIORITY, &rx_sm_cfg);
+
+	/* Initialize the Bluetooth Subsystem */
+	err = bt_enable(NULL);
+	if (err) {
+		printk("Bluetooth init failed (err %d)\n", err);
+		return 0;
+	}
+
+	printk("Scan callbacks register...");
+	bt_le_scan_cb_register(&scan_callbacks);
+	printk("success.\n");
+
+	printk("Periodic Advertising callbacks register...");
+	bt_le_per_adv_sync_cb_register(&sync_callbacks);
+	printk("Success.\n");
+
+#if defined(CONFIG_ISO_MULTI_SOURCE)
+	/* Een bron met minstens een BIS is bruikbaar, bis_select kiest verder */
+	sources_init(1U);
+#endif /* CONFIG_ISO_MULTI_SOURCE */
+
+	rx_sm_post(RX_EVT_START);
+
+	return 0;
 }
@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdlib.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/iso.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/printk.h>
+
+#include "rx_stats.h"
+
+#define CHAN_MAX CONFIG_BT_ISO_MAX_CHAN
+
+struct rx_chan_stats {
+	atomic_t received;
+	atomic_t lost;
+	atomic_t error;
+	atomic_t gap;
+	atomic_t duplicate;
+	/* Inter-arrival jitter: deviation of the arrival interval from the SDU
+	 * interval (us)
+	 */
+	atomic_t jitter_min;
+	atomic_t jitter_max;
+	atomic_t jitter_sum;
+	atomic_t jitter_count;
+	/* Change of (arrival time - SDU time stamp) since the first SDU (us),
+	 * i.e. how far the controller clock drifted from the local clock
+	 */
+	atomic_t ts_drift;
+
+	/* Only used by the writer */
+	bool started;
+	uint16_t last_seq;
+	uint32_t last_rx_us;
+	bool offset_valid;
+	uint32_t first_offset_us;
+};
+
+static struct rx_chan_stats stats[CHAN_MAX];
+/* Set by the shell, the writer of the BIS clears its statistics */
+static ATOMIC_DEFINE(reset_pending, CHAN_MAX);
+static uint8_t chan_count;
+static uint32_t sdu_interval_us;
+
+static uint32_t local_us(void)
+{
+	return (uint32_t)k_ticks_to_us_floor64(k_uptime_ticks());
+}
+
+static void chan_clear(struct rx_chan_stats *s)
+{
+	atomic_clear(&s->received);
+	atomic_clear(&s->lost);
+	atomic_clear(&s->error);
+	atomic_clear(&s->gap);
+	atomic_clear(&s->duplicate);
+	atomic_set(&s->jitter_min, INT32_MAX);
+	atomic_clear(&s->jitter_max);
+	atomic_clear(&s->jitter_sum);
+	atomic_clear(&s->jitter_count);
+	atomic_clear(&s->ts_drift);
+	s->started = false;
+	s->offset_valid = false;
+}
+
+void rx_stats_reset(uint8_t count, uint32_t interval_us)
+{
+	__ASSERT_NO_MSG(count <= CHAN_MAX);
+
+	chan_count = count;
+	sdu_interval_us = interval_us;
+
+	for (uint8_t i = 0U; i < count; i++) {
+		atomic_clear_bit(reset_pending, i);
+		chan_clear(&stats[i]);
+	}
+}
+
+void rx_stats_update(uint8_t chan, const struct bt_iso_recv_info *info)
+{
+	struct rx_chan_stats *s = &stats[chan];
+	uint32_t now = local_us();
+	int16_t step;
+
+	if (chan >= chan_count) {
+		return;
+	}
+
+	if (atomic_test_and_clear_bit(reset_pending, chan)) {
+		chan_clear(s);
+	}
+
+	atomic_inc(&s->received);
+
+	if (info->flags & BT_ISO_FLAGS_LOST) {
+		atomic_inc(&s->lost);
+	}
+
+	if (info->flags & BT_ISO_FLAGS_ERROR) {
+		atomic_inc(&s->error);
+	}
+
+	/* The reference is the first SDU that has a time stamp */
+	if (info->flags & BT_ISO_FLAGS_TS) {
+		if (!s->offset_valid) {
+			s->offset_valid = true;
+			s->first_offset_us = now - info->ts;
+		} else {
+			atomic_set(&s->ts_drift, (int32_t)(now - info->ts - s->first_offset_us));
+		}
+	}
+
+	if (!s->started) {
+		s->started = true;
+		s->last_seq = info->seq_num;
+		s->last_rx_us = now;
+		return;
+	}
+
+	step = (int16_t)(info->seq_num - s->last_seq);
+	if (step <= 0) {
+		atomic_inc(&s->duplicate);
+		return;
+	}
+
+	if (step > 1) {
+		atomic_add(&s->gap, step - 1);
+	}
+
+	/* Arrival interval compared to the SDU interval of the SDUs in between */
+	if (sdu_interval_us) {
+		int32_t jitter = abs((int32_t)(now - s->last_rx_us) -
+				     step * (int32_t)sdu_interval_us);
+
+		if (jitter < atomic_get(&s->jitter_min)) {
+			atomic_set(&s->jitter_min, jitter);
+		}
+		if (jitter > atomic_get(&s->jitter_max)) {
+			atomic_set(&s->jitter_max, jitter);
+		}
+		atomic_add(&s->jitter_sum, jitter);
+		atomic_inc(&s->jitter_count);
+	}
+
+	s->last_seq = info->seq_num;
+	s->last_rx_us = now;
+}
+
+void rx_stats_get(uint8_t chan, struct rx_stats_counts *counts)
+{
+	struct rx_chan_stats *s = &stats[chan];
+
+	counts->received = atomic_get(&s->received);
+	counts->lost = atomic_get(&s->lost);
+	counts->error = atomic_get(&s->error);
+	counts->gap = atomic_get(&s->gap);
+	counts->duplicate = atomic_get(&s->duplicate);
+}
+
+void rx_stats_print(void)
+{
+	for (uint8_t i = 0U; i < chan_count; i++) {
+		struct rx_chan_stats *s = &stats[i];
+		uint32_t count = atomic_get(&s->jitter_count);
+
+		printk("BIS %u: rx %ld lost %ld error %ld gap %ld dup %ld jitter %ld/%ld/%ld us "
+		       "drift %ld us\n", i, atomic_get(&s->received), atomic_get(&s->lost),
+		       atomic_get(&s->error), atomic_get(&s->gap), atomic_get(&s->duplicate),
+		       count ? atomic_get(&s->jitter_min) : 0,
+		       count ? atomic_get(&s->jitter_sum) / (atomic_val_t)count : 0,
+		       atomic_get(&s->jitter_max), atomic_get(&s->ts_drift));
+	}
+}
+
+#if CONFIG_ISO_STATS_SUMMARY_INTERVAL_S > 0
+static void summary_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(summary_work, summary_handler);
+
+static void summary_handler(struct k_work *work)
+{
+	rx_stats_print();
+	k_work_schedule(&summary_work, K_SECONDS(CONFIG_ISO_STATS_SUMMARY_INTERVAL_S));
+}
+
+static int summary_init(void)
+{
+	k_work_schedule(&summary_work, K_SECONDS(CONFIG_ISO_STATS_SUMMARY_INTERVAL_S));
+
+	return 0;
+}
+
+SYS_INIT(summary_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+#endif /* CONFIG_ISO_STATS_SUMMARY_INTERVAL_S > 0 */
+
+#if defined(CONFIG_SHELL)
+#include <zephyr/shell/shell.h>
+
+static int cmd_iso_stats(const struct shell *sh, size_t argc, char **argv)
+{
+	rx_stats_print();
+
+	return 0;
+}
+
+static int cmd_iso_stats_reset(const struct shell *sh, size_t argc, char **argv)
+{
+	/* The ISO recv callback owns the state of a BIS, it clears it with its
+	 * next SDU
+	 */
+	for (uint8_t i = 0U; i < chan_count; i++) {
+		atomic_set_bit(reset_pending, i);
+	}
+	shell_print(sh, "Statistics of %u BIS cleared with their next SDU", chan_count);
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(iso_stats_cmds,
+	SHELL_CMD(reset, NULL, "Clear the statistics", cmd_iso_stats_reset),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(iso_stats, &iso_stats_cmds, "Per BIS reception statistics", cmd_iso_stats);
+#endif /* CONFIG_SHELL */
@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef RX_STATS_H_
+#define RX_STATS_H_
+
+#include <stdint.h>
+
+#include <zephyr/bluetooth/iso.h>
+
+/* Per BIS reception statistics. rx_stats_update() is called from the ISO recv
+ * callback, one writer per BIS, and only updates atomic counters so the shell
+ * and the periodic summary can read them at any time.
+ */
+
+/* SDU counters of one BIS */
+struct rx_stats_counts {
+	uint32_t received;
+	/* Reported by the controller with BT_ISO_FLAGS_LOST */
+	uint32_t lost;
+	/* Reported by the controller with BT_ISO_FLAGS_ERROR */
+	uint32_t error;
+	/* Never reported at all: sequence numbers skipped between two SDUs */
+	uint32_t gap;
+	uint32_t duplicate;
+};
+
+/* Clear the statistics of count BIS with the given SDU interval, e.g. after
+ * a new BIG sync
+ */
+void rx_stats_reset(uint8_t count, uint32_t sdu_interval_us);
+
+void rx_stats_update(uint8_t chan, const struct bt_iso_recv_info *info);
+
+/* Snapshot of the counters of BIS chan */
+void rx_stats_get(uint8_t chan, struct rx_stats_counts *counts);
+
+/* One compact line per BIS */
+void rx_stats_print(void);
+
+#endif /* RX_STATS_H_ */
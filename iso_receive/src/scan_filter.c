@@ -0,0 +1,363 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/uuid.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/printk.h>
+
+#include "scan_filter.h"
+
+/* Broadcast Audio Announcement: 16-bit UUID followed by the 24-bit Broadcast ID */
+#define BROADCAST_ID_AD_LEN (BT_UUID_SIZE_16 + 3)
+#define BROADCAST_ID_ANY    -1
+
+struct scan_filter {
+	int8_t rssi_min;
+	bool addr_set;
+	bt_addr_t addr;
+	const char *name;
+	uint8_t name_len;
+	int32_t broadcast_id;
+};
+
+enum reject_reason {
+	REJECT_RSSI,
+	REJECT_ADDR,
+	REJECT_NAME,
+	REJECT_BROADCAST_ID,
+	REJECT_COUNT,
+};
+
+static const char *const reject_str[REJECT_COUNT] = {
+	"RSSI", "address", "name", "Broadcast ID",
+};
+
+static struct scan_filter filter = {
+	.rssi_min = CONFIG_ISO_SCAN_FILTER_RSSI_MIN,
+	.name = CONFIG_ISO_SCAN_FILTER_NAME,
+	.name_len = sizeof(CONFIG_ISO_SCAN_FILTER_NAME) - 1,
+	.broadcast_id = CONFIG_ISO_SCAN_FILTER_BROADCAST_ID,
+};
+
+/* Only updated from the scan callback */
+static uint32_t accept_count;
+static uint32_t reject_count[REJECT_COUNT];
+
+BUILD_ASSERT(sizeof(CONFIG_ISO_SCAN_FILTER_NAME) - 1 <= UINT8_MAX,
+	     "CONFIG_ISO_SCAN_FILTER_NAME too long");
+
+/* Walk the AD structures once and decide on the name and Broadcast ID as soon
+ * as they are found. Returns REJECT_COUNT when the report is accepted.
+ */
+static enum reject_reason ad_match(const struct scan_filter *f, const uint8_t *data,
+				   uint16_t len)
+{
+	bool name_ok = !f->name_len;
+	bool id_ok = f->broadcast_id == BROADCAST_ID_ANY;
+
+	while (!(name_ok && id_ok) && len > 1U) {
+		uint8_t field_len = data[0];
+		uint8_t type;
+
+		if (!field_len) {
+			/* Early termination of the AD data */
+			break;
+		}
+		if (field_len >= len) {
+			/* Malformed, treat what is left as missing */
+			break;
+		}
+
+		type = data[1];
+
+		switch (type) {
+		case BT_DATA_NAME_COMPLETE:
+			if (!name_ok) {
+				if (field_len - 1U != f->name_len ||
+				    memcmp(&data[2], f->name, f->name_len)) {
+					return REJECT_NAME;
+				}
+				name_ok = true;
+			}
+			break;
+		case BT_DATA_NAME_SHORTENED:
+			if (!name_ok) {
+				/* Shortened names are a prefix of the complete one */
+				if (field_len - 1U > f->name_len ||
+				    memcmp(&data[2], f->name, field_len - 1U)) {
+					return REJECT_NAME;
+				}
+				name_ok = true;
+			}
+			break;
+		case BT_DATA_SVC_DATA16:
+			if (!id_ok && field_len - 1U >= BROADCAST_ID_AD_LEN &&
+			    sys_get_le16(&data[2]) == BT_UUID_BROADCAST_AUDIO_VAL) {
+				if (sys_get_le24(&data[4]) != (uint32_t)f->broadcast_id) {
+					return REJECT_BROADCAST_ID;
+				}
+				id_ok = true;
+			}
+			break;
+		default:
+			break;
+		}
+
+		data += field_len + 1U;
+		len -= field_len + 1U;
+	}
+
+	if (!name_ok) {
+		return REJECT_NAME;
+	}
+	if (!id_ok) {
+		return REJECT_BROADCAST_ID;
+	}
+
+	return REJECT_COUNT;
+}
+
+static enum reject_reason filter_match(const struct scan_filter *f,
+				       const struct bt_le_scan_recv_info *info,
+				       const struct net_buf_simple *buf)
+{
+	if (info->rssi < f->rssi_min) {
+		return REJECT_RSSI;
+	}
+
+	if (f->addr_set && !bt_addr_eq(&info->addr->a, &f->addr)) {
+		return REJECT_ADDR;
+	}
+
+	return ad_match(f, buf->data, buf->len);
+}
+
+int scan_filter_init(void)
+{
+	int err;
+
+	if (!strlen(CONFIG_ISO_SCAN_FILTER_ADDR)) {
+		return 0;
+	}
+
+	err = bt_addr_from_str(CONFIG_ISO_SCAN_FILTER_ADDR, &filter.addr);
+	if (err) {
+		printk("Invalid scan filter address %s\n", CONFIG_ISO_SCAN_FILTER_ADDR);
+		return -EINVAL;
+	}
+	filter.addr_set = true;
+
+	return 0;
+}
+
+bool scan_filter_accept(const struct bt_le_scan_recv_info *info,
+			const struct net_buf_simple *buf)
+{
+	enum reject_reason reason = filter_match(&filter, info, buf);
+
+	if (reason != REJECT_COUNT) {
+		reject_count[reason]++;
+		return false;
+	}
+
+	accept_count++;
+
+	return true;
+}
+
+void scan_filter_stats_print(void)
+{
+	printk("Scan filter: accepted %u, rejected", accept_count);
+	for (uint8_t reason = 0U; reason < REJECT_COUNT; reason++) {
+		printk(" %s %u", reject_str[reason], reject_count[reason]);
+	}
+	printk("\n");
+}
+
+#if defined(CONFIG_ISO_SCAN_FILTER_BENCH)
+#include <zephyr/bluetooth/conn.h>
+
+#include "perf.h"
+
+#define BENCH_REPORTS    64
+#define BENCH_ROUNDS     100
+#define BENCH_ADV_LEN    31
+#define BENCH_NAME_LEN   30
+#define BENCH_LINE_LEN   256
+
+struct bench_report {
+	bt_addr_le_t addr;
+	struct bt_le_scan_recv_info info;
+	uint8_t data[BENCH_ADV_LEN];
+	uint8_t len;
+};
+
+static struct bench_report reports[BENCH_REPORTS];
+/* Output of the formatting, as printed per report before filtering */
+static char bench_line[BENCH_LINE_LEN];
+
+static uint8_t ad_put(uint8_t *data, uint8_t type, const void *value, uint8_t len)
+{
+	data[0] = len + 1U;
+	data[1] = type;
+	memcpy(&data[2], value, len);
+
+	return len + 2U;
+}
+
+/* A venue: mostly unrelated advertisers (flags and a name), every fourth one a
+ * broadcast source with a Broadcast Audio Announcement. Only one report is
+ * the source the bench filter looks for.
+ */
+static void bench_reports_init(void)
+{
+	for (uint8_t i = 0U; i < BENCH_REPORTS; i++) {
+		struct bench_report *r = &reports[i];
+		uint8_t flags = BT_LE_AD_NO_BREDR;
+		char name[16];
+		uint8_t name_len;
+
+		r->addr.type = BT_ADDR_LE_RANDOM;
+		for (uint8_t b = 0U; b < sizeof(r->addr.a.val); b++) {
+			r->addr.a.val[b] = (uint8_t)(i * 37U + b);
+		}
+
+		r->len = ad_put(r->data, BT_DATA_FLAGS, &flags, sizeof(flags));
+
+		if ((i % 4U) == 0U) {
+			uint8_t svc[BROADCAST_ID_AD_LEN];
+
+			sys_put_le16(BT_UUID_BROADCAST_AUDIO_VAL, &svc[0]);
+			sys_put_le24(0x100000U + i, &svc[2]);
+			r->len += ad_put(&r->data[r->len], BT_DATA_SVC_DATA16, svc, sizeof(svc));
+			r->info.interval = 0x50;
+		}
+
+		name_len = snprintk(name, sizeof(name), "Speaker %u", i);
+		r->len += ad_put(&r->data[r->len], BT_DATA_NAME_COMPLETE, name, name_len);
+
+		r->info.addr = &r->addr;
+		r->info.rssi = -40 - (int8_t)(i % 60U);
+		r->info.adv_type = BT_GAP_ADV_TYPE_EXT_ADV;
+		r->info.adv_props = BT_GAP_ADV_PROP_EXT_ADV;
+		r->info.primary_phy = BT_GAP_LE_PHY_1M;
+		r->info.secondary_phy = BT_GAP_LE_PHY_2M;
+		r->info.sid = i % 16U;
+	}
+}
+
+static bool bench_name_cb(struct bt_data *data, void *user_data)
+{
+	char *name = user_data;
+	uint8_t len;
+
+	switch (data->type) {
+	case BT_DATA_NAME_SHORTENED:
+	case BT_DATA_NAME_COMPLETE:
+		len = MIN(data->data_len, BENCH_NAME_LEN - 1);
+		memcpy(name, data->data, len);
+		name[len] = '\0';
+		return false;
+	default:
+		return true;
+	}
+}
+
+/* What every report cost before: parse the name, format the address and the
+ * report line. The line goes to a buffer, printing it costs more on top.
+ */
+static void bench_format(const struct bt_le_scan_recv_info *info,
+			 const struct net_buf_simple *buf)
+{
+	char le_addr[BT_ADDR_LE_STR_LEN];
+	char name[BENCH_NAME_LEN] = { 0 };
+	struct net_buf_simple ad = *buf;
+
+	bt_data_parse(&ad, bench_name_cb, name);
+	bt_addr_le_to_str(info->addr, le_addr, sizeof(le_addr));
+	snprintk(bench_line, sizeof(bench_line),
+		 "[DEVICE]: %s, AD evt type %u, Tx Pwr: %i, RSSI %i %s "
+		 "C:%u S:%u D:%u SR:%u E:%u Prim: %u, Secn: %u, "
+		 "Interval: 0x%04x (%u us), SID: %u\n",
+		 le_addr, info->adv_type, info->tx_power, info->rssi, name,
+		 (info->adv_props & BT_GAP_ADV_PROP_CONNECTABLE) != 0,
+		 (info->adv_props & BT_GAP_ADV_PROP_SCANNABLE) != 0,
+		 (info->adv_props & BT_GAP_ADV_PROP_DIRECTED) != 0,
+		 (info->adv_props & BT_GAP_ADV_PROP_SCAN_RESPONSE) != 0,
+		 (info->adv_props & BT_GAP_ADV_PROP_EXT_ADV) != 0,
+		 info->primary_phy, info->secondary_phy, info->interval,
+		 BT_CONN_INTERVAL_TO_US(info->interval), info->sid);
+}
+
+static uint32_t bench_run(const struct scan_filter *f, uint32_t *accepted)
+{
+	uint64_t total_ns = 0U;
+
+	*accepted = 0U;
+
+	/* Timed per round, perf_ns() only covers a few seconds */
+	for (uint32_t round = 0U; round < BENCH_ROUNDS; round++) {
+		perf_ts_t start = perf_now();
+
+		for (uint8_t i = 0U; i < BENCH_REPORTS; i++) {
+			struct net_buf_simple buf;
+
+			net_buf_simple_init_with_data(&buf, reports[i].data, reports[i].len);
+
+			if (f && filter_match(f, &reports[i].info, &buf) != REJECT_COUNT) {
+				continue;
+			}
+
+			bench_format(&reports[i].info, &buf);
+			(*accepted)++;
+		}
+
+		total_ns += perf_ns(start, perf_now());
+	}
+
+	return (uint32_t)(total_ns / (BENCH_ROUNDS * BENCH_REPORTS));
+}
+
+void scan_filter_bench(void)
+{
+	struct scan_filter by_name = {
+		.rssi_min = INT8_MIN,
+		.name = "Speaker 8",
+		.name_len = sizeof("Speaker 8") - 1,
+		.broadcast_id = BROADCAST_ID_ANY,
+	};
+	struct scan_filter by_id = {
+		.rssi_min = INT8_MIN,
+		.broadcast_id = 0x100008,
+	};
+	struct scan_filter by_rssi = {
+		.rssi_min = -50,
+		.broadcast_id = BROADCAST_ID_ANY,
+	};
+	uint32_t accepted;
+	uint32_t ns;
+
+	perf_init();
+	bench_reports_init();
+
+	printk("Scan filter benchmark, %u reports x %u rounds\n", BENCH_REPORTS,
+	       BENCH_ROUNDS);
+
+	ns = bench_run(NULL, &accepted);
+	printk("unfiltered:   %u ns per report, %u formatted\n", ns, accepted);
+	ns = bench_run(&by_rssi, &accepted);
+	printk("RSSI >= -50:  %u ns per report, %u formatted\n", ns, accepted);
+	ns = bench_run(&by_name, &accepted);
+	printk("name:         %u ns per report, %u formatted\n", ns, accepted);
+	ns = bench_run(&by_id, &accepted);
+	printk("Broadcast ID: %u ns per report, %u formatted\n", ns, accepted);
+}
+#endif /* CONFIG_ISO_SCAN_FILTER_BENCH */
@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef SCAN_FILTER_H_
+#define SCAN_FILTER_H_
+
+#include <stdbool.h>
+
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/net/buf.h>
+
+/* Accept filter for advertising reports, applied in the scan callback before
+ * anything is copied or formatted. The checks run from cheap to expensive:
+ * RSSI, address, then a single pass over the AD structures that stops as soon
+ * as the name and Broadcast ID have been decided.
+ */
+
+/* Load the filter from CONFIG_ISO_SCAN_FILTER_* */
+int scan_filter_init(void);
+
+bool scan_filter_accept(const struct bt_le_scan_recv_info *info,
+			const struct net_buf_simple *buf);
+
+/* Accepted reports and rejected reports per reason */
+void scan_filter_stats_print(void);
+
+#if defined(CONFIG_ISO_SCAN_FILTER_BENCH)
+/* Replay a dense set of advertising reports through the unfiltered report
+ * formatting and through the filter and print the cost per report.
+ */
+void scan_filter_bench(void);
+#endif /* CONFIG_ISO_SCAN_FILTER_BENCH */
+
+#endif /* SCAN_FILTER_H_ */
@@ -0,0 +1,496 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/iso.h>
+#include <zephyr/sys/printk.h>
+
+#include "broadcast_code.h"
+#include "sources.h"
+
+#define SOURCE_COUNT CONFIG_ISO_SOURCE_MAX
+/* Same as for the active sync in main */
+#define PA_RETRY_COUNT 6
+
+/* RSSI is averaged in 1/8 dB, new reports weigh 1/8 */
+#define RSSI_FRAC_BITS 3
+/* Score penalty per percent of periodic advertising events lost */
+#define SCORE_PER_LOSS_PCT 1
+/* Score bonus per retransmission of every BIS PDU (BIGInfo IRC) */
+#define SCORE_PER_IRC 3
+
+struct source {
+	bool used;
+	bt_addr_le_t addr;
+	uint8_t sid;
+	uint32_t interval_us;
+	int16_t rssi_avg;
+	uint32_t seen_us;
+
+	/* Active or standby PA sync to this source */
+	struct bt_le_per_adv_sync *sync;
+	bool synced;
+
+	/* Periodic advertising reports received and events missed in between */
+	uint32_t pa_last_us;
+	uint32_t pa_recv;
+	uint32_t pa_lost;
+
+	bool biginfo_valid;
+	uint8_t num_bis;
+	uint8_t nse;
+	uint8_t bn;
+	uint8_t irc;
+	uint16_t max_sdu;
+	bool encrypted;
+	uint32_t sdu_interval_us;
+};
+
+static struct source sources[SOURCE_COUNT];
+static struct source *active;
+static struct source *standby;
+static uint8_t num_bis_min;
+static struct k_spinlock sources_lock;
+
+static uint32_t failover_count;
+
+static uint32_t local_us(void)
+{
+	return (uint32_t)k_ticks_to_us_floor64(k_uptime_ticks());
+}
+
+static struct source *source_find(const bt_addr_le_t *addr, uint8_t sid)
+{
+	for (uint8_t i = 0U; i < SOURCE_COUNT; i++) {
+		if (sources[i].used && sources[i].sid == sid &&
+		    bt_addr_le_eq(&sources[i].addr, addr)) {
+			return &sources[i];
+		}
+	}
+
+	return NULL;
+}
+
+static struct source *source_by_sync(const struct bt_le_per_adv_sync *sync)
+{
+	for (uint8_t i = 0U; i < SOURCE_COUNT; i++) {
+		if (sources[i].used && sources[i].sync == sync) {
+			return &sources[i];
+		}
+	}
+
+	return NULL;
+}
+
+/* A free entry, or the one not heard from the longest that has no sync */
+static struct source *source_alloc(void)
+{
+	struct source *oldest = NULL;
+
+	for (uint8_t i = 0U; i < SOURCE_COUNT; i++) {
+		struct source *s = &sources[i];
+
+		if (!s->used) {
+			return s;
+		}
+
+		if (s->sync || s == active) {
+			continue;
+		}
+
+		if (!oldest || (int32_t)(oldest->seen_us - s->seen_us) > 0) {
+			oldest = s;
+		}
+	}
+
+	return oldest;
+}
+
+static void rssi_add(struct source *s, int8_t rssi)
+{
+	if (rssi == BT_HCI_LE_RSSI_NOT_AVAILABLE) {
+		return;
+	}
+
+	s->rssi_avg += ((rssi << RSSI_FRAC_BITS) - s->rssi_avg) >> RSSI_FRAC_BITS;
+}
+
+static bool source_usable(const struct source *s)
+{
+	uint8_t code[BT_ISO_BROADCAST_CODE_SIZE];
+
+	if (!s->biginfo_valid) {
+		/* Not known until synced, try it */
+		return true;
+	}
+
+	if (s->num_bis < num_bis_min) {
+		return false;
+	}
+
+	return !s->encrypted || broadcast_code_get(code);
+}
+
+static int32_t source_score(const struct source *s)
+{
+	uint32_t events = s->pa_recv + s->pa_lost;
+	int32_t score = s->rssi_avg >> RSSI_FRAC_BITS;
+
+	if (events) {
+		score -= (int32_t)(s->pa_lost * 100U / events) * SCORE_PER_LOSS_PCT;
+	}
+
+	if (s->biginfo_valid) {
+		score += s->irc * SCORE_PER_IRC;
+	}
+
+	return score;
+}
+
+static struct source *source_best(const struct source *exclude)
+{
+	struct source *best = NULL;
+
+	for (uint8_t i = 0U; i < SOURCE_COUNT; i++) {
+		struct source *s = &sources[i];
+
+		if (!s->used || s == exclude || !source_usable(s)) {
+			continue;
+		}
+
+		if (!best || source_score(s) > source_score(best)) {
+			best = s;
+		}
+	}
+
+	return best;
+}
+
+static void info_fill(const struct source *s, struct sources_info *info)
+{
+	bt_addr_le_copy(&info->addr, &s->addr);
+	info->sid = s->sid;
+	info->interval_us = s->interval_us;
+	info->biginfo_valid = s->biginfo_valid;
+	info->encrypted = s->encrypted;
+	info->sdu_interval_us = s->sdu_interval_us;
+	info->num_bis = s->num_bis;
+	info->nse = s->nse;
+	info->bn = s->bn;
+	info->irc = s->irc;
+	info->max_sdu = s->max_sdu;
+}
+
+void sources_init(uint8_t num_bis)
+{
+	k_spinlock_key_t key = k_spin_lock(&sources_lock);
+
+	memset(sources, 0, sizeof(sources));
+	active = NULL;
+	standby = NULL;
+	num_bis_min = num_bis;
+
+	k_spin_unlock(&sources_lock, key);
+}
+
+void sources_scan_report(const struct bt_le_scan_recv_info *info)
+{
+	k_spinlock_key_t key = k_spin_lock(&sources_lock);
+	struct source *s = source_find(info->addr, info->sid);
+
+	if (!s) {
+		s = source_alloc();
+		if (!s) {
+			k_spin_unlock(&sources_lock, key);
+			return;
+		}
+
+		memset(s, 0, sizeof(*s));
+		s->used = true;
+		bt_addr_le_copy(&s->addr, info->addr);
+		s->sid = info->sid;
+		s->rssi_avg = info->rssi << RSSI_FRAC_BITS;
+	}
+
+	s->interval_us = BT_CONN_INTERVAL_TO_US(info->interval);
+	s->seen_us = local_us();
+	rssi_add(s, info->rssi);
+
+	k_spin_unlock(&sources_lock, key);
+}
+
+bool sources_synced(struct bt_le_per_adv_sync *sync)
+{
+	k_spinlock_key_t key = k_spin_lock(&sources_lock);
+	struct source *s = source_by_sync(sync);
+	bool is_standby = s && s == standby;
+
+	if (s) {
+		s->synced = true;
+		s->pa_last_us = local_us();
+	}
+
+	k_spin_unlock(&sources_lock, key);
+
+	return is_standby;
+}
+
+bool sources_term(struct bt_le_per_adv_sync *sync)
+{
+	k_spinlock_key_t key = k_spin_lock(&sources_lock);
+	struct source *s = source_by_sync(sync);
+	bool is_standby = s && s == standby;
+
+	if (s) {
+		/* The host releases the sync object after this callback */
+		s->sync = NULL;
+		s->synced = false;
+		if (is_standby) {
+			standby = NULL;
+		}
+	}
+
+	k_spin_unlock(&sources_lock, key);
+
+	return is_standby;
+}
+
+void sources_pa_report(struct bt_le_per_adv_sync *sync,
+		       const struct bt_le_per_adv_sync_recv_info *info)
+{
+	k_spinlock_key_t key = k_spin_lock(&sources_lock);
+	struct source *s = source_by_sync(sync);
+	uint32_t now = local_us();
+
+	if (!s) {
+		k_spin_unlock(&sources_lock, key);
+		return;
+	}
+
+	/* Every event that passed without a report was lost */
+	if (s->pa_recv && s->interval_us) {
+		uint32_t events = (now - s->pa_last_us + s->interval_us / 2U) / s->interval_us;
+
+		if (events > 1U) {
+			s->pa_lost += events - 1U;
+		}
+	}
+
+	s->pa_last_us = now;
+	s->pa_recv++;
+	s->seen_us = now;
+	rssi_add(s, info->rssi);
+
+	k_spin_unlock(&sources_lock, key);
+}
+
+bool sources_biginfo(struct bt_le_per_adv_sync *sync, const struct bt_iso_biginfo *biginfo)
+{
+	k_spinlock_key_t key = k_spin_lock(&sources_lock);
+	struct source *s = source_by_sync(sync);
+	bool is_standby = s && s == standby;
+
+	if (s) {
+		s->biginfo_valid = true;
+		s->num_bis = biginfo->num_bis;
+		s->nse = biginfo->sub_evt_count;
+		s->bn = biginfo->burst_number;
+		s->max_sdu = biginfo->max_sdu;
+		s->irc = biginfo->rep_count;
+		s->encrypted = biginfo->encryption;
+		s->sdu_interval_us = biginfo->sdu_interval;
+	}
+
+	k_spin_unlock(&sources_lock, key);
+
+	return is_standby;
+}
+
+bool sources_best(struct sources_info *info)
+{
+	k_spinlock_key_t key = k_spin_lock(&sources_lock);
+	struct source *s = source_best(NULL);
+
+	if (s) {
+		info_fill(s, info);
+	}
+
+	k_spin_unlock(&sources_lock, key);
+
+	return s != NULL;
+}
+
+void sources_active_set(struct bt_le_per_adv_sync *sync, const bt_addr_le_t *addr,
+			uint8_t sid, uint32_t interval_us)
+{
+	k_spinlock_key_t key = k_spin_lock(&sources_lock);
+	struct source *s = source_find(addr, sid);
+
+	if (!s) {
+		/* Not from a scan, e.g. a fast resync */
+		s = source_alloc();
+		if (!s) {
+			k_spin_unlock(&sources_lock, key);
+			return;
+		}
+
+		memset(s, 0, sizeof(*s));
+		s->used = true;
+		bt_addr_le_copy(&s->addr, addr);
+		s->sid = sid;
+		s->seen_us = local_us();
+	}
+
+	if (active && active != s && active->sync == sync) {
+		active->sync = NULL;
+	}
+
+	active = s;
+	s->sync = sync;
+	s->synced = true;
+	s->interval_us = interval_us;
+
+	k_spin_unlock(&sources_lock, key);
+}
+
+int sources_standby_start(void)
+{
+	struct bt_le_per_adv_sync_param param = { 0 };
+	struct bt_le_per_adv_sync *sync;
+	k_spinlock_key_t key;
+	struct source *s;
+	int err;
+
+	key = k_spin_lock(&sources_lock);
+	if (standby) {
+		k_spin_unlock(&sources_lock, key);
+		return 0;
+	}
+
+	s = source_best(active);
+	if (!s) {
+		k_spin_unlock(&sources_lock, key);
+		return -ENOENT;
+	}
+
+	bt_addr_le_copy(&param.addr, &s->addr);
+	param.sid = s->sid;
+	/* Multiple PA interval with retry count and convert to unit of 10 ms */
+	param.timeout = (s->interval_us * PA_RETRY_COUNT) / (10 * USEC_PER_MSEC);
+	k_spin_unlock(&sources_lock, key);
+
+	err = bt_le_per_adv_sync_create(&param, &sync);
+	if (err) {
+		return err;
+	}
+
+	key = k_spin_lock(&sources_lock);
+	s->sync = sync;
+	s->synced = false;
+	s->biginfo_valid = false;
+	s->pa_recv = 0U;
+	s->pa_lost = 0U;
+	standby = s;
+	k_spin_unlock(&sources_lock, key);
+
+	return 0;
+}
+
+void sources_standby_stop(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&sources_lock);
+	struct bt_le_per_adv_sync *sync = NULL;
+
+	if (standby) {
+		sync = standby->sync;
+		standby->sync = NULL;
+		standby->synced = false;
+		standby = NULL;
+	}
+
+	k_spin_unlock(&sources_lock, key);
+
+	if (sync) {
+		(void)bt_le_per_adv_sync_delete(sync);
+	}
+}
+
+struct bt_le_per_adv_sync *sources_failover(bool active_lost, struct sources_info *info)
+{
+	k_spinlock_key_t key = k_spin_lock(&sources_lock);
+	struct bt_le_per_adv_sync *sync;
+	struct source *old = active;
+
+	if (!standby || !standby->synced || !standby->biginfo_valid ||
+	    !source_usable(standby)) {
+		k_spin_unlock(&sources_lock, key);
+		return NULL;
+	}
+
+	active = standby;
+	standby = NULL;
+
+	if (old) {
+		if (active_lost) {
+			old->sync = NULL;
+			old->synced = false;
+		} else if (old->sync) {
+			/* Still synced, keep it warm for the way back */
+			standby = old;
+		}
+	}
+
+	sync = active->sync;
+	info_fill(active, info);
+	failover_count++;
+
+	k_spin_unlock(&sources_lock, key);
+
+	return sync;
+}
+
+void sources_print(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&sources_lock);
+	struct source snapshot[SOURCE_COUNT];
+	int32_t score[SOURCE_COUNT];
+	bool usable[SOURCE_COUNT];
+	const char *role[SOURCE_COUNT];
+
+	/* Copied so nothing is printed with the lock held */
+	for (uint8_t i = 0U; i < SOURCE_COUNT; i++) {
+		snapshot[i] = sources[i];
+		score[i] = source_score(&sources[i]);
+		usable[i] = source_usable(&sources[i]);
+		role[i] = &sources[i] == active ? "active" :
+			  &sources[i] == standby ? "standby" : "idle";
+	}
+
+	k_spin_unlock(&sources_lock, key);
+
+	printk("Sources, %u failovers:\n", failover_count);
+
+	for (uint8_t i = 0U; i < SOURCE_COUNT; i++) {
+		const struct source *s = &snapshot[i];
+		char le_addr[BT_ADDR_LE_STR_LEN];
+
+		if (!s->used) {
+			continue;
+		}
+
+		bt_addr_le_to_str(&s->addr, le_addr, sizeof(le_addr));
+		printk("  %s SID %u %s: RSSI %d, PA recv %u lost %u, %u BIS irc %u%s, "
+		       "score %d%s\n", le_addr, s->sid, role[i],
+		       s->rssi_avg >> RSSI_FRAC_BITS, s->pa_recv, s->pa_lost,
+		       s->num_bis, s->irc, s->encrypted ? " encrypted" : "",
+		       score[i], usable[i] ? "" : " (unusable)");
+	}
+}
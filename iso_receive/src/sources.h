@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef SOURCES_H_
+#define SOURCES_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/iso.h>
+
+/* Broadcast sources seen while scanning, ranked by RSSI, periodic advertising
+ * loss and BIGInfo. Next to the active source a warm PA sync is kept on the
+ * best other source, so a failover only needs a BIG sync.
+ *
+ * The report functions are called from the Bluetooth callbacks, the others
+ * from the main thread.
+ */
+
+/* What the main loop needs to sync to a source */
+struct sources_info {
+	bt_addr_le_t addr;
+	uint8_t sid;
+	uint32_t interval_us;
+	bool biginfo_valid;
+	bool encrypted;
+	uint32_t sdu_interval_us;
+	uint8_t num_bis;
+	uint8_t nse;
+	uint8_t bn;
+	uint8_t irc;
+	uint16_t max_sdu;
+};
+
+/* Forget all sources, num_bis is the number of BIS a source must have */
+void sources_init(uint8_t num_bis);
+
+/* Advertising report of a periodic advertiser */
+void sources_scan_report(const struct bt_le_scan_recv_info *info);
+
+/* Periodic advertising callbacks of every sync. The synced, term and BIGInfo
+ * reports return true when sync is the standby sync, the caller then leaves it
+ * alone.
+ */
+bool sources_synced(struct bt_le_per_adv_sync *sync);
+bool sources_term(struct bt_le_per_adv_sync *sync);
+void sources_pa_report(struct bt_le_per_adv_sync *sync,
+		       const struct bt_le_per_adv_sync_recv_info *info);
+bool sources_biginfo(struct bt_le_per_adv_sync *sync, const struct bt_iso_biginfo *biginfo);
+
+/* Best ranked source, false when none is known */
+bool sources_best(struct sources_info *info);
+
+/* The main loop synced to the source at addr and sid */
+void sources_active_set(struct bt_le_per_adv_sync *sync, const bt_addr_le_t *addr,
+			uint8_t sid, uint32_t interval_us);
+
+/* Create a PA sync to the best source other than the active one, if there is
+ * no standby yet. Returns 0 or a negative error.
+ */
+int sources_standby_start(void);
+
+/* Delete the standby sync, e.g. before creating a new active PA sync */
+void sources_standby_stop(void);
+
+/* Make the standby source active when it is synced and has a usable BIGInfo.
+ * The old active sync becomes the standby when active_lost is false. Returns
+ * the sync to create the BIG sync on and fills info, NULL when there is no
+ * usable standby.
+ */
+struct bt_le_per_adv_sync *sources_failover(bool active_lost, struct sources_info *info);
+
+void sources_print(void);
+
+#endif /* SOURCES_H_ */
@@ -0,0 +1,450 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/hci.h>
+#include <zephyr/bluetooth/iso.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/printk.h>
+
+#include "trace.h"
+
+#define ISO_RING_SIZE  CONFIG_ISO_TRACE_RING_SIZE
+#define SCAN_RING_SIZE CONFIG_ISO_TRACE_SCAN_RING_SIZE
+/* Leading data bytes kept per record */
+#define ISO_DATA_LEN 8
+#define ADV_DATA_LEN 24
+#define NAME_LEN     30
+
+BUILD_ASSERT(IS_POWER_OF_TWO(ISO_RING_SIZE), "CONFIG_ISO_TRACE_RING_SIZE must be a power of two");
+BUILD_ASSERT(IS_POWER_OF_TWO(SCAN_RING_SIZE),
+	     "CONFIG_ISO_TRACE_SCAN_RING_SIZE must be a power of two");
+
+enum trace_type {
+	TRACE_ISO,
+	TRACE_ISO_DISCONNECTED,
+	TRACE_SCAN,
+	TRACE_PA,
+	TRACE_BIGINFO,
+};
+
+struct trace_rec {
+	uint32_t cycles;
+	uint8_t type;
+	union {
+		struct {
+			uint8_t chan;
+			uint8_t flags;
+			uint8_t data_len;
+			uint16_t seq_num;
+			uint16_t len;
+			uint32_t ts;
+			uint32_t recv_count;
+			uint8_t data[ISO_DATA_LEN];
+		} iso;
+		struct {
+			uint8_t chan;
+			uint8_t reason;
+			uint32_t mic_fail_count;
+		} iso_disconnected;
+		struct {
+			bt_addr_le_t addr;
+			uint8_t adv_type;
+			int8_t tx_power;
+			int8_t rssi;
+			uint8_t sid;
+			uint8_t primary_phy;
+			uint8_t secondary_phy;
+			uint16_t adv_props;
+			uint16_t interval;
+			uint8_t data_len;
+			uint8_t data[ADV_DATA_LEN];
+		} scan;
+		struct {
+			uint8_t sync_index;
+			int8_t tx_power;
+			int8_t rssi;
+			uint8_t cte_type;
+			uint8_t data_len;
+			uint16_t len;
+			uint8_t data[ADV_DATA_LEN];
+		} pa;
+		struct {
+			uint8_t sync_index;
+			uint8_t sid;
+			uint8_t num_bis;
+			uint8_t sub_evt_count;
+			uint8_t burst_number;
+			uint8_t offset;
+			uint8_t rep_count;
+			uint8_t phy;
+			uint8_t framing;
+			uint8_t encryption;
+			uint16_t iso_interval;
+			uint16_t max_pdu;
+			uint16_t max_sdu;
+			uint32_t sdu_interval;
+		} biginfo;
+	};
+};
+
+/* ISO records have their own ring so a flood of advertising reports while
+ * scanning cannot push them out. A full ring drops its newest record.
+ */
+struct trace_ring {
+	struct trace_rec *recs;
+	uint32_t size;
+	uint32_t wr;
+	uint32_t rd;
+	uint32_t dropped;
+	const char *name;
+};
+
+static struct trace_rec iso_recs[ISO_RING_SIZE];
+static struct trace_rec scan_recs[SCAN_RING_SIZE];
+
+static struct trace_ring iso_ring = {
+	.recs = iso_recs,
+	.size = ISO_RING_SIZE,
+	.name = "ISO",
+};
+static struct trace_ring scan_ring = {
+	.recs = scan_recs,
+	.size = SCAN_RING_SIZE,
+	.name = "scan",
+};
+static struct k_spinlock ring_lock;
+
+const char *phy2str(uint8_t phy)
+{
+	switch (phy) {
+	case 0: return "No packets";
+	case BT_GAP_LE_PHY_1M: return "LE 1M";
+	case BT_GAP_LE_PHY_2M: return "LE 2M";
+	case BT_GAP_LE_PHY_CODED: return "LE Coded";
+	default: return "Unknown";
+	}
+}
+
+/* Claim the next record, NULL when the ring is full. The record is published
+ * by rec_commit(), the lock is held in between.
+ */
+static struct trace_rec *rec_alloc(struct trace_ring *ring, uint8_t type,
+				   k_spinlock_key_t *key)
+{
+	struct trace_rec *rec;
+
+	*key = k_spin_lock(&ring_lock);
+
+	if (ring->wr - ring->rd >= ring->size) {
+		ring->dropped++;
+		k_spin_unlock(&ring_lock, *key);
+		return NULL;
+	}
+
+	rec = &ring->recs[ring->wr % ring->size];
+	rec->cycles = k_cycle_get_32();
+	rec->type = type;
+
+	return rec;
+}
+
+static void rec_commit(struct trace_ring *ring, k_spinlock_key_t key)
+{
+	ring->wr++;
+	k_spin_unlock(&ring_lock, key);
+}
+
+void trace_iso(uint8_t chan, const struct bt_iso_recv_info *info,
+	       const struct net_buf *buf, uint32_t recv_count)
+{
+	k_spinlock_key_t key;
+	struct trace_rec *rec = rec_alloc(&iso_ring, TRACE_ISO, &key);
+
+	if (!rec) {
+		return;
+	}
+
+	rec->iso.chan = chan;
+	rec->iso.flags = info->flags;
+	rec->iso.seq_num = info->seq_num;
+	rec->iso.ts = info->ts;
+	rec->iso.len = buf->len;
+	rec->iso.recv_count = recv_count;
+	rec->iso.data_len = MIN(buf->len, ISO_DATA_LEN);
+	memcpy(rec->iso.data, buf->data, rec->iso.data_len);
+
+	rec_commit(&iso_ring, key);
+}
+
+void trace_iso_disconnected(uint8_t chan, uint8_t reason, uint32_t mic_fail_count)
+{
+	k_spinlock_key_t key;
+	struct trace_rec *rec = rec_alloc(&iso_ring, TRACE_ISO_DISCONNECTED, &key);
+
+	if (!rec) {
+		return;
+	}
+
+	rec->iso_disconnected.chan = chan;
+	rec->iso_disconnected.reason = reason;
+	rec->iso_disconnected.mic_fail_count = mic_fail_count;
+
+	rec_commit(&iso_ring, key);
+}
+
+void trace_scan(const struct bt_le_scan_recv_info *info, const struct net_buf_simple *buf)
+{
+	k_spinlock_key_t key;
+	struct trace_rec *rec = rec_alloc(&scan_ring, TRACE_SCAN, &key);
+
+	if (!rec) {
+		return;
+	}
+
+	bt_addr_le_copy(&rec->scan.addr, info->addr);
+	rec->scan.adv_type = info->adv_type;
+	rec->scan.tx_power = info->tx_power;
+	rec->scan.rssi = info->rssi;
+	rec->scan.sid = info->sid;
+	rec->scan.primary_phy = info->primary_phy;
+	rec->scan.secondary_phy = info->secondary_phy;
+	rec->scan.adv_props = info->adv_props;
+	rec->scan.interval = info->interval;
+	rec->scan.data_len = MIN(buf->len, ADV_DATA_LEN);
+	memcpy(rec->scan.data, buf->data, rec->scan.data_len);
+
+	rec_commit(&scan_ring, key);
+}
+
+void trace_pa(uint8_t sync_index, const struct bt_le_per_adv_sync_recv_info *info,
+	      const struct net_buf_simple *buf)
+{
+	k_spinlock_key_t key;
+	struct trace_rec *rec = rec_alloc(&scan_ring, TRACE_PA, &key);
+
+	if (!rec) {
+		return;
+	}
+
+	rec->pa.sync_index = sync_index;
+	rec->pa.tx_power = info->tx_power;
+	rec->pa.rssi = info->rssi;
+	rec->pa.cte_type = info->cte_type;
+	rec->pa.len = buf->len;
+	rec->pa.data_len = MIN(buf->len, ADV_DATA_LEN);
+	memcpy(rec->pa.data, buf->data, rec->pa.data_len);
+
+	rec_commit(&scan_ring, key);
+}
+
+void trace_biginfo(uint8_t sync_index, const struct bt_iso_biginfo *biginfo)
+{
+	k_spinlock_key_t key;
+	struct trace_rec *rec = rec_alloc(&scan_ring, TRACE_BIGINFO, &key);
+
+	if (!rec) {
+		return;
+	}
+
+	rec->biginfo.sync_index = sync_index;
+	rec->biginfo.sid = biginfo->sid;
+	rec->biginfo.num_bis = biginfo->num_bis;
+	rec->biginfo.sub_evt_count = biginfo->sub_evt_count;
+	rec->biginfo.iso_interval = biginfo->iso_interval;
+	rec->biginfo.burst_number = biginfo->burst_number;
+	rec->biginfo.offset = biginfo->offset;
+	rec->biginfo.rep_count = biginfo->rep_count;
+	rec->biginfo.max_pdu = biginfo->max_pdu;
+	rec->biginfo.sdu_interval = biginfo->sdu_interval;
+	rec->biginfo.max_sdu = biginfo->max_sdu;
+	rec->biginfo.phy = biginfo->phy;
+	rec->biginfo.framing = biginfo->framing;
+	rec->biginfo.encryption = biginfo->encryption;
+
+	rec_commit(&scan_ring, key);
+}
+
+static bool name_cb(struct bt_data *data, void *user_data)
+{
+	char *name = user_data;
+	uint8_t len;
+
+	switch (data->type) {
+	case BT_DATA_NAME_SHORTENED:
+	case BT_DATA_NAME_COMPLETE:
+		len = MIN(data->data_len, NAME_LEN - 1);
+		memcpy(name, data->data, len);
+		name[len] = '\0';
+		return false;
+	default:
+		return true;
+	}
+}
+
+static void print_iso(const struct trace_rec *rec)
+{
+	char data_str[2 * ISO_DATA_LEN + 1];
+	uint32_t count = 0U; /* only valid if the data is a counter */
+
+	if ((rec->iso.recv_count % CONFIG_ISO_PRINT_INTERVAL) != 0) {
+		return;
+	}
+
+	if (rec->iso.len == sizeof(count)) {
+		count = sys_get_le32(rec->iso.data);
+	}
+
+	bin2hex(rec->iso.data, rec->iso.data_len, data_str, sizeof(data_str));
+	printk("[%u] Incoming data channel %u flags 0x%x seq_num %u ts %u len %u: "
+	       "%s%s (counter value %u)\n", rec->cycles, rec->iso.chan,
+	       rec->iso.flags, rec->iso.seq_num, rec->iso.ts, rec->iso.len, data_str,
+	       rec->iso.len > rec->iso.data_len ? "..." : "", count);
+	if (iso_ring.dropped || scan_ring.dropped) {
+		printk("Trace records dropped: ISO %u, scan %u\n", iso_ring.dropped,
+		       scan_ring.dropped);
+	}
+}
+
+static void print_iso_disconnected(const struct trace_rec *rec)
+{
+	printk("[%u] ISO Channel %u disconnected with reason 0x%02x\n", rec->cycles,
+	       rec->iso_disconnected.chan, rec->iso_disconnected.reason);
+
+	if (rec->iso_disconnected.reason == BT_HCI_ERR_TERM_DUE_TO_MIC_FAIL) {
+		printk("[%u] MIC failure, wrong Broadcast Code? MIC failures %u\n",
+		       rec->cycles, rec->iso_disconnected.mic_fail_count);
+	}
+}
+
+static void print_scan(const struct trace_rec *rec)
+{
+	char le_addr[BT_ADDR_LE_STR_LEN];
+	char name[NAME_LEN] = { 0 };
+	struct net_buf_simple ad;
+
+	net_buf_simple_init_with_data(&ad, (void *)rec->scan.data, rec->scan.data_len);
+	bt_data_parse(&ad, name_cb, name);
+
+	bt_addr_le_to_str(&rec->scan.addr, le_addr, sizeof(le_addr));
+	printk("[%u] [DEVICE]: %s, AD evt type %u, Tx Pwr: %i, RSSI %i %s "
+	       "C:%u S:%u D:%u SR:%u E:%u Prim: %s, Secn: %s, "
+	       "Interval: 0x%04x (%u us), SID: %u\n", rec->cycles,
+	       le_addr, rec->scan.adv_type, rec->scan.tx_power, rec->scan.rssi, name,
+	       (rec->scan.adv_props & BT_GAP_ADV_PROP_CONNECTABLE) != 0,
+	       (rec->scan.adv_props & BT_GAP_ADV_PROP_SCANNABLE) != 0,
+	       (rec->scan.adv_props & BT_GAP_ADV_PROP_DIRECTED) != 0,
+	       (rec->scan.adv_props & BT_GAP_ADV_PROP_SCAN_RESPONSE) != 0,
+	       (rec->scan.adv_props & BT_GAP_ADV_PROP_EXT_ADV) != 0,
+	       phy2str(rec->scan.primary_phy), phy2str(rec->scan.secondary_phy),
+	       rec->scan.interval, BT_CONN_INTERVAL_TO_US(rec->scan.interval),
+	       rec->scan.sid);
+}
+
+static void print_pa(const struct trace_rec *rec)
+{
+	char data_str[2 * ADV_DATA_LEN + 1];
+
+	bin2hex(rec->pa.data, rec->pa.data_len, data_str, sizeof(data_str));
+	printk("[%u] PER_ADV_SYNC[%u]: tx_power %i, RSSI %i, CTE %u, "
+	       "data length %u, data: %s%s\n", rec->cycles, rec->pa.sync_index,
+	       rec->pa.tx_power, rec->pa.rssi, rec->pa.cte_type, rec->pa.len,
+	       data_str, rec->pa.len > rec->pa.data_len ? "..." : "");
+}
+
+static void print_biginfo(const struct trace_rec *rec)
+{
+	printk("[%u] BIG INFO[%u]: sid 0x%02x, "
+	       "num_bis %u, nse %u, interval 0x%04x (%u ms), "
+	       "bn %u, pto %u, irc %u, max_pdu %u, "
+	       "sdu_interval %u us, max_sdu %u, phy %s, "
+	       "%s framing, %sencrypted\n", rec->cycles,
+	       rec->biginfo.sync_index, rec->biginfo.sid, rec->biginfo.num_bis,
+	       rec->biginfo.sub_evt_count, rec->biginfo.iso_interval,
+	       (rec->biginfo.iso_interval * 5 / 4), rec->biginfo.burst_number,
+	       rec->biginfo.offset, rec->biginfo.rep_count, rec->biginfo.max_pdu,
+	       rec->biginfo.sdu_interval, rec->biginfo.max_sdu,
+	       phy2str(rec->biginfo.phy),
+	       rec->biginfo.framing ? "with" : "without",
+	       rec->biginfo.encryption ? "" : "not ");
+}
+
+static void rec_print(const struct trace_rec *rec)
+{
+	switch (rec->type) {
+	case TRACE_ISO:
+		print_iso(rec);
+		break;
+	case TRACE_ISO_DISCONNECTED:
+		print_iso_disconnected(rec);
+		break;
+	case TRACE_SCAN:
+		print_scan(rec);
+		break;
+	case TRACE_PA:
+		print_pa(rec);
+		break;
+	case TRACE_BIGINFO:
+		print_biginfo(rec);
+		break;
+	default:
+		break;
+	}
+}
+
+/* The ring whose oldest record is the oldest of both, NULL when both are empty */
+static struct trace_ring *ring_next(void)
+{
+	const struct trace_rec *iso;
+	const struct trace_rec *scan;
+
+	if (scan_ring.rd == scan_ring.wr) {
+		return iso_ring.rd == iso_ring.wr ? NULL : &iso_ring;
+	}
+
+	if (iso_ring.rd == iso_ring.wr) {
+		return &scan_ring;
+	}
+
+	iso = &iso_ring.recs[iso_ring.rd % iso_ring.size];
+	scan = &scan_ring.recs[scan_ring.rd % scan_ring.size];
+
+	return (int32_t)(iso->cycles - scan->cycles) <= 0 ? &iso_ring : &scan_ring;
+}
+
+static void trace_thread(void *p1, void *p2, void *p3)
+{
+	struct trace_ring *ring;
+
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	while (true) {
+		/* Both rings are printed in the order the records were taken */
+		while ((ring = ring_next()) != NULL) {
+			/* Only this thread writes rd, the record stays valid until it
+			 * is advanced
+			 */
+			k_spinlock_key_t key;
+
+			rec_print(&ring->recs[ring->rd % ring->size]);
+
+			key = k_spin_lock(&ring_lock);
+			ring->rd++;
+			k_spin_unlock(&ring_lock, key);
+		}
+
+		k_sleep(K_MSEC(CONFIG_ISO_TRACE_DRAIN_INTERVAL_MS));
+	}
+}
+
+K_THREAD_DEFINE(trace_tid, CONFIG_ISO_TRACE_THREAD_STACK_SIZE, trace_thread, NULL, NULL, NULL,
+		K_PRIO_PREEMPT(CONFIG_ISO_TRACE_THREAD_PRIO), 0, 0);
@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdint.h>
+
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/iso.h>
+#include <zephyr/net/buf.h>
+
+/* Binary trace of the Bluetooth callbacks. The trace_* functions only copy a
+ * fixed size record into a ring and may be called from the Bluetooth RX
+ * context, a low priority thread formats and prints the records later. ISO
+ * records and scan records (advertising, periodic advertising, BIGInfo) have
+ * their own ring, so scanning cannot crowd out ISO records. When a ring is
+ * full its newest records are dropped and counted.
+ */
+
+/* ISO SDU, recv_count is used to print only every CONFIG_ISO_PRINT_INTERVAL */
+void trace_iso(uint8_t chan, const struct bt_iso_recv_info *info,
+	       const struct net_buf *buf, uint32_t recv_count);
+
+/* BIS lost, mic_fail_count is printed when reason is a MIC failure */
+void trace_iso_disconnected(uint8_t chan, uint8_t reason, uint32_t mic_fail_count);
+
+/* Advertising report */
+void trace_scan(const struct bt_le_scan_recv_info *info, const struct net_buf_simple *buf);
+
+/* Periodic advertising report */
+void trace_pa(uint8_t sync_index, const struct bt_le_per_adv_sync_recv_info *info,
+	      const struct net_buf_simple *buf);
+
+/* BIGInfo report */
+void trace_biginfo(uint8_t sync_index, const struct bt_iso_biginfo *biginfo);
+
+const char *phy2str(uint8_t phy);
+
+#endif /* TRACE_H_ */
@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdlib.h>
+
+#include <zephyr/ztest.h>
+#include <zephyr/bluetooth/iso.h>
+
+#include "drift.h"
+
+#define SDU_INTERVAL_US 10000U
+/* 30 s of SDUs, 30 windows */
+#define SDU_COUNT       3000U
+/* Arbitrary start of the controller clock, wraps during the test */
+#define TS_START        (UINT32_MAX - 5000000U)
+/* Filtered estimate within 0.5 ppm */
+#define TOLERANCE_PPB   500
+
+/* Time stamp of SDU n for a local clock off by ppm, with up to 96 us of
+ * jitter that is 0 at least once per window
+ */
+static uint32_t sdu_ts(uint32_t n, int32_t ppm, bool jitter)
+{
+	int64_t t = (int64_t)n * SDU_INTERVAL_US;
+
+	t += t * ppm / 1000000;
+	if (jitter) {
+		t += (n * 37U) % 97U;
+	}
+
+	return TS_START + (uint32_t)t;
+}
+
+static void sdu_recv(uint16_t seq_num, uint32_t ts, uint8_t flags)
+{
+	struct bt_iso_recv_info info = {
+		.seq_num = seq_num,
+		.ts = ts,
+		.flags = flags,
+	};
+
+	drift_update(&info);
+}
+
+static void stream_recv(uint16_t seq_start, int32_t ppm, bool jitter)
+{
+	for (uint32_t n = 0U; n < SDU_COUNT; n++) {
+		sdu_recv(seq_start + n, sdu_ts(n, ppm, jitter),
+			 BT_ISO_FLAGS_VALID | BT_ISO_FLAGS_TS);
+	}
+}
+
+static void drift_assert(int32_t ppm)
+{
+	int32_t ppb = drift_ppb();
+
+	zassert_true(abs(ppb - ppm * 1000) <= TOLERANCE_PPB, "%d ppb for %d ppm", ppb, ppm);
+}
+
+static void drift_before(void *fixture)
+{
+	ARG_UNUSED(fixture);
+
+	drift_reset(SDU_INTERVAL_US);
+}
+
+ZTEST_SUITE(drift, NULL, NULL, drift_before, NULL, NULL);
+
+ZTEST(drift, test_none)
+{
+	stream_recv(0U, 0, true);
+	drift_assert(0);
+}
+
+ZTEST(drift, test_fast)
+{
+	stream_recv(0U, 50, true);
+	drift_assert(50);
+}
+
+ZTEST(drift, test_slow)
+{
+	stream_recv(0U, -50, true);
+	drift_assert(-50);
+}
+
+ZTEST(drift, test_seq_wraps)
+{
+	stream_recv(UINT16_MAX - 100U, 50, false);
+	drift_assert(50);
+}
+
+ZTEST(drift, test_lost_sdus)
+{
+	/* Lost SDUs still advance the remote time by their sequence numbers */
+	for (uint32_t n = 0U; n < SDU_COUNT; n++) {
+		uint8_t flags = (n % 10U) < 3U ? BT_ISO_FLAGS_LOST :
+			       BT_ISO_FLAGS_VALID | BT_ISO_FLAGS_TS;
+
+		sdu_recv(n, sdu_ts(n, -50, true), flags);
+	}
+	drift_assert(-50);
+}
+
+ZTEST(drift, test_invalid_ignored)
+{
+	/* Errored SDUs with a time stamp far off must not move the estimate */
+	for (uint32_t n = 0U; n < SDU_COUNT; n++) {
+		uint32_t ts = sdu_ts(n, 50, true);
+
+		if (n % 10U == 5U) {
+			sdu_recv(n, ts - 5000U, BT_ISO_FLAGS_ERROR | BT_ISO_FLAGS_TS);
+		} else {
+			sdu_recv(n, ts, BT_ISO_FLAGS_VALID | BT_ISO_FLAGS_TS);
+		}
+	}
+	drift_assert(50);
+}
+
+ZTEST(drift, test_no_estimate_before_two_windows)
+{
+	for (uint32_t n = 0U; n < 150U; n++) {
+		sdu_recv(n, sdu_ts(n, 50, false), BT_ISO_FLAGS_VALID | BT_ISO_FLAGS_TS);
+	}
+	zassert_equal(drift_ppb(), 0);
+}
@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/ztest.h>
+#include <zephyr/bluetooth/iso.h>
+
+#include "rx_stats.h"
+
+#define SDU_INTERVAL_US 10000U
+
+static void sdu_recv(uint16_t seq_num, uint8_t flags)
+{
+	struct bt_iso_recv_info info = {
+		.seq_num = seq_num,
+		.ts = seq_num * SDU_INTERVAL_US,
+		.flags = flags | BT_ISO_FLAGS_TS,
+	};
+
+	rx_stats_update(0U, &info);
+}
+
+static void counts_get(struct rx_stats_counts *counts)
+{
+	rx_stats_get(0U, counts);
+}
+
+static void rx_stats_before(void *fixture)
+{
+	ARG_UNUSED(fixture);
+
+	rx_stats_reset(1U, SDU_INTERVAL_US);
+}
+
+ZTEST_SUITE(rx_stats, NULL, NULL, rx_stats_before, NULL, NULL);
+
+ZTEST(rx_stats, test_valid)
+{
+	struct rx_stats_counts counts;
+
+	for (uint16_t seq_num = 0U; seq_num < 10U; seq_num++) {
+		sdu_recv(seq_num, BT_ISO_FLAGS_VALID);
+	}
+
+	counts_get(&counts);
+	zassert_equal(counts.received, 10U);
+	zassert_equal(counts.lost, 0U);
+	zassert_equal(counts.error, 0U);
+	zassert_equal(counts.gap, 0U);
+	zassert_equal(counts.duplicate, 0U);
+}
+
+/* A lost SDU is still reported, with its own sequence number */
+ZTEST(rx_stats, test_lost_flag)
+{
+	struct rx_stats_counts counts;
+
+	sdu_recv(0U, BT_ISO_FLAGS_VALID);
+	sdu_recv(1U, BT_ISO_FLAGS_LOST);
+	sdu_recv(2U, BT_ISO_FLAGS_LOST);
+	sdu_recv(3U, BT_ISO_FLAGS_VALID);
+
+	counts_get(&counts);
+	zassert_equal(counts.received, 4U);
+	zassert_equal(counts.lost, 2U);
+	zassert_equal(counts.error, 0U);
+	zassert_equal(counts.gap, 0U);
+}
+
+ZTEST(rx_stats, test_error_flag)
+{
+	struct rx_stats_counts counts;
+
+	sdu_recv(0U, BT_ISO_FLAGS_VALID);
+	sdu_recv(1U, BT_ISO_FLAGS_ERROR);
+	sdu_recv(2U, BT_ISO_FLAGS_VALID);
+
+	counts_get(&counts);
+	zassert_equal(counts.received, 3U);
+	zassert_equal(counts.lost, 0U);
+	zassert_equal(counts.error, 1U);
+	zassert_equal(counts.gap, 0U);
+}
+
+/* Sequence numbers that never reach the host are neither lost nor errored */
+ZTEST(rx_stats, test_gap)
+{
+	struct rx_stats_counts counts;
+
+	sdu_recv(0U, BT_ISO_FLAGS_VALID);
+	sdu_recv(4U, BT_ISO_FLAGS_VALID);
+
+	counts_get(&counts);
+	zassert_equal(counts.received, 2U);
+	zassert_equal(counts.lost, 0U);
+	zassert_equal(counts.error, 0U);
+	zassert_equal(counts.gap, 3U);
+}
+
+ZTEST(rx_stats, test_gap_wraps)
+{
+	struct rx_stats_counts counts;
+
+	sdu_recv(UINT16_MAX, BT_ISO_FLAGS_VALID);
+	sdu_recv(1U, BT_ISO_FLAGS_VALID);
+
+	counts_get(&counts);
+	zassert_equal(counts.gap, 1U);
+	zassert_equal(counts.duplicate, 0U);
+}
+
+ZTEST(rx_stats, test_duplicate)
+{
+	struct rx_stats_counts counts;
+
+	sdu_recv(0U, BT_ISO_FLAGS_VALID);
+	sdu_recv(1U, BT_ISO_FLAGS_VALID);
+	sdu_recv(1U, BT_ISO_FLAGS_VALID);
+
+	counts_get(&counts);
+	zassert_equal(counts.received, 3U);
+	zassert_equal(counts.duplicate, 1U);
+	zassert_equal(counts.gap, 0U);
+}